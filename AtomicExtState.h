@@ -0,0 +1,197 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_ATOMICEXTSTATE_H_
+#define __SLAVE_ATOMICEXTSTATE_H_
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "SlaveStats.h"
+
+namespace slave
+{
+// Same as DefaultExtState, but calls made on every event or row do not take a lock:
+// scalar fields are atomics and per-table counters are addressed by the index
+// returned from tableCountIndex(). Only the binlog position is guarded by a mutex.
+// Tables have to be registered with initTableCount() (Slave::setCallback does it)
+// before the slave is started.
+class AtomicExtState: public ExtStateIface {
+
+    // One cache line per counter, so tables counted by different dispatcher threads
+    // do not contend
+    struct Counter
+    {
+        std::atomic<unsigned long> value;
+        char pad[64 - sizeof(std::atomic<unsigned long>)];
+
+        Counter() : value(0) {}
+    };
+
+    std::atomic<time_t>         m_connect_time{0};
+    std::atomic<time_t>         m_last_filtered_update{0};
+    std::atomic<time_t>         m_last_event_time{0};
+    std::atomic<time_t>         m_last_update{0};
+    std::atomic<unsigned long>  m_intransaction_pos{0};
+    std::atomic<unsigned int>   m_connect_count{0};
+    std::atomic<bool>           m_state_processing{false};
+
+    std::mutex m_mutex;
+    Position m_position;
+
+    // Elements of deque do not move when new ones are added
+    std::deque<Counter> m_table_counts;
+    std::map<std::string, size_t> m_table_index;
+
+public:
+    State getState() override
+    {
+        State state;
+        state.connect_time = m_connect_time.load(std::memory_order_relaxed);
+        state.last_filtered_update = m_last_filtered_update.load(std::memory_order_relaxed);
+        state.last_event_time = m_last_event_time.load(std::memory_order_relaxed);
+        state.last_update = m_last_update.load(std::memory_order_relaxed);
+        state.intransaction_pos = m_intransaction_pos.load(std::memory_order_relaxed);
+        state.connect_count = m_connect_count.load(std::memory_order_relaxed);
+        state.state_processing = m_state_processing.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        state.position = m_position;
+        return state;
+    }
+    void setConnecting() override
+    {
+        m_connect_time.store(::time(NULL), std::memory_order_relaxed);
+        m_connect_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    time_t getConnectTime() override
+    {
+        return m_connect_time.load(std::memory_order_relaxed);
+    }
+    void setLastFilteredUpdateTime() override
+    {
+        m_last_filtered_update.store(::time(NULL), std::memory_order_relaxed);
+    }
+    time_t getLastFilteredUpdateTime() override
+    {
+        return m_last_filtered_update.load(std::memory_order_relaxed);
+    }
+    void setLastEventTimePos(time_t t, unsigned long pos) override
+    {
+        m_last_event_time.store(t, std::memory_order_relaxed);
+        m_intransaction_pos.store(pos, std::memory_order_relaxed);
+        m_last_update.store(::time(NULL), std::memory_order_relaxed);
+    }
+    time_t getLastUpdateTime() override
+    {
+        return m_last_update.load(std::memory_order_relaxed);
+    }
+    time_t getLastEventTime() override
+    {
+        return m_last_event_time.load(std::memory_order_relaxed);
+    }
+    unsigned long getIntransactionPos() override
+    {
+        return m_intransaction_pos.load(std::memory_order_relaxed);
+    }
+    void setMasterPosition(const Position& pos) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_position = pos;
+        m_intransaction_pos.store(pos.log_pos, std::memory_order_relaxed);
+    }
+    void saveMasterPosition() override {}
+    bool loadMasterPosition(Position& pos) override
+    {
+        pos.clear();
+        return false;
+    }
+    bool getMasterPosition(Position& pos) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_position.empty())
+            {
+                pos = m_position;
+                const unsigned long intransaction_pos = m_intransaction_pos.load(std::memory_order_relaxed);
+                if (intransaction_pos)
+                    pos.log_pos = intransaction_pos;
+                return true;
+            }
+        }
+        return loadMasterPosition(pos);
+    }
+    unsigned int getConnectCount() override
+    {
+        return m_connect_count.load(std::memory_order_relaxed);
+    }
+    void setStateProcessing(bool _state) override
+    {
+        m_state_processing.store(_state, std::memory_order_relaxed);
+    }
+    bool getStateProcessing() override
+    {
+        return m_state_processing.load(std::memory_order_relaxed);
+    }
+
+    void initTableCount(const std::string& t) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_table_index.emplace(t, m_table_counts.size()).second)
+            m_table_counts.emplace_back();
+    }
+    size_t tableCountIndex(const std::string& t) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_table_index.find(t);
+        return it == m_table_index.end() ? no_table_index : it->second;
+    }
+    void incTableCountAt(size_t index, unsigned long count) override
+    {
+        m_table_counts[index].value.fetch_add(count, std::memory_order_relaxed);
+    }
+    // Name-keyed versions are not used by Slave for registered tables
+    void incTableCount(const std::string& t) override
+    {
+        incTableCount(t, 1);
+    }
+    void incTableCount(const std::string& t, unsigned long count) override
+    {
+        const size_t index = tableCountIndex(t);
+        if (index != no_table_index)
+            incTableCountAt(index, count);
+    }
+
+    // Number of rows passed to callbacks of the table, 0 for unknown tables
+    unsigned long getTableCount(const std::string& t)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_table_index.find(t);
+        return it == m_table_index.end() ? 0 : m_table_counts[it->second].value.load(std::memory_order_relaxed);
+    }
+    std::map<std::string, unsigned long> getTableCounts()
+    {
+        std::map<std::string, unsigned long> result;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& x : m_table_index)
+            result[x.first] = m_table_counts[x.second].value.load(std::memory_order_relaxed);
+        return result;
+    }
+};
+
+}// slave
+
+#endif
@@ -0,0 +1,317 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Checkpointer.h"
+#include "Logging.h"
+
+namespace
+{
+const char* const header = "libslave-position\t1";
+
+std::runtime_error errno_error(const std::string& what, const std::string& path)
+{
+    return std::runtime_error(what + " " + path + ": " + ::strerror(errno));
+}
+
+void write_all(int fd, const std::string& data, const std::string& path)
+{
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left)
+    {
+        const ssize_t n = ::write(fd, p, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw errno_error("Can't write", path);
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+// The rename is durable only after the directory itself is synced
+void sync_dir(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw errno_error("Can't open", dir);
+    const int rc = ::fsync(fd);
+    ::close(fd);
+    if (rc != 0)
+        throw errno_error("Can't sync", dir);
+}
+
+std::string escape(const std::string& s)
+{
+    std::string r;
+    r.reserve(s.size());
+    for (const char c : s)
+    {
+        if (c == '\0')
+            r += "\\0";
+        else
+        {
+            if (c == '\\' || c == '\'')
+                r += '\\';
+            r += c;
+        }
+    }
+    return r;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+void FileCheckpointSink::save(const Position& pos)
+{
+    const std::string content = std::string(header) + "\n" + pos.log_name + "\t"
+        + std::to_string(pos.log_pos) + "\t" + pos.formatGtid() + "\n";
+
+    const std::string tmp = m_path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw errno_error("Can't open", tmp);
+    try
+    {
+        write_all(fd, content, tmp);
+        if (::fsync(fd) != 0)
+            throw errno_error("Can't sync", tmp);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    if (::close(fd) != 0)
+        throw errno_error("Can't close", tmp);
+
+    if (::rename(tmp.c_str(), m_path.c_str()) != 0)
+        throw errno_error("Can't rename", tmp);
+    sync_dir(m_path);
+}
+
+bool FileCheckpointSink::load(Position& pos)
+{
+    std::ifstream in(m_path.c_str());
+    if (!in)
+    {
+        if (errno == ENOENT)
+            return false;
+        throw errno_error("Can't open", m_path);
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != header)
+        throw std::runtime_error("Position file " + m_path + " has unknown format");
+
+    std::getline(in, line);
+    const size_t tab1 = line.find('\t');
+    const size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+    if (tab2 == std::string::npos)
+        throw std::runtime_error("Position file " + m_path + " is broken");
+
+    const std::string log_pos = line.substr(tab1 + 1, tab2 - tab1 - 1);
+    char* end = nullptr;
+    const unsigned long n = std::strtoul(log_pos.c_str(), &end, 10);
+    if (log_pos.empty() || *end != '\0')
+        throw std::runtime_error("Position file " + m_path + " is broken");
+
+    pos.clear();
+    pos.log_name = line.substr(0, tab1);
+    pos.log_pos = n;
+    pos.parseGtid(line.substr(tab2 + 1));
+    return true;
+}
+
+MysqlCheckpointSink::MysqlCheckpointSink(const nanomysql::mysql_conn_opts& opts, std::string table, std::string name)
+:   m_opts(opts)
+,   m_table(std::move(table))
+,   m_name(std::move(name))
+{}
+
+nanomysql::Connection& MysqlCheckpointSink::connection()
+{
+    if (!m_conn)
+        m_conn.reset(new nanomysql::Connection(m_opts));
+
+    if (!m_table_created)
+    {
+        m_conn->query("CREATE TABLE IF NOT EXISTS " + m_table + " ("
+                      "name VARCHAR(255) NOT NULL PRIMARY KEY, "
+                      "log_name VARCHAR(255) NOT NULL, "
+                      "log_pos BIGINT UNSIGNED NOT NULL, "
+                      "gtid_executed TEXT NOT NULL)");
+        m_table_created = true;
+    }
+    return *m_conn;
+}
+
+void MysqlCheckpointSink::save(const Position& pos)
+{
+    const std::string query = "REPLACE INTO " + m_table + " (name, log_name, log_pos, gtid_executed) VALUES ('"
+        + escape(m_name) + "', '" + escape(pos.log_name) + "', " + std::to_string(pos.log_pos) + ", '"
+        + escape(pos.formatGtid()) + "')";
+    try
+    {
+        connection().query(query);
+    }
+    catch (...)
+    {
+        m_conn.reset();
+        throw;
+    }
+}
+
+bool MysqlCheckpointSink::load(Position& pos)
+{
+    nanomysql::Connection::result_t res;
+    try
+    {
+        nanomysql::Connection& conn = connection();
+        conn.query("SELECT log_name, log_pos, gtid_executed FROM " + m_table + " WHERE name = '" + escape(m_name) + "'");
+        conn.store(res);
+    }
+    catch (...)
+    {
+        m_conn.reset();
+        throw;
+    }
+
+    if (res.empty())
+        return false;
+
+    pos.clear();
+    pos.log_name = res.front().at("log_name").data;
+    pos.log_pos = std::strtoul(res.front().at("log_pos").data.c_str(), nullptr, 10);
+    pos.parseGtid(res.front().at("gtid_executed").data);
+    return true;
+}
+
+Checkpointer::Checkpointer(std::unique_ptr<CheckpointSink> sink, unsigned interval_ms, unsigned every_positions)
+:   m_sink(std::move(sink))
+,   m_interval_ms(interval_ms ? interval_ms : 1)
+,   m_every_positions(every_positions)
+{
+    m_thread = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer()
+{
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_stopped = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void Checkpointer::submit(const Position& pos)
+{
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_pending = pos;
+        ++m_submitted;
+        wake = m_every_positions && ++m_since_save >= m_every_positions;
+    }
+    if (wake)
+        m_wake.notify_one();
+}
+
+void Checkpointer::flush()
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+    const uint64_t target = m_submitted;
+    if (m_saved_seq >= target)
+        return;
+    m_flush = true;
+    m_wake.notify_one();
+    m_saved.wait(l, [this, target] { return m_saved_seq >= target; });
+}
+
+uint64_t Checkpointer::saveCount()
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+    return m_save_count;
+}
+
+void Checkpointer::run()
+{
+    const std::chrono::milliseconds interval(m_interval_ms);
+    // Reused between rounds, so positions are copied without allocations
+    Position pos;
+
+    std::unique_lock<std::mutex> l(m_mutex);
+    while (true)
+    {
+        m_wake.wait_for(l, interval, [this]
+        {
+            return m_stopped || m_flush || (m_every_positions && m_since_save >= m_every_positions);
+        });
+
+        if (m_saved_seq == m_submitted)
+        {
+            if (m_stopped)
+                return;
+            m_flush = false;
+            continue;
+        }
+
+        pos = m_pending;
+        const uint64_t seq = m_submitted;
+        m_since_save = 0;
+        l.unlock();
+
+        bool saved = false;
+        try
+        {
+            m_sink->save(pos);
+            saved = true;
+        }
+        catch (const std::exception& _ex)
+        {
+            LOG_ERROR(log, "Checkpointer: failed to save position " << pos << ": " << _ex.what());
+        }
+
+        l.lock();
+        if (saved)
+        {
+            m_saved_seq = seq;
+            ++m_save_count;
+            m_saved.notify_all();
+        }
+        else if (m_stopped)
+            return;
+        else
+            // Do not hammer a failing sink, even when flush() waits
+            m_wake.wait_for(l, interval, [this] { return m_stopped; });
+    }
+}
+
+}// slave
@@ -0,0 +1,151 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_CHECKPOINTER_H_
+#define __SLAVE_CHECKPOINTER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "AtomicExtState.h"
+#include "binlog_pos.h"
+#include "nanomysql.h"
+
+namespace slave
+{
+
+// Persistent storage of master positions. Both calls throw on errors.
+struct CheckpointSink
+{
+    virtual void save(const Position& pos) = 0;
+    // Returns false if no position was saved yet
+    virtual bool load(Position& pos) = 0;
+
+    virtual ~CheckpointSink() {}
+};
+
+// Keeps the position in a file. It is written to a temporary file first, synced
+// and renamed, so the file always holds a complete position.
+class FileCheckpointSink : public CheckpointSink
+{
+public:
+    explicit FileCheckpointSink(std::string path) : m_path(std::move(path)) {}
+
+    void save(const Position& pos) override;
+    bool load(Position& pos) override;
+
+private:
+    const std::string m_path;
+};
+
+// Keeps positions in a MySQL table, one row per 'name', so several slaves may share it.
+// The table is created if it does not exist.
+class MysqlCheckpointSink : public CheckpointSink
+{
+public:
+    MysqlCheckpointSink(const nanomysql::mysql_conn_opts& opts, std::string table, std::string name);
+
+    void save(const Position& pos) override;
+    bool load(Position& pos) override;
+
+private:
+    // Connects if there is no connection, a failed query drops it
+    nanomysql::Connection& connection();
+
+    const nanomysql::mysql_conn_opts m_opts;
+    const std::string m_table;
+    const std::string m_name;
+    std::unique_ptr<nanomysql::Connection> m_conn;
+    bool m_table_created = false;
+};
+
+// Saves positions on a background thread. submit() only replaces the pending position,
+// so positions of transactions which come faster than they are saved are coalesced.
+// The pending position is saved every 'interval_ms' and as soon as 'every_positions'
+// positions were submitted since the last save (0 - only by time). Failed saves are
+// retried on the next round.
+class Checkpointer
+{
+public:
+    Checkpointer(std::unique_ptr<CheckpointSink> sink, unsigned interval_ms = 1000, unsigned every_positions = 0);
+    // Saves the pending position and stops the thread
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // Never waits for the sink
+    void submit(const Position& pos);
+
+    // Waits until the last submitted position is saved
+    void flush();
+
+    bool load(Position& pos) { return m_sink->load(pos); }
+
+    // Number of successful saves
+    uint64_t saveCount();
+
+private:
+    void run();
+
+    std::unique_ptr<CheckpointSink> m_sink;
+    const unsigned m_interval_ms;
+    const unsigned m_every_positions;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_saved;
+    Position m_pending;
+    // Sequence numbers of the last submitted and the last saved positions
+    uint64_t m_submitted = 0;
+    uint64_t m_saved_seq = 0;
+    // Submitted since the pending position was taken for saving
+    unsigned m_since_save = 0;
+    bool m_flush = false;
+    bool m_stopped = false;
+    uint64_t m_save_count = 0;
+
+    std::thread m_thread;
+};
+
+// AtomicExtState which persists master positions with a Checkpointer. Slave calls
+// saveMasterPosition() only when it starts from the current master position.
+class CheckpointExtState : public AtomicExtState
+{
+public:
+    explicit CheckpointExtState(Checkpointer& checkpointer) : m_checkpointer(checkpointer) {}
+
+    void setMasterPosition(const Position& pos) override
+    {
+        AtomicExtState::setMasterPosition(pos);
+        m_checkpointer.submit(pos);
+    }
+    void saveMasterPosition() override { m_checkpointer.flush(); }
+    bool loadMasterPosition(Position& pos) override
+    {
+        pos.clear();
+        return m_checkpointer.load(pos);
+    }
+
+private:
+    Checkpointer& m_checkpointer;
+};
+
+}// slave
+
+#endif
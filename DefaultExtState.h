@@ -109,6 +109,7 @@ public:
     }
     void initTableCount(const std::string& t) override {}
     void incTableCount(const std::string& t) override {}
+    void incTableCount(const std::string& t, unsigned long count) override {}
 };
 
 }// slave
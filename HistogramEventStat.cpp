@@ -0,0 +1,269 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <sstream>
+
+#include "HistogramEventStat.h"
+
+namespace
+{
+void print(std::ostream& os, const std::string& name, const slave::LatencyHistogram& h)
+{
+    os << name << " count=" << h.count() << " mean=" << static_cast<uint64_t>(h.mean())
+       << " p50=" << h.percentile(50) << " p90=" << h.percentile(90)
+       << " p99=" << h.percentile(99) << " p999=" << h.percentile(99.9)
+       << " max=" << h.maximum() << "\n";
+}
+
+void store_max(std::atomic<size_t>& max, size_t v)
+{
+    size_t cur = max.load(std::memory_order_relaxed);
+    while (v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+        ;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+const size_t LatencyHistogram::sub_buckets;
+const size_t LatencyHistogram::buckets;
+const uint64_t HistogramEventStat::IdSlot::empty;
+
+size_t LatencyHistogram::index(uint64_t v)
+{
+    // Values below 2 * sub_buckets have buckets of their own
+    if (v < 2 * sub_buckets)
+        return v;
+
+    const unsigned int exp = 63 - __builtin_clzll(v);
+    return (exp - 2) * sub_buckets + ((v >> (exp - 3)) & (sub_buckets - 1));
+}
+
+uint64_t LatencyHistogram::upper_bound(size_t index)
+{
+    if (index < 2 * sub_buckets)
+        return index;
+
+    const unsigned int exp = index / sub_buckets + 2;
+    const uint64_t lower = uint64_t(sub_buckets + index % sub_buckets) << (exp - 3);
+    return lower + ((uint64_t(1) << (exp - 3)) - 1);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    uint64_t n = 0;
+    for (const auto& c : m_counts)
+        n += c.load(std::memory_order_relaxed);
+    return n;
+}
+
+double LatencyHistogram::mean() const
+{
+    const uint64_t n = count();
+    return n ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n : 0;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    uint64_t counts[buckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets; ++i)
+        total += counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    uint64_t target = static_cast<uint64_t>(std::ceil(p / 100 * total));
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets; ++i)
+    {
+        seen += counts[i];
+        if (seen >= target)
+        {
+            const uint64_t bound = upper_bound(i);
+            return bound < maximum() ? bound : maximum();
+        }
+    }
+    return maximum();
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& c : m_counts)
+        c.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+HistogramEventStat::IdSlot& HistogramEventStat::IdTable::find(uint64_t id) const
+{
+    // Slot of the id or the empty one it would take, there is always an empty one
+    for (size_t i = (id * 0x9e3779b97f4a7c15ULL) >> 32;; ++i)
+    {
+        IdSlot& slot = slots[i & (size - 1)];
+        const uint64_t x = slot.id.load(std::memory_order_acquire);
+        if (x == id || x == IdSlot::empty)
+            return slot;
+    }
+}
+
+void HistogramEventStat::processTableMap(const unsigned long id, const std::string& table, const std::string& database)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& histograms = m_tables[database + "." + table];
+    if (!histograms)
+        histograms.reset(new TableHistograms);
+
+    IdTable* ids = m_ids.load(std::memory_order_relaxed);
+    if (ids)
+    {
+        IdSlot& slot = ids->find(id);
+        // Ids are reused by other tables after a restart of the master, as in RelayLogInfo::setTableName
+        if (slot.id.load(std::memory_order_relaxed) == id)
+        {
+            slot.histograms.store(histograms.get(), std::memory_order_release);
+            return;
+        }
+    }
+
+    // Keeps at least half of the slots empty
+    if (!ids || 2 * (ids->used + 1) > ids->size)
+    {
+        IdTable* grown = new IdTable(ids ? 2 * ids->size : 64);
+        m_id_tables.emplace_back(grown);
+        for (size_t i = 0; ids && i < ids->size; ++i)
+        {
+            const uint64_t x = ids->slots[i].id.load(std::memory_order_relaxed);
+            if (x == IdSlot::empty)
+                continue;
+            IdSlot& slot = grown->find(x);
+            slot.histograms.store(ids->slots[i].histograms.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            slot.id.store(x, std::memory_order_relaxed);
+        }
+        grown->used = ids ? ids->used : 0;
+        m_ids.store(grown, std::memory_order_release);
+        ids = grown;
+    }
+
+    IdSlot& slot = ids->find(id);
+    slot.histograms.store(histograms.get(), std::memory_order_release);
+    slot.id.store(id, std::memory_order_release);
+    ++ids->used;
+}
+
+HistogramEventStat::TableHistograms* HistogramEventStat::table(unsigned long id) const
+{
+    const IdTable* ids = m_ids.load(std::memory_order_acquire);
+    if (!ids)
+        return nullptr;
+
+    const IdSlot& slot = ids->find(id);
+    return slot.id.load(std::memory_order_acquire) == id ? slot.histograms.load(std::memory_order_acquire) : nullptr;
+}
+
+void HistogramEventStat::tickModifyRowDecoded(const unsigned long id, EventKind /*kind*/, uint64_t decodeTimeNanoSeconds)
+{
+    if (TableHistograms* t = table(id))
+        t->decode.add(decodeTimeNanoSeconds);
+}
+
+void HistogramEventStat::tickModifyRowDone(const unsigned long id, EventKind /*kind*/, uint64_t callbackWorkTimeNanoSeconds)
+{
+    // Rows which were not sampled
+    if (callbackWorkTimeNanoSeconds == 0)
+        return;
+    if (TableHistograms* t = table(id))
+        t->callback.add(callbackWorkTimeNanoSeconds);
+}
+
+void HistogramEventStat::tickModifyEventLag(const unsigned long id, EventKind /*kind*/, time_t lagSeconds)
+{
+    if (TableHistograms* t = table(id))
+        t->lag.add(lagSeconds > 0 ? lagSeconds : 0);
+}
+
+void HistogramEventStat::tickStage(ProbeStage stage, uint64_t bytes, uint64_t nanoSeconds)
+{
+    m_stage_time[stage].add(nanoSeconds);
+    m_stage_bytes[stage].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HistogramEventStat::tickAlloc(ProbeStage stage, uint64_t count, uint64_t bytes)
+{
+    m_stage_allocs[stage].fetch_add(count, std::memory_order_relaxed);
+    m_stage_alloc_bytes[stage].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HistogramEventStat::tickBacklog(BacklogQueue queue, size_t events, size_t bytes)
+{
+    Backlog& b = m_backlog[queue];
+    b.events.store(events, std::memory_order_relaxed);
+    b.bytes.store(bytes, std::memory_order_relaxed);
+    store_max(b.max_events, events);
+    store_max(b.max_bytes, bytes);
+}
+
+std::vector<std::pair<std::string, const HistogramEventStat::TableHistograms*>> HistogramEventStat::tables() const
+{
+    std::vector<std::pair<std::string, const TableHistograms*>> result;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& x : m_tables)
+        result.emplace_back(x.first, x.second.get());
+    return result;
+}
+
+std::string HistogramEventStat::report() const
+{
+    std::ostringstream os;
+    print(os, "network_wait_ns", m_network_wait);
+    print(os, "checksum_ns", m_checksum);
+
+    if (m_backpressure.count())
+        print(os, "backpressure_ns", m_backpressure);
+    static const char* const queue_names[bqQueueCount] = { "pipeline", "dispatch" };
+    for (int i = 0; i < bqQueueCount; ++i)
+    {
+        const BacklogQueue queue = static_cast<BacklogQueue>(i);
+        if (maxBacklogEvents(queue))
+            os << "backlog_" << queue_names[i] << " events=" << backlogEvents(queue) << " bytes=" << backlogBytes(queue)
+               << " max_events=" << maxBacklogEvents(queue) << " max_bytes=" << maxBacklogBytes(queue) << "\n";
+    }
+
+    static const char* const stage_names[psStageCount] = { "read", "checksum", "parse", "decode", "callback" };
+    for (int i = 0; i < psStageCount; ++i)
+    {
+        const ProbeStage stage = static_cast<ProbeStage>(i);
+        if (!m_stage_time[stage].count())
+            continue;
+        print(os, std::string("stage_") + stage_names[i] + "_ns", m_stage_time[stage]);
+        os << "stage_" << stage_names[i] << " bytes=" << stageBytes(stage)
+           << " allocs=" << stageAllocs(stage) << " alloc_bytes=" << stageAllocBytes(stage) << "\n";
+    }
+
+    for (const auto& x : tables())
+    {
+        if (!x.second->decode.count() && !x.second->callback.count() && !x.second->lag.count())
+            continue;
+        print(os, x.first + " decode_ns", x.second->decode);
+        print(os, x.first + " callback_ns", x.second->callback);
+        print(os, x.first + " lag_s", x.second->lag);
+    }
+    return os.str();
+}
+
+}// slave
@@ -0,0 +1,189 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_HISTOGRAMEVENTSTAT_H_
+#define __SLAVE_HISTOGRAMEVENTSTAT_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SlaveStats.h"
+
+namespace slave
+{
+
+// Log-linear histogram in the HdrHistogram manner: every power of two is split into
+// 8 buckets, so values are kept with 1/8 relative precision in 4K of memory.
+// add() is lock-free and may be called from several threads.
+class LatencyHistogram
+{
+public:
+
+    static const size_t sub_buckets = 8;
+    static const size_t buckets = (64 - 2) * sub_buckets;
+
+    LatencyHistogram() { reset(); }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void add(uint64_t v)
+    {
+        m_counts[index(v)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(v, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (v > max && !m_max.compare_exchange_weak(max, v, std::memory_order_relaxed))
+            ;
+    }
+
+    uint64_t count() const;
+    uint64_t maximum() const { return m_max.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    // Value not less than 'p' percent (0..100) of the values, rounded up to the bucket bound
+    uint64_t percentile(double p) const;
+
+    void reset();
+
+    static size_t index(uint64_t v);
+    // Largest value that falls into the bucket
+    static uint64_t upper_bound(size_t index);
+
+private:
+
+    std::atomic<uint64_t> m_counts[buckets];
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+// EventStatIface implementation that collects latency distributions: network wait and
+// checksum time for the whole stream, row decoding and callback time and replication lag
+// per table, time, bytes and allocations of the probed stages, depth of the queues of
+// unprocessed events and time the reading was stopped by the flow control. Times are
+// in nanoseconds, lag is in seconds. Only every 'sample_interval'th row or event is
+// timed, see EventStatIface::timingSampleInterval().
+class HistogramEventStat: public EventStatIface
+{
+public:
+
+    struct TableHistograms
+    {
+        LatencyHistogram decode;
+        // As passed to tickModifyRowDone, includes decoding
+        LatencyHistogram callback;
+        LatencyHistogram lag;
+    };
+
+    explicit HistogramEventStat(unsigned int sample_interval = 1) : m_sample_interval(sample_interval) {}
+
+    unsigned int timingSampleInterval() const override { return m_sample_interval; }
+
+    void processTableMap(const unsigned long id, const std::string& table, const std::string& database) override;
+
+    void tickNetworkWait(uint64_t nanoSeconds) override { m_network_wait.add(nanoSeconds); }
+    void tickChecksum(uint64_t nanoSeconds) override { m_checksum.add(nanoSeconds); }
+    void tickModifyRowDecoded(const unsigned long id, EventKind kind, uint64_t decodeTimeNanoSeconds) override;
+    void tickModifyRowDone(const unsigned long id, EventKind kind, uint64_t callbackWorkTimeNanoSeconds) override;
+    void tickModifyEventLag(const unsigned long id, EventKind kind, time_t lagSeconds) override;
+    void tickStage(ProbeStage stage, uint64_t bytes, uint64_t nanoSeconds) override;
+    void tickAlloc(ProbeStage stage, uint64_t count, uint64_t bytes) override;
+    void tickBacklog(BacklogQueue queue, size_t events, size_t bytes) override;
+    void tickBackpressure(uint64_t nanoSeconds) override { m_backpressure.add(nanoSeconds); }
+
+    const LatencyHistogram& networkWait() const { return m_network_wait; }
+    const LatencyHistogram& checksum() const { return m_checksum; }
+
+    // Queue depth as of the last event put into it and the largest one seen
+    size_t backlogEvents(BacklogQueue queue) const { return m_backlog[queue].events.load(std::memory_order_relaxed); }
+    size_t backlogBytes(BacklogQueue queue) const { return m_backlog[queue].bytes.load(std::memory_order_relaxed); }
+    size_t maxBacklogEvents(BacklogQueue queue) const { return m_backlog[queue].max_events.load(std::memory_order_relaxed); }
+    size_t maxBacklogBytes(BacklogQueue queue) const { return m_backlog[queue].max_bytes.load(std::memory_order_relaxed); }
+    const LatencyHistogram& backpressure() const { return m_backpressure; }
+
+    // Filled only by the library built with probes, see probes.h
+    const LatencyHistogram& stageTime(ProbeStage stage) const { return m_stage_time[stage]; }
+    uint64_t stageBytes(ProbeStage stage) const { return m_stage_bytes[stage].load(std::memory_order_relaxed); }
+    uint64_t stageAllocs(ProbeStage stage) const { return m_stage_allocs[stage].load(std::memory_order_relaxed); }
+    uint64_t stageAllocBytes(ProbeStage stage) const { return m_stage_alloc_bytes[stage].load(std::memory_order_relaxed); }
+
+    // Histograms of the tables seen in TABLE_MAP events, by "db.table"
+    std::vector<std::pair<std::string, const TableHistograms*>> tables() const;
+
+    // One line per histogram: count, mean, p50, p90, p99, p99.9 and max
+    std::string report() const;
+
+private:
+
+    // Open addressing map of table ids to histograms. It is filled only by processTableMap,
+    // under the mutex, and read by the per-row ticks without locks. A full one is replaced
+    // by a twice larger copy, old ones are kept until destruction as readers may use them.
+    struct IdSlot
+    {
+        static const uint64_t empty = ~uint64_t(0);
+
+        std::atomic<uint64_t> id{empty};
+        std::atomic<TableHistograms*> histograms{nullptr};
+    };
+
+    struct IdTable
+    {
+        explicit IdTable(size_t size_) : size(size_), slots(new IdSlot[size_]) {}
+
+        // Power of two
+        const size_t size;
+        std::unique_ptr<IdSlot[]> slots;
+        size_t used = 0;
+
+        IdSlot& find(uint64_t id) const;
+    };
+
+    // Histograms bound to the id by the last TABLE_MAP event, nullptr for unknown ids
+    TableHistograms* table(unsigned long id) const;
+
+    const unsigned int m_sample_interval;
+
+    LatencyHistogram m_network_wait;
+    LatencyHistogram m_checksum;
+
+    struct Backlog
+    {
+        std::atomic<size_t> events{0};
+        std::atomic<size_t> bytes{0};
+        std::atomic<size_t> max_events{0};
+        std::atomic<size_t> max_bytes{0};
+    };
+
+    Backlog m_backlog[bqQueueCount];
+    LatencyHistogram m_backpressure;
+
+    LatencyHistogram m_stage_time[psStageCount];
+    std::atomic<uint64_t> m_stage_bytes[psStageCount] = {};
+    std::atomic<uint64_t> m_stage_allocs[psStageCount] = {};
+    std::atomic<uint64_t> m_stage_alloc_bytes[psStageCount] = {};
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<TableHistograms>> m_tables;
+    std::vector<std::unique_ptr<IdTable>> m_id_tables;
+    std::atomic<IdTable*> m_ids{nullptr};
+};
+
+}// slave
+
+#endif
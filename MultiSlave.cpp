@@ -0,0 +1,196 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "Logging.h"
+#include "MultiSlave.h"
+
+namespace
+{
+// Longest epoll wait, so the interrupt flag and reconnects are checked often enough
+const int poll_timeout_ms = 100;
+}// anonymous-namespace
+
+namespace slave
+{
+
+MultiSlave::MultiSlave(unsigned dispatch_threads)
+{
+    if (dispatch_threads)
+        m_dispatcher = std::make_shared<Dispatcher>(dispatch_threads);
+
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0)
+    {
+        LOG_ERROR(log, "MultiSlave: epoll_create1 failed: " << ::strerror(errno));
+        throw std::runtime_error("MultiSlave::MultiSlave(): epoll_create1 failed");
+    }
+}
+
+MultiSlave::~MultiSlave()
+{
+    for (size_t i = 0; i < m_sources.size(); ++i)
+        close(i, false);
+    ::close(m_epoll);
+}
+
+void MultiSlave::add(Slave& slave)
+{
+    if (m_dispatcher)
+        slave.setDispatcher(m_dispatcher);
+
+    m_sources.emplace_back();
+    m_sources.back().slave = &slave;
+}
+
+bool MultiSlave::open(size_t index)
+{
+    Source& src = m_sources[index];
+    const time_t now = ::time(NULL);
+
+    try
+    {
+        // Blocks the loop: connect, registration and handshake are synchronous client calls
+        if (src.slave->open_dump_(m_read_chunk_size))
+        {
+            epoll_event ev;
+            ::memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.u64 = index;
+            if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, src.slave->dump_fd_(), &ev) != 0)
+                throw std::runtime_error(std::string("epoll_ctl failed: ") + ::strerror(errno));
+
+            src.connected = true;
+            src.last_read = now;
+            return true;
+        }
+    }
+    catch (const std::exception& _ex)
+    {
+        LOG_ERROR(log, "MultiSlave: failed to start reading binlog: " << _ex.what());
+        src.slave->close_dump_();
+    }
+
+    src.retry_at = now + src.slave->masterInfo().connect_retry;
+    return false;
+}
+
+void MultiSlave::close(size_t index, bool retry)
+{
+    Source& src = m_sources[index];
+    if (src.connected)
+    {
+        // Closing the socket removes it from epoll anyway, errors do not matter
+        ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, src.slave->dump_fd_(), nullptr);
+        src.connected = false;
+    }
+    src.slave->close_dump_();
+    src.gtid_next = gtid_t();
+    // The first reconnect is immediate, the same as for Slave::get_remote_binlog
+    src.retry_at = retry ? ::time(NULL) : 0;
+}
+
+void MultiSlave::run(const std::function<bool()>& _interruptFlag)
+{
+    std::vector<epoll_event> events(m_sources.empty() ? 1 : m_sources.size());
+    // Sources which have hit the packets per turn limit with data left in their buffers,
+    // epoll does not report them as the socket may be already empty
+    std::vector<size_t> busy, ready;
+    std::vector<char> is_ready(m_sources.size(), 0);
+
+    for (size_t i = 0; i < m_sources.size(); ++i)
+        open(i);
+
+    while (!_interruptFlag())
+    {
+        const time_t now = ::time(NULL);
+        for (size_t i = 0; i < m_sources.size(); ++i)
+        {
+            Source& src = m_sources[i];
+            if (!src.connected)
+            {
+                if (src.retry_at <= now)
+                    open(i);
+                continue;
+            }
+
+            const unsigned int timeout = src.slave->masterInfo().conn_options.mysql_read_timeout;
+            if (timeout && now - src.last_read > static_cast<time_t>(timeout))
+            {
+                LOG_WARNING(log, "MultiSlave: read timeout on " << src.slave->masterInfo().conn_options.mysql_host);
+                close(i, true);
+            }
+        }
+
+        const int n = ::epoll_wait(m_epoll, events.data(), events.size(), busy.empty() ? poll_timeout_ms : 0);
+        if (n < 0 && errno != EINTR)
+        {
+            LOG_ERROR(log, "MultiSlave: epoll_wait failed: " << ::strerror(errno));
+            throw std::runtime_error("MultiSlave::run(): epoll_wait failed");
+        }
+
+        ready.swap(busy);
+        busy.clear();
+        for (const size_t i : ready)
+            is_ready[i] = 1;
+        for (int k = 0; k < n; ++k)
+        {
+            const size_t i = events[k].data.u64;
+            m_sources[i].last_read = now;
+            if (!is_ready[i])
+            {
+                is_ready[i] = 1;
+                ready.push_back(i);
+            }
+        }
+
+        for (const size_t i : ready)
+        {
+            is_ready[i] = 0;
+            Source& src = m_sources[i];
+            if (!src.connected)
+                continue;
+
+            switch (src.slave->read_dump_(src.gtid_next, m_packets_per_turn))
+            {
+            case Slave::DUMP_BUSY:
+                src.last_read = now;
+                busy.push_back(i);
+                break;
+            case Slave::DUMP_LOST:
+                close(i, true);
+                break;
+            case Slave::DUMP_IDLE:
+                break;
+            }
+        }
+        ready.clear();
+    }
+
+    for (size_t i = 0; i < m_sources.size(); ++i)
+    {
+        close(i, false);
+        m_sources[i].slave->finishDispatched_();
+    }
+
+    LOG_WARNING(log, "MultiSlave was stopped. Binlog events are not listened.");
+}
+
+}// slave
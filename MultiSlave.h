@@ -0,0 +1,95 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_MULTISLAVE_H_
+#define __SLAVE_MULTISLAVE_H_
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Slave.h"
+
+namespace slave
+{
+
+// Reads binlogs of several masters in one thread. Dump connections are multiplexed
+// with epoll and read without blocking by own packet framing, events of every master
+// are handled by its Slave: its tables, callbacks, ExtStateIface and EventStatIface.
+// Row callbacks may run on a worker pool shared by all masters.
+//
+// Slaves are set up as for get_remote_binlog (init, callbacks, createDatabaseStructure)
+// and have to outlive the MultiSlave. SSL and compressed connections are not supported.
+//
+// Only reading is non-blocking. Connecting to a master, registering as a slave and
+// the checksum handshake are done with blocking client calls in the reading thread,
+// so events of other masters wait while a master is (re)connected, up to
+// mysql_connect_timeout and mysql_read_timeout of its connection. Likewise a slave that
+// reaches its Slave::setFlowControl cap stops reading of all masters until its
+// callbacks catch up.
+class MultiSlave
+{
+public:
+
+    // 'dispatch_threads' workers are shared by all slaves, 0 runs callbacks in the reading thread
+    explicit MultiSlave(unsigned dispatch_threads = 0);
+    ~MultiSlave();
+
+    MultiSlave(const MultiSlave&) = delete;
+    MultiSlave& operator=(const MultiSlave&) = delete;
+
+    // Makes sense only when run is not started
+    void add(Slave& slave);
+
+    // Size of the receive buffer of every connection, see Slave::setReadChunkSize.
+    // Makes sense only when run is not started
+    void setReadChunkSize(size_t size) { m_read_chunk_size = size; }
+
+    // Packets handled from one connection before switching to the next ready one.
+    // Makes sense only when run is not started
+    void setPacketsPerTurn(size_t packets) { m_packets_per_turn = packets ? packets : 1; }
+
+    // Reads events of all masters until '_interruptFlag' returns true. It is checked at least
+    // every 100 ms. Lost connections are reopened after MasterInfo::connect_retry seconds;
+    // other masters are not read while a connection is being opened, see above.
+    void run(const std::function<bool()>& _interruptFlag);
+
+private:
+
+    struct Source
+    {
+        Slave* slave;
+        bool connected = false;
+        // When to try to connect again
+        time_t retry_at = 0;
+        // Last time data was received, for mysql_read_timeout
+        time_t last_read = 0;
+        gtid_t gtid_next;
+    };
+
+    bool open(size_t index);
+    void close(size_t index, bool retry);
+
+    std::shared_ptr<Dispatcher> m_dispatcher;
+    std::vector<Source> m_sources;
+    int m_epoll = -1;
+
+    size_t m_read_chunk_size = 1024 * 1024;
+    size_t m_packets_per_turn = 256;
+};
+
+}// slave
+
+#endif
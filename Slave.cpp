@@ -15,13 +15,16 @@
 
 #include <algorithm>
 #include <memory>
-#include <regex>
 #include <string>
 
 #include "Slave.h"
 #include "SlaveStats.h"
+#include "binlog_file.h"
+#include "query_scanner.h"
+#include "schema_snapshot.h"
 
 #include "Logging.h"
+#include "probes.h"
 
 #include "nanomysql.h"
 
@@ -32,9 +35,12 @@
 #include <mysql/sql_common.h>
 
 #include <signal.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #define packet_end_data 1
+// Own framing in non-blocking mode has no complete packet yet
+#define packet_would_block 2
 
 #define ER_NET_PACKET_TOO_LARGE 1153
 #define ER_MASTER_FATAL_ERROR_READING_BINLOG 1236
@@ -146,198 +152,338 @@ void Slave::close_connection()
 }
 
 
-void Slave::createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli) const
+void Slave::setupTable_(const std::pair<std::string, std::string>& key, Table& table)
 {
-    LOG_TRACE(log, "enter: createDatabaseStructure");
+    table.m_callback = m_callbacks[key];
+    table.m_batch_callback = m_batch_callbacks[key];
+    table.m_columnar_callback = m_columnar_callbacks[key];
+    table.batch_flush = m_batch_flushes[key];
+    table.m_filter = m_filters[key];
+    table.set_column_filter(m_column_filters[key]);
+    table.row_type = m_row_types[key];
+    table.reuse_rows = m_reuse_rows;
+
+    const auto format = m_value_formats.find(key);
+    for (auto& field : table.fields)
+        field->set_value_format(format == m_value_formats.end() ? ValueFormat::Default : format->second);
+
+    if (table.m_columnar_callback)
+        table.init_column_batch();
+}
 
-    nanomysql::Connection conn(m_master_info.conn_options);
-    const collate_map_t collate_map = readCollateMap(conn);
+void Slave::flushColumnBatches_()
+{
+    for (const auto& x : m_rli.m_table_map)
+    {
+        const Table& table = *x.second;
+        if (table.m_columnar_callback && !table.batch_flush.per_event)
+            table.call_columnar_callback(ext_state);
+    }
+}
 
 
-    for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ++ it) {
+void Slave::finishDispatched_()
+{
+    try {
+        drainDispatcher();
+    } catch (const std::exception& _ex) {
+        LOG_ERROR(log, "Met exception in dispatched callback. Message: " << _ex.what());
+        if (event_stat)
+            event_stat->tickError();
+    }
+}
 
-        LOG_INFO( log, "Creating database structure for: " << it->first << ", Creating table for: " << it->second );
-        createTable(rli, it->first, it->second, collate_map, conn);
+void Slave::rebuildTable_(const std::pair<std::string, std::string>& key, const Table_map_event_info* tmi)
+{
+    finishDispatched_();
+
+    const PtrTable& table = m_rli.getTable(key);
+    // Collected rows have the old columns
+    if (table && table->m_columnar_callback)
+        table->call_columnar_callback(ext_state);
+    std::vector<PtrField> fields;
+    if (tmi && table && create_fields(*tmi, fields))
+    {
+        LOG_DEBUG(log, "Rebuilding table " << key.first << "." << key.second << " from TABLE_MAP.");
+        table->reset_fields(std::move(fields));
+        setupTable_(key, *table);
+        // Layout from TABLE_MAP is not kept in SHOW FULL COLUMNS form
+        m_schema.erase(key);
+        dropSchemaSnapshot_();
+        return;
     }
 
-    LOG_TRACE(log, "exit: createDatabaseStructure");
+    LOG_DEBUG(log, "Rebuilding database structure.");
+    table_order_t order {key};
+    createDatabaseStructure_(order, m_rli);
+    auto it = m_rli.m_table_map.find(key);
+    if (it != m_rli.m_table_map.end())
+        setupTable_(key, *it->second);
+    saveSchemaSnapshot_(m_master_info.position);
 }
 
+void Slave::markStale_(const std::pair<std::string, std::string>& key)
+{
+    m_stale_tables.insert(key);
+    m_schema.erase(key);
+    dropSchemaSnapshot_();
+}
 
-
-void Slave::createTable(RelayLogInfo& rli,
-                        const std::string& db_name, const std::string& tbl_name,
-                        const collate_map_t& collate_map, nanomysql::Connection& conn) const
+void Slave::createDatabaseStructure()
 {
-    LOG_TRACE(log, "enter: createTable " << db_name << " " << tbl_name);
+    drainDispatcher();
+    m_rli.clear();
+    m_stale_tables.clear();
+    m_schema.clear();
 
-    nanomysql::Connection::result_t res;
+    if (m_schema_snapshot_path.empty() || !loadSchemaSnapshot_()) {
 
-    conn.query("SHOW FULL COLUMNS FROM " + tbl_name + " IN " + db_name);
-    conn.store(res);
+        createDatabaseStructure_(m_table_order, m_rli);
 
-    std::unique_ptr<Table> table(new Table(db_name, tbl_name));
+        if (!m_schema_snapshot_path.empty()) {
+            // The structure is valid from the position the reading is going to start
+            Position pos;
+            if (!ext_state.getMasterPosition(pos))
+                pos = getLastBinlogPos();
+            saveSchemaSnapshot_(pos);
+        }
+    }
 
-    LOG_DEBUG(log, "Created new Table object: database:" << db_name << " table: " << tbl_name );
+    for (RelayLogInfo::name_to_table_t::iterator i = m_rli.m_table_map.begin(); i != m_rli.m_table_map.end(); ++i) {
+        setupTable_(i->first, *i->second);
+    }
+}
 
-    for (nanomysql::Connection::result_t::const_iterator i = res.begin(); i != res.end(); ++i) {
 
-        //row.at(0) - field name
-        //row.at(1) - field type
-        //row.at(2) - collation
-        //row.at(3) - can be null
+void Slave::createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli)
+{
+    LOG_TRACE(log, "enter: createDatabaseStructure");
 
-        std::map<std::string,nanomysql::field>::const_iterator z = i->find("Field");
+    table_columns_t columns;
+    readColumns_(tabs, columns);
 
-        if (z == i->end())
-            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Field'");
+    for (const auto& x : columns) {
 
-        std::string name = z->second.data;
+        LOG_INFO( log, "Creating database structure for: " << x.first.first << ", Creating table for: " << x.first.second );
+        createTable_(rli, x.first, x.second);
+        m_schema[x.first] = x.second;
+    }
 
-        z = i->find("Type");
+    LOG_TRACE(log, "exit: createDatabaseStructure");
+}
 
-        if (z == i->end())
-            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Type'");
 
-        std::string type = z->second.data;
+namespace
+{
+ColumnInfo column_info(const std::map<std::string, nanomysql::field>& row, const collate_map_t& collate_map)
+{
+    //row.at(0) - field name
+    //row.at(1) - field type
+    //row.at(2) - collation
+    //row.at(3) - can be null
 
-        z = i->find("Null");
+    ColumnInfo c;
 
-        if (z == i->end())
-            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Null'");
+    std::map<std::string,nanomysql::field>::const_iterator z = row.find("Field");
 
-        std::string extract_field;
+    if (z == row.end())
+        throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Field'");
 
-        // Extract field type
-        for (size_t tmpi = 0; tmpi < type.size(); ++tmpi) {
+    c.name = z->second.data;
 
-            if (!((type[tmpi] >= 'a' && type[tmpi] <= 'z') ||
-                  (type[tmpi] >= 'A' && type[tmpi] <= 'Z'))) {
+    z = row.find("Type");
 
-                extract_field = type.substr(0, tmpi);
-                break;
-            }
+    if (z == row.end())
+        throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Type'");
 
-            if (tmpi == type.size()-1) {
-                extract_field = type;
-                break;
-            }
-        }
+    c.type = z->second.data;
 
-        if (extract_field.empty())
-            throw std::runtime_error("Slave::create_table(): Regexp error, type not found");
+    z = row.find("Null");
 
-        collate_info ci;
-        if ("varchar" == extract_field || "char" == extract_field)
-        {
-            z = i->find("Collation");
-            if (z == i->end())
-                throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Collation' for field '" + name + "'");
-            const std::string collate = z->second.data;
-            collate_map_t::const_iterator it = collate_map.find(collate);
-            if (collate_map.end() == it)
-                throw std::runtime_error("Slave::create_table(): cannot find collate '" + collate + "' from field "
-                                         + name + " type " + type + " in collate info map");
-            ci = it->second;
-            LOG_DEBUG(log, "Created column: name-type: " << name << " - " << type
-                      << " Field type: " << extract_field << " Collation: " << ci.name);
-        }
-        else
-            LOG_DEBUG(log, "Created column: name-type: " << name << " - " << type
-                      << " Field type: " << extract_field );
+    if (z == row.end())
+        throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Null'");
 
-        PtrField field;
+    const std::string extract_field = field_type_name(c.type);
 
-        if (extract_field == "int")
-            field = PtrField(new Field_long(name, type));
-
-        else if (extract_field == "double")
-            field = PtrField(new Field_double(name, type));
-
-        else if (extract_field == "float")
-            field = PtrField(new Field_float(name, type));
-
-        else if (extract_field == "timestamp")
-            field = PtrField(new Field_timestamp(name, type, m_master_info.is_old_storage));
+    if ("varchar" == extract_field || "char" == extract_field)
+    {
+        z = row.find("Collation");
+        if (z == row.end())
+            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Collation' for field '" + c.name + "'");
+        const std::string collate = z->second.data;
+        collate_map_t::const_iterator it = collate_map.find(collate);
+        if (collate_map.end() == it)
+            throw std::runtime_error("Slave::create_table(): cannot find collate '" + collate + "' from field "
+                                     + c.name + " type " + c.type + " in collate info map");
+        c.collate = it->second;
+    }
 
-        else if (extract_field == "datetime")
-            field = PtrField(new Field_datetime(name, type, m_master_info.is_old_storage));
+    return c;
+}
 
-        else if (extract_field == "date")
-            field = PtrField(new Field_date(name, type));
+std::string quote(const std::string& s)
+{
+    std::string r = "'";
+    for (const char c : s)
+    {
+        if (c == '\'' || c == '\\')
+            r += c;
+        r += c;
+    }
+    return r + "'";
+}
 
-        else if (extract_field == "year")
-            field = PtrField(new Field_year(name, type));
+// Tables fetched by one information_schema query
+const size_t columns_query_tables = 500;
+}// anonymous-namespace
 
-        else if (extract_field == "time")
-            field = PtrField(new Field_time(name, type, m_master_info.is_old_storage));
+void Slave::readColumns_(const table_order_t& tabs, table_columns_t& columns) const
+{
+    nanomysql::Connection conn(m_master_info.conn_options);
+    const collate_map_t collate_map = readCollateMap(conn);
 
-        else if (extract_field == "enum")
-            field = PtrField(new Field_enum(name, type));
+    // One round-trip for many tables instead of SHOW FULL COLUMNS for each one
+    for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ) {
+
+        std::string where;
+        for (size_t n = 0; it != tabs.end() && n < columns_query_tables; ) {
+            const std::string& db = it->first;
+            where += where.empty() ? "(" : " OR (";
+            where += "TABLE_SCHEMA = " + quote(db) + " AND TABLE_NAME IN (";
+            for (bool first = true; it != tabs.end() && it->first == db && n < columns_query_tables; ++it, ++n, first = false)
+                where += (first ? "" : ", ") + quote(it->second);
+            where += "))";
+        }
 
-        else if (extract_field == "set")
-            field = PtrField(new Field_set(name, type));
+        nanomysql::Connection::result_t res;
+        conn.query("SELECT TABLE_SCHEMA AS `Db`, TABLE_NAME AS `Table`, COLUMN_NAME AS `Field`, COLUMN_TYPE AS `Type`, "
+                   "COLLATION_NAME AS `Collation`, IS_NULLABLE AS `Null` FROM information_schema.COLUMNS WHERE "
+                   + where + " ORDER BY TABLE_SCHEMA, TABLE_NAME, ORDINAL_POSITION");
+        conn.store(res);
+
+        for (const auto& row : res) {
+            const auto db = row.find("Db");
+            const auto tbl = row.find("Table");
+            if (db == row.end() || tbl == row.end())
+                throw std::runtime_error("Slave::readColumns_(): information_schema query did not return 'Db' or 'Table'");
+
+            const auto key = std::make_pair(db->second.data, tbl->second.data);
+            if (tabs.count(key))
+                columns[key].push_back(column_info(row, collate_map));
+        }
+    }
 
-        else if (extract_field == "varchar")
-            field = PtrField(new Field_varstring(name, type, ci));
+    // Names may differ in case from information_schema, or the table may be missing:
+    // SHOW FULL COLUMNS finds it or fails as before
+    for (const auto& key : tabs) {
+        if (!columns.count(key))
+            readTableColumns_(conn, key, collate_map, columns[key]);
+    }
+}
 
-        else if (extract_field == "char")
-            field = PtrField(new Field_varstring(name, type, ci));
+void Slave::readTableColumns_(nanomysql::Connection& conn, const std::pair<std::string, std::string>& key,
+                              const collate_map_t& collate_map, std::vector<ColumnInfo>& columns) const
+{
+    nanomysql::Connection::result_t res;
 
-        else if (extract_field == "tinyint")
-            field = PtrField(new Field_tiny(name, type));
+    conn.query("SHOW FULL COLUMNS FROM " + key.second + " IN " + key.first);
+    conn.store(res);
 
-        else if (extract_field == "smallint")
-            field = PtrField(new Field_short(name, type));
+    for (const auto& row : res)
+        columns.push_back(column_info(row, collate_map));
+}
 
-        else if (extract_field == "mediumint")
-            field = PtrField(new Field_medium(name, type));
+void Slave::createTable_(RelayLogInfo& rli, const std::pair<std::string, std::string>& key,
+                         const std::vector<ColumnInfo>& columns) const
+{
+    LOG_TRACE(log, "enter: createTable " << key.first << " " << key.second);
 
-        else if (extract_field == "bigint")
-            field = PtrField(new Field_longlong(name, type));
+    std::unique_ptr<Table> table(new Table(key.first, key.second));
+    table->count_index = ext_state.tableCountIndex(table->full_name);
 
-        else if (extract_field == "text")
-            field = PtrField(new Field_blob(name, type));
+    LOG_DEBUG(log, "Created new Table object: database:" << key.first << " table: " << key.second );
 
-        else if (extract_field == "tinytext")
-            field = PtrField(new Field_tinyblob(name, type));
+    for (const auto& c : columns) {
 
-        else if (extract_field == "mediumtext")
-            field = PtrField(new Field_mediumblob(name, type));
+        if (!c.collate.name.empty())
+            LOG_DEBUG(log, "Created column: name-type: " << c.name << " - " << c.type
+                      << " Field type: " << field_type_name(c.type) << " Collation: " << c.collate.name);
+        else
+            LOG_DEBUG(log, "Created column: name-type: " << c.name << " - " << c.type
+                      << " Field type: " << field_type_name(c.type) );
 
-        else if (extract_field == "longtext")
-            field = PtrField(new Field_longblob(name, type));
+        table->fields.push_back(create_field(c.name, c.type, c.collate, m_master_info.is_old_storage));
+    }
 
-        else if (extract_field == "blob")
-            field = PtrField(new Field_blob(name, type));
+    rli.setTable(key.second, key.first, std::move(table));
+}
 
-        else if (extract_field == "tinyblob")
-            field = PtrField(new Field_tinyblob(name, type));
+void Slave::createTable(RelayLogInfo& rli,
+                        const std::string& db_name, const std::string& tbl_name,
+                        const collate_map_t& collate_map, nanomysql::Connection& conn) const
+{
+    const auto key = std::make_pair(db_name, tbl_name);
+    std::vector<ColumnInfo> columns;
+    readTableColumns_(conn, key, collate_map, columns);
+    createTable_(rli, key, columns);
+}
 
-        else if (extract_field == "mediumblob")
-            field = PtrField(new Field_mediumblob(name, type));
+bool Slave::loadSchemaSnapshot_()
+{
+    SchemaSnapshot snapshot;
+    if (!snapshot.load(m_schema_snapshot_path))
+        return false;
+
+    Position start;
+    if (!ext_state.getMasterPosition(start) || !SchemaSnapshot::usableFrom(snapshot.position, start)) {
+        LOG_INFO(log, "Schema snapshot of " << snapshot.position << " can not be used from binlog position " << start);
+        return false;
+    }
 
-        else if (extract_field == "longblob")
-            field = PtrField(new Field_longblob(name, type));
+    for (const auto& key : m_table_order) {
+        if (!snapshot.tables.count(key)) {
+            LOG_INFO(log, "Schema snapshot has no table " << key.first << "." << key.second);
+            return false;
+        }
+    }
 
-        else if (extract_field == "decimal")
-            field = PtrField(new Field_decimal(name, type));
+    for (const auto& key : m_table_order) {
+        createTable_(m_rli, key, snapshot.tables[key]);
+        m_schema[key] = snapshot.tables[key];
+    }
 
-        else if (extract_field == "bit")
-            field = PtrField(new Field_bit(name, type));
+    LOG_INFO(log, "Database structure is loaded from schema snapshot of " << snapshot.position);
+    return true;
+}
 
-        else {
-            LOG_ERROR(log, "createTable: class name don't exist: " << extract_field );
-            throw std::runtime_error("class name does not exist: " + extract_field);
+void Slave::saveSchemaSnapshot_(const Position& pos)
+{
+    if (m_schema_snapshot_path.empty())
+        return;
+
+    SchemaSnapshot snapshot;
+    snapshot.position = pos;
+    for (const auto& key : m_table_order) {
+        const auto it = m_schema.find(key);
+        if (it == m_schema.end()) {
+            // Columns of the table are not known until its next TABLE_MAP
+            dropSchemaSnapshot_();
+            return;
         }
-
-        table->fields.push_back(std::move(field));
-
+        snapshot.tables.insert(*it);
     }
 
+    try {
+        snapshot.save(m_schema_snapshot_path);
+    } catch (const std::exception& _ex) {
+        LOG_ERROR(log, "Failed to save schema snapshot: " << _ex.what());
+    }
+}
 
-    rli.setTable(tbl_name, db_name, std::move(table));
-
+void Slave::dropSchemaSnapshot_()
+{
+    if (!m_schema_snapshot_path.empty() && ::unlink(m_schema_snapshot_path.c_str()) != 0 && errno != ENOENT)
+        LOG_WARNING(log, "Can't remove schema snapshot " << m_schema_snapshot_path << ": " << errno);
 }
 
 namespace
@@ -410,6 +556,10 @@ struct raii_mysql_connector
         if(was_error)
             LOG_INFO(log, "Successfully connected to " << sConnOptions.mysql_host << ":" << sConnOptions.mysql_port);
 
+        if (sConnOptions.mysql_rcvbuf > 0 &&
+            ::setsockopt(mysql->net.fd, SOL_SOCKET, SO_RCVBUF, &sConnOptions.mysql_rcvbuf, sizeof(sConnOptions.mysql_rcvbuf)) != 0)
+            LOG_WARNING(log, "Can't set SO_RCVBUF of the connection to master: " << errno);
+
 
         mysql->reconnect = 1;
 
@@ -423,6 +573,38 @@ struct raii_mysql_connector
         mysql_close(mysql);
     }
 };
+
+// Stops and joins thread which fills the event queue in pipelined mode
+struct raii_queue_reader
+{
+    EventQueue* queue;
+    std::thread& thread;
+
+    raii_queue_reader(EventQueue* q, std::thread& t) : queue(q), thread(t) {}
+
+    ~raii_queue_reader() {
+        join();
+    }
+
+    void join()
+    {
+        if (thread.joinable()) {
+            queue->stop();
+            thread.join();
+        }
+    }
+};
+
+// Releases processed slot of the event queue
+struct raii_queue_slot
+{
+    EventQueue* queue;
+
+    ~raii_queue_slot() {
+        if (queue)
+            queue->pop();
+    }
+};
 }// anonymous-namespace
 
 
@@ -444,33 +626,33 @@ void Slave::get_remote_binlog(const std::function<bool()>& _interruptFlag)
 
     register_slave_on_master(&mysql);
 
+    std::unique_ptr<EventQueue> queue;
+    if (m_pipeline_depth)
+        queue.reset(new EventQueue(m_pipeline_depth, m_flow_max_bytes));
+    std::thread reader;
+    raii_queue_reader __reader(queue.get(), reader);
+
 connected:
-    do_checksum_handshake(&mysql);
+    start_dump_(m_read_chunk_size, false);
+    gtid_t gtid_next;
 
-    // Get binlog position saved in ext_state before, or load it
-    // from persistent storage. Get false if failed to get binlog position.
-    if(!ext_state.getMasterPosition(m_master_info.position))
-    {
-        // If there is not binlog position saved before,
-        // get last binlog name and last binlog position.
-        LOG_INFO(log, "There is no saved binlog_pos");
-        m_master_info.position = getLastBinlogPos();
-        ext_state.setMasterPosition(m_master_info.position);
-        ext_state.saveMasterPosition();
+    if (queue) {
+        queue->reset();
+        reader = std::thread(&Slave::read_events_to_queue, this, std::ref(*queue), ::pthread_self());
     }
 
-    LOG_INFO(log, "Starting from binlog_pos: " << m_master_info.position);
-
-    request_dump(m_master_info.position, &mysql);
-    gtid_t gtid_next;
-
     while (!_interruptFlag()) {
 
         try {
 
             LOG_TRACE(log, "-- reading event --");
 
-            unsigned long len = read_event(&mysql);
+            const unsigned char* packet = nullptr;
+            raii_queue_slot __slot {queue.get()};
+
+            // Set by the processing thread only, the pipelined reader may run ahead of it
+            ext_state.setStateProcessing(false);
+            unsigned long len = queue ? read_queued_event(*queue, reader, packet) : read_event(&mysql, packet);
 
             ext_state.setStateProcessing(true);
 
@@ -518,108 +700,289 @@ connected:
                 continue;
             }
 
-            slave::Basic_event_info event;
+            process_packet_(packet, len, gtid_next, !queue);
 
-            if (!slave::read_log_event((const char*) mysql.net.read_pos + 1,
-                                       len - 1,
-                                       event,
-                                       event_stat,
-                                       masterGe56(),
-                                       m_master_info)) {
+        } catch (const std::exception& _ex ) {
 
-                LOG_TRACE(log, "Skipping unknown event.");
-                continue;
-            }
+            LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
+            if (event_stat)
+                event_stat->tickError();
+            usleep(1000*1000);
+            continue;
 
-            //
+        }
 
-            LOG_TRACE(log, "Event log position: " << event.log_pos );
+    } //while
 
-            if (event.log_pos != 0) {
-                m_master_info.position.log_pos = event.log_pos;
-                ext_state.setLastEventTimePos(event.when, event.log_pos);
-            }
+    __reader.join();
 
-            LOG_TRACE(log, "seconds_behind_master: " << (::time(NULL) - event.when) );
+    finishDispatched_();
 
+    LOG_WARNING(log, "Binlog monitor was stopped. Binlog events are not listened.");
 
-            // MySQL5.1.23 binlogs can be read only starting from a XID_EVENT
-            // MySQL5.1.23 ev->log_pos -- the binlog offset
+    deregister_slave_on_master(&mysql);
+}
 
-            if (event.type == XID_EVENT) {
+void Slave::start_dump_(size_t read_chunk_size, bool nonblocking)
+{
+    do_checksum_handshake(&mysql);
+    if (m_skip_replication_filter)
+        do_skip_replication(&mysql);
 
-                if (!gtid_next.first.empty())
-                    m_master_info.position.addGtid(gtid_next);
-                ext_state.setMasterPosition(m_master_info.position);
+    // Get binlog position saved in ext_state before, or load it
+    // from persistent storage. Get false if failed to get binlog position.
+    if(!ext_state.getMasterPosition(m_master_info.position))
+    {
+        // If there is not binlog position saved before,
+        // get last binlog name and last binlog position.
+        LOG_INFO(log, "There is no saved binlog_pos");
+        m_master_info.position = getLastBinlogPos();
+        ext_state.setMasterPosition(m_master_info.position);
+        ext_state.saveMasterPosition();
+    }
 
-                LOG_TRACE(log, "Got XID event. Using binlog pos: " << m_master_info.position);
+    LOG_INFO(log, "Starting from binlog_pos: " << m_master_info.position);
 
-                if (m_xid_callback)
-                    m_xid_callback(event.server_id);
+    request_dump(m_master_info.position, &mysql);
 
-            } else  if (event.type == ROTATE_EVENT) {
+    // Nothing is read after the dump request yet, so the stream can be taken over from libmysqlclient
+    if (read_chunk_size && !mysql_get_ssl_cipher(&mysql) && !mysql.net.compress) {
+        if (!m_packet_reader)
+            m_packet_reader.reset(new PacketReader(read_chunk_size));
+        m_packet_reader->reset(mysql.net.fd, m_master_info.conn_options.mysql_read_timeout, nonblocking);
+    } else {
+        m_packet_reader.reset();
+    }
+}
 
-                slave::Rotate_event_info rei(event.buf, event.event_len);
+bool Slave::skip_event_(const char* buf, unsigned int event_len)
+{
+    // Broken events are left for read_log_event to report
+    if (event_len < LOG_EVENT_HEADER_LEN)
+        return false;
+
+    if (slave::ignorable_event(buf, event_len)) {
+        if (event_stat) {
+            event_stat->tick(uint4korr(buf));
+            event_stat->tickOther();
+        }
+        return true;
+    }
 
-                /*
-                 * new_log_ident - new binlog name
-                 * pos - position of the starting event
-                 */
+    if (!m_early_table_filter)
+        return false;
 
-                LOG_INFO(log, "Got rotate event.");
+    switch (buf[EVENT_TYPE_OFFSET]) {
 
-                /* WTF
-                 */
+    case TABLE_MAP_EVENT:
+        // Tables waiting for TABLE_MAP after DDL are among these too
+        if (!skip_table_map_event(m_rli, buf, event_len, m_table_order))
+            return false;
+        break;
 
-                if (event.when == 0) {
+    case WRITE_ROWS_EVENT_V1:
+    case UPDATE_ROWS_EVENT_V1:
+    case DELETE_ROWS_EVENT_V1:
+    case WRITE_ROWS_EVENT:
+    case UPDATE_ROWS_EVENT:
+    case DELETE_ROWS_EVENT:
+    {
+        slave::Basic_event_info bei;
+        bei.parse(buf, event_len);
+        if (!skip_row_event(m_rli, bei, event_stat))
+            return false;
+        break;
+    }
 
-                    //LOG_TRACE(log, "ROTATE_FAKE");
-                }
+    default:
+        return false;
+    }
 
-                m_master_info.position.log_name = rei.new_log_ident;
-                m_master_info.position.log_pos = rei.pos; // this will always be equal to 4
+    if (event_stat)
+        event_stat->tick(uint4korr(buf));
+    return true;
+}
 
-                ext_state.setMasterPosition(m_master_info.position);
+void Slave::process_packet_(const unsigned char* packet, unsigned long len, gtid_t& gtid_next, bool verify_checksum)
+{
+    if (skip_event_((const char*) packet + 1, len - 1))
+        return;
 
-                LOG_TRACE(log, "new position is " << m_master_info.position);
-                LOG_TRACE(log, "ROTATE_EVENT processed OK.");
-            }
-            else if (event.type == GTID_LOG_EVENT)
-            {
-                LOG_TRACE(log, "Got GTID event.");
-                if (!gtid_next.first.empty())
-                {
-                    m_master_info.position.addGtid(gtid_next);
-                    ext_state.setMasterPosition(m_master_info.position);
-                }
-                Gtid_event_info gei(event.buf, event.event_len);
-                LOG_TRACE(log, "GTID_NEXT: sid = " << gei.m_sid << ", gno =  " << gei.m_gno);
-                gtid_next.first = gei.m_sid;
-                gtid_next.second = gei.m_gno;
-            }
+    slave::Basic_event_info event;
 
-            if (process_event(event, m_rli))
-            {
-                LOG_TRACE(log, "Error in processing event.");
-            }
+    if (!slave::read_log_event((const char*) packet + 1,
+                               len - 1,
+                               event,
+                               event_stat,
+                               masterGe56(),
+                               m_master_info,
+                               verify_checksum)) {
 
+        LOG_TRACE(log, "Skipping unknown event.");
+        return;
+    }
 
+    handle_event(event, gtid_next);
+}
 
-        } catch (const std::exception& _ex ) {
+bool Slave::open_dump_(size_t read_chunk_size)
+{
+    if (!m_server_id)
+        generateSlaveId();
 
-            LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
+    ext_state.setConnecting();
+
+    if (!(mysql_guard::mysql_safe_init(&mysql)))
+        throw std::runtime_error("Slave::open_dump_() : mysql_init() : could not initialize mysql structure");
+
+    const auto& sConnOptions = m_master_info.conn_options;
+    nanomysql::Connection::setOptions(&mysql, sConnOptions);
+
+    if (mysql_guard::mysql_safe_connect(&mysql,
+                                        sConnOptions.mysql_host.c_str(),
+                                        sConnOptions.mysql_user.c_str(),
+                                        sConnOptions.mysql_pass.c_str(), 0, sConnOptions.mysql_port, 0, CLIENT_REMEMBER_OPTIONS) == 0) {
+        LOG_ERROR(log, "Couldn't connect to mysql master " << sConnOptions.mysql_host << ":" << sConnOptions.mysql_port
+                  << ": " << mysql_error(&mysql));
+        mysql_close(&mysql);
+        return false;
+    }
+    m_dump_opened = true;
+
+    if (sConnOptions.mysql_rcvbuf > 0 &&
+        ::setsockopt(mysql.net.fd, SOL_SOCKET, SO_RCVBUF, &sConnOptions.mysql_rcvbuf, sizeof(sConnOptions.mysql_rcvbuf)) != 0)
+        LOG_WARNING(log, "Can't set SO_RCVBUF of the connection to master: " << errno);
+
+    register_slave_on_master(&mysql);
+    start_dump_(read_chunk_size, true);
+
+    // libmysqlclient reads would block the other masters
+    if (!m_packet_reader) {
+        LOG_ERROR(log, "Connection to " << sConnOptions.mysql_host << ":" << sConnOptions.mysql_port
+                  << " uses SSL or compression, which can not be read without blocking");
+        throw std::runtime_error("Slave::open_dump_(): SSL and compressed connections are not supported");
+    }
+
+    LOG_INFO(log, "Reading binlog of " << sConnOptions.mysql_host << ":" << sConnOptions.mysql_port);
+    return true;
+}
+
+void Slave::close_dump_()
+{
+    if (!m_dump_opened)
+        return;
+    m_dump_opened = false;
+    m_packet_reader.reset();
+    mysql_close(&mysql);
+}
+
+Slave::DumpState Slave::read_dump_(gtid_t& gtid_next, size_t max_packets)
+{
+    for (size_t i = 0; i < max_packets; ++i) {
+
+        const unsigned char* packet = nullptr;
+        ext_state.setStateProcessing(false);
+        const ulong len = read_event(&mysql, packet);
+
+        if (len == packet_would_block)
+            return DUMP_IDLE;
+
+        if (len == packet_error || len == packet_end_data) {
+            LOG_WARNING(log, "Myslave: Error from MySQL " << m_master_info.conn_options.mysql_host << ": " << mysql_error(&mysql));
+            return DUMP_LOST;
+        }
+
+        ext_state.setStateProcessing(true);
+
+        try {
+            process_packet_(packet, len, gtid_next, true);
+        } catch (const std::exception& _ex) {
+            LOG_ERROR(log, "Met exception in read_dump cycle. Message: " << _ex.what());
             if (event_stat)
                 event_stat->tickError();
-            usleep(1000*1000);
-            continue;
-
         }
+    }
 
-    } //while
+    return DUMP_BUSY;
+}
 
-    LOG_WARNING(log, "Binlog monitor was stopped. Binlog events are not listened.");
+void Slave::get_local_binlog(const std::vector<std::string>& files, const std::function<bool()>& _interruptFlag)
+{
+    Position start;
+    const bool has_position = ext_state.getMasterPosition(start);
 
-    deregister_slave_on_master(&mysql);
+    size_t first = 0;
+    if (has_position && !start.log_name.empty())
+    {
+        auto it = std::find_if(files.begin(), files.end(),
+                               [&start](const std::string& f) { return BinlogFile::name(f) == start.log_name; });
+        if (it != files.end())
+            first = it - files.begin();
+        else
+            LOG_WARNING(log, "Binlog '" << start.log_name << "' of saved position is not among local files, starting from the first one");
+    }
+
+    gtid_t gtid_next;
+
+    for (size_t i = first; i < files.size() && !_interruptFlag(); ++i) {
+
+        BinlogFile file(files[i]);
+
+        LOG_INFO(log, "Reading local binlog: " << file.path());
+
+        // Format of the events depends on the server that has written the file
+        const int version = file.server_version();
+        if (version)
+            m_master_version = version;
+
+        // Checksum algorithm comes from the format description event
+        m_master_info.checksum_alg = BINLOG_CHECKSUM_ALG_OFF;
+        m_master_info.position.log_name = file.name();
+        m_master_info.position.log_pos = BinlogFile::first_event_pos;
+        ext_state.setMasterPosition(m_master_info.position);
+
+        const size_t start_pos = (i == first && has_position && start.log_name == file.name()) ? start.log_pos : 0;
+        bool first_event = true;
+
+        unsigned int len = 0;
+        while (!_interruptFlag()) {
+
+            const char* buf = file.next(len);
+            if (!buf)
+                break;
+
+            ext_state.setStateProcessing(true);
+
+            try {
+
+                slave::Basic_event_info event;
+
+                if (skip_event_(buf, len))
+                    LOG_TRACE(log, "Skipping unneeded event.");
+                else if (slave::read_log_event(buf, len, event, event_stat, masterGe56(), m_master_info))
+                    handle_event(event, gtid_next);
+                else
+                    LOG_TRACE(log, "Skipping unknown event.");
+
+            } catch (const std::exception& _ex) {
+
+                LOG_ERROR(log, "Met exception in get_local_binlog cycle. Message: " << _ex.what() );
+                if (event_stat)
+                    event_stat->tickError();
+            }
+
+            // Events up to the saved position are skipped, format description is still needed
+            if (first_event) {
+                first_event = false;
+                if (start_pos > file.tell())
+                    file.seek(start_pos);
+            }
+        }
+
+        ext_state.setStateProcessing(false);
+    }
+
+    finishDispatched_();
 }
 
 void Slave::register_slave_on_master(MYSQL* mysql)
@@ -786,24 +1149,123 @@ void Slave::do_checksum_handshake(MYSQL* mysql)
 
 
 
-namespace
-{
-std::string checkAlterOrCreateQuery(const std::string& str)
+
+
+
+void Slave::do_skip_replication(MYSQL* mysql)
 {
-    static const std::regex query_regex(R"(\s*(?:alter\s+table|create\s+table(?:\s+if\s+not\s+exists)?)\s+(?:`?\w+`?\.)?`?(\w+)`?(?:[^\w\.`].*$|$))",
-                                        std::regex_constants::optimize | std::regex_constants::icase);
+    // MariaDB master does not send events flagged with LOG_EVENT_SKIP_REPLICATION_F to such dump connection
+    const char query[] = "SET skip_replication=1";
 
-    std::string s;
-    std::replace_copy(str.begin(), str.end(), std::back_inserter(s), '\n', ' ');
+    if (mysql_real_query(mysql, query, static_cast<ulong>(strlen(query))))
+    {
+        if (mysql_errno(mysql) != ER_UNKNOWN_SYSTEM_VARIABLE)
+            throw std::runtime_error("Slave::do_skip_replication(MYSQL* mysql): query 'SET skip_replication=1' failed");
 
-    std::smatch sm;
-    if (std::regex_match(s, sm, query_regex))
-        return sm[1];
-    return "";
+        LOG_WARNING(log, "Master does not support skip_replication, all events are sent");
+    }
+    mysql_free_result(mysql_store_result(mysql));
 }
-}// anonymouos-namespace
 
+void Slave::handle_event(const slave::Basic_event_info& event, gtid_t& gtid_next)
+{
+    LOG_TRACE(log, "Event log position: " << event.log_pos );
+
+    if (event.log_pos != 0) {
+        m_master_info.position.log_pos = event.log_pos;
+        ext_state.setLastEventTimePos(event.when, event.log_pos);
+    }
+
+    LOG_TRACE(log, "seconds_behind_master: " << (::time(NULL) - event.when) );
+
+
+    // MySQL5.1.23 binlogs can be read only starting from a XID_EVENT
+    // MySQL5.1.23 ev->log_pos -- the binlog offset
+
+    if (event.type == XID_EVENT) {
+
+        finishDispatched_();
+        flushColumnBatches_();
+
+        if (!gtid_next.first.empty())
+            m_master_info.position.addGtid(gtid_next);
+        ext_state.setMasterPosition(m_master_info.position);
+
+        LOG_TRACE(log, "Got XID event. Using binlog pos: " << m_master_info.position);
+
+        if (m_xid_callback)
+            m_xid_callback(event.server_id);
+
+    } else  if (event.type == ROTATE_EVENT) {
+
+        slave::Rotate_event_info rei(event.buf, event.event_len);
+
+        /*
+         * new_log_ident - new binlog name
+         * pos - position of the starting event
+         */
+
+        LOG_INFO(log, "Got rotate event.");
+
+        finishDispatched_();
 
+        /* WTF
+         */
+
+        if (event.when == 0) {
+
+            //LOG_TRACE(log, "ROTATE_FAKE");
+        }
+
+        m_master_info.position.log_name = rei.new_log_ident;
+        m_master_info.position.log_pos = rei.pos; // this will always be equal to 4
+
+        ext_state.setMasterPosition(m_master_info.position);
+
+        LOG_TRACE(log, "new position is " << m_master_info.position);
+        LOG_TRACE(log, "ROTATE_EVENT processed OK.");
+    }
+    else if (event.type == GTID_LOG_EVENT)
+    {
+        LOG_TRACE(log, "Got GTID event.");
+        finishDispatched_();
+        if (!gtid_next.first.empty())
+        {
+            m_master_info.position.addGtid(gtid_next);
+            ext_state.setMasterPosition(m_master_info.position);
+        }
+        Gtid_event_info gei(event.buf, event.event_len);
+        LOG_TRACE(log, "GTID_NEXT: sid = " << gei.m_sid << ", gno =  " << gei.m_gno);
+        gtid_next.first = gei.m_sid;
+        gtid_next.second = gei.m_gno;
+    }
+    else if (event.type == TRANSACTION_PAYLOAD_EVENT)
+    {
+        LOG_TRACE(log, "Got TRANSACTION_PAYLOAD event.");
+
+        // Inner events have no checksums and no binlog positions of their own:
+        // the whole transaction ends at the position of the payload event set above.
+        MasterInfo payload_info;
+        slave::Transaction_payload_event_info tpi(event.buf, event.event_len);
+
+        unsigned int len = 0;
+        while (const char* buf = tpi.next(len))
+        {
+            slave::Basic_event_info inner;
+            if (!slave::read_log_event(buf, len, inner, event_stat, masterGe56(), payload_info, false))
+                continue;
+
+            inner.log_pos = 0;
+            handle_event(inner, gtid_next);
+        }
+        return;
+    }
+
+    if (process_event(event, m_rli))
+    {
+        LOG_TRACE(log, "Error in processing event.");
+    }
+}
 
 int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli)
 {
@@ -817,29 +1279,69 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
 
     case QUERY_EVENT:
     {
-        // Check for ALTER TABLE or CREATE TABLE
+        // Classified in place, without copying the query
+
+        const slave::Query_event_view qev(bei.buf, bei.event_len);
+
+        LOG_TRACE(log, "Received QUERY_EVENT: " << std::string(qev.query, qev.query_len));
 
-        slave::Query_event_info qei(bei.buf, bei.event_len);
+        DdlScanner ddl(qev.query, qev.query_len);
+        if (ddl.queryKind() == QUERY_BEGIN)
+        {
+            if (m_begin_callback)
+                m_begin_callback(bei.server_id);
+            break;
+        }
+        if (ddl.queryKind() == QUERY_COMMIT || ddl.queryKind() == QUERY_ROLLBACK)
+        {
+            // Transactions of non-transactional tables, rows of those are in binlog either way
+            finishDispatched_();
+            flushColumnBatches_();
+            break;
+        }
+        // Temporary table is seen only by its session, tracked table of the same name is intact
+        if (ddl.queryKind() != QUERY_DDL || ddl.temporary())
+            break;
 
-        LOG_TRACE(log, "Received QUERY_EVENT: " << qei.query);
+        // Check for DDL on tracked tables
 
-        const auto tbl_name = checkAlterOrCreateQuery(qei.query);
-        if (!tbl_name.empty())
+        DdlTable t;
+        for (size_t i = 0; ddl.next(t); ++i)
         {
-            const auto key = std::make_pair(qei.db_name, tbl_name);
-            if (m_table_order.count(key) == 1)
+            const auto key = std::make_pair(t.db.empty() ? std::string(qev.db_name, qev.db_len) : t.db.str(), t.table.str());
+            if (m_table_order.count(key) == 0)
+                continue;
+
+            switch (ddl.kind())
             {
-                LOG_DEBUG(log, "Rebuilding database structure.");
-                table_order_t order {key};
-                createDatabaseStructure_(order, m_rli);
-                auto it = m_rli.m_table_map.find(key);
-                if (it != m_rli.m_table_map.end())
+            case DdlScanner::RENAME_TABLE:
+                if (i % 2 == 0)
                 {
-                    it->second->m_callback = m_callbacks[key];
-                    it->second->m_filter = m_filters[key];
-                    it->second->set_column_filter(m_column_filters[key]);
-                    it->second->row_type = m_row_types[key];
+                    // Old name, the table is gone for now
+                    markStale_(key);
+                    break;
                 }
+                // New name gets structure of the renamed table
+            case DdlScanner::ALTER_TABLE:
+            case DdlScanner::CREATE_TABLE:
+                if (m_schema_from_table_map)
+                {
+                    LOG_DEBUG(log, "Table " << key.first << "." << key.second << " will be rebuilt from TABLE_MAP.");
+                    markStale_(key);
+                }
+                else
+                {
+                    m_stale_tables.erase(key);
+                    rebuildTable_(key, nullptr);
+                }
+                break;
+            case DdlScanner::DROP_TABLE:
+                // Rebuilt on the next TABLE_MAP, if the table is created again
+                markStale_(key);
+                break;
+            default:
+                // TRUNCATE does not change structure
+                break;
             }
         }
         break;
@@ -849,10 +1351,24 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
     {
         LOG_TRACE(log, "Got TABLE_MAP_EVENT.");
 
+        SLAVE_PROBE_BEGIN(probe, event_stat, psParse);
         slave::Table_map_event_info tmi(bei.buf, bei.event_len);
+        SLAVE_PROBE_END(probe, bei.event_len);
 
         m_rli.setTableName(tmi.m_table_id, tmi.m_tblnam, tmi.m_dbnam);
 
+        if (!m_stale_tables.empty())
+        {
+            const auto key = std::make_pair(tmi.m_dbnam, tmi.m_tblnam);
+            // Tables dropped or renamed away come back from TABLE_MAP only if that is enabled,
+            // the mark is kept until the rebuild succeeds
+            if (m_stale_tables.count(key))
+            {
+                rebuildTable_(key, m_schema_from_table_map ? &tmi : nullptr);
+                m_stale_tables.erase(key);
+            }
+        }
+
         if (m_master_version >= 50604)
         {
             const auto& table = m_rli.getTable(std::make_pair(tmi.m_dbnam, tmi.m_tblnam));
@@ -866,12 +1382,12 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
                     case MYSQL_TYPE_TIMESTAMP:
                     case MYSQL_TYPE_DATETIME:
                     case MYSQL_TYPE_TIME:
-                        static_cast<Field_temporal*>(table->fields[i].get())->reset(true);
+                        resetTemporalField(static_cast<Field_temporal*>(table->fields[i].get()), true);
                         break;
                     case MYSQL_TYPE_TIMESTAMP2:
                     case MYSQL_TYPE_DATETIME2:
                     case MYSQL_TYPE_TIME2:
-                        static_cast<Field_temporal*>(table->fields[i].get())->reset(false);
+                        resetTemporalField(static_cast<Field_temporal*>(table->fields[i].get()), false);
                         break;
                     default:
                         break;
@@ -898,7 +1414,22 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
                                   bei.type == DELETE_ROWS_EVENT_V1 || bei.type == DELETE_ROWS_EVENT ? "DELETE" :
                                   "UPDATE") << "_ROWS_EVENT");
 
+        if (skip_row_event(m_rli, bei, event_stat))
+            break;
+
+        SLAVE_PROBE_BEGIN(probe, event_stat, psParse);
         Row_event_info roi(bei.buf, bei.event_len, (bei.type == UPDATE_ROWS_EVENT_V1 || bei.type == UPDATE_ROWS_EVENT), masterGe56());
+        SLAVE_PROBE_END(probe, bei.event_len);
+
+        if (m_dispatcher)
+        {
+            const Table* table = m_rli.getTableById(roi.m_table_id);
+            if (table)
+            {
+                dispatch_row_event(table, bei, roi);
+                break;
+            }
+        }
 
         apply_row_event(m_rli, bei, roi, ext_state, event_stat);
 
@@ -912,6 +1443,44 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
     return 0;
 }
 
+void Slave::resetTemporalField(Field_temporal* field, bool old_storage)
+{
+    if (field->old_storage() == old_storage)
+        return;
+
+    // Workers may be unpacking previous events of this table
+    finishDispatched_();
+    field->reset(old_storage);
+}
+
+void Slave::dispatch_row_event(const Table* table, const Basic_event_info& bei, const Row_event_info& roi)
+{
+    // Event buffer belongs to the network layer, so worker gets its own copy
+    auto data = std::make_shared<std::vector<char>>(bei.buf, bei.buf + bei.event_len);
+
+    Basic_event_info task_bei = bei;
+    task_bei.buf = data->data();
+
+    Row_event_info task_roi = roi;
+    task_roi.m_rows_buf = (unsigned char*)data->data() + (roi.m_rows_buf - (const unsigned char*)bei.buf);
+    task_roi.m_rows_end = (unsigned char*)data->data() + (roi.m_rows_end - (const unsigned char*)bei.buf);
+
+    // Blocks while the flow control caps are reached
+    const Dispatcher::Backlog backlog =
+        m_dispatcher->dispatch(m_dispatch_group, std::hash<std::string>()(table->full_name),
+                               [this, data, table, task_bei, task_roi]()
+                               {
+                                   apply_row_event(table, task_bei, task_roi, ext_state, event_stat);
+                               },
+                               data->size());
+
+    if (event_stat) {
+        event_stat->tickBacklog(bqDispatch, backlog.tasks, backlog.bytes);
+        if (backlog.wait_ns)
+            event_stat->tickBackpressure(backlog.wait_ns);
+    }
+}
+
 void Slave::request_dump_wo_gtid(const std::string& logname, unsigned long start_position, MYSQL* mysql)
 {
     uchar buf[128];
@@ -924,6 +1493,7 @@ void Slave::request_dump_wo_gtid(const std::string& logname, unsigned long start
     //
     //start_position = 4;
 
+    // BINLOG_SEND_ANNOTATE_ROWS_EVENT is not set, so MariaDB does not send rows queries
     int binlog_flags = 0;
     int4store(buf, (uint32)start_position);
     int2store(buf + BIN_LOG_HEADER_SIZE, binlog_flags);
@@ -974,17 +1544,43 @@ void Slave::request_dump(const Position& pos, MYSQL* mysql)
     }
 }
 
-ulong Slave::read_event(MYSQL* mysql)
+ulong Slave::read_event(MYSQL* mysql, const unsigned char*& packet)
 {
 
     ulong len;
-    ext_state.setStateProcessing(false);
 
+    const bool timed = event_stat && event_stat->sampleTiming(tsNetworkWait);
+    const uint64_t wait_start = timed ? monotonic_ns() : 0;
+    SLAVE_PROBE_BEGIN(probe, event_stat, psRead);
+
+    if (m_packet_reader) {
+        // Errors are stored the way libmysqlclient does, for mysql_errno() and mysql_error()
+        if (!m_packet_reader->read(packet, len)) {
+            if (m_packet_reader->wouldBlock())
+                return packet_would_block;
+            mysql->net.last_errno = CR_SERVER_LOST;
+            ::snprintf(mysql->net.last_error, sizeof(mysql->net.last_error),
+                       "Lost connection to MySQL server: %s", m_packet_reader->error().c_str());
+            len = packet_error;
+        } else if (len > 0 && packet[0] == 255) {
+            // Error packet: 0xff, error code, '#' and sqlstate since 4.1, message
+            mysql->net.last_errno = len >= 3 ? uint2korr(packet + 1) : CR_UNKNOWN_ERROR;
+            const size_t msg = (len >= 9 && packet[3] == '#') ? 9 : (len < 3 ? len : 3);
+            ::snprintf(mysql->net.last_error, sizeof(mysql->net.last_error),
+                       "%.*s", static_cast<int>(len - msg), packet + msg);
+            len = packet_error;
+        }
+    } else {
 #if MYSQL_VERSION_ID < 50705
-    len = cli_safe_read(mysql);
+        len = cli_safe_read(mysql);
 #else
-    len = cli_safe_read(mysql, nullptr);
+        len = cli_safe_read(mysql, nullptr);
 #endif
+        packet = mysql->net.read_pos;
+    }
+
+    if (timed && len != packet_error)
+        event_stat->tickNetworkWait(monotonic_ns() - wait_start);
 
     if (len == packet_error) {
         LOG_ERROR(log, "Myslave: Error reading packet from server: " << mysql_error(mysql)
@@ -993,8 +1589,10 @@ ulong Slave::read_event(MYSQL* mysql)
         return packet_error;
     }
 
+    SLAVE_PROBE_END(probe, len);
+
     // check for end-of-data
-    if (len < 8 && mysql->net.read_pos[0] == 254) {
+    if (len < 8 && packet[0] == 254) {
 
         LOG_ERROR(log, "read_event(): end of data\n");
         return packet_end_data;
@@ -1043,6 +1641,82 @@ void Slave::generateSlaveId()
     LOG_DEBUG(log, "Generated m_server_id = " << m_server_id);
 }
 
+void Slave::read_events_to_queue(EventQueue& queue, pthread_t owner_thread_id)
+{
+    // close_connection() has to interrupt this thread, as it is the one blocked on reading
+    {
+        std::lock_guard<std::mutex> l(m_slave_thread_mutex);
+        m_slave_thread_id = ::pthread_self();
+    }
+
+    // Checksums are verified here to take CRC computation off the processing thread,
+    // so the algorithm is tracked by format description events on this side too
+    enum_binlog_checksum_alg checksum_alg = m_master_info.checksum_alg;
+    const unsigned int checksum_interval = m_master_info.checksum_verify_interval;
+    unsigned int checksum_counter = 0;
+
+    while (EventQueue::Slot* slot = queue.acquire()) {
+
+        const unsigned char* packet = nullptr;
+        const ulong len = read_event(&mysql, packet);
+        slot->len = len;
+        slot->checksum_failed = false;
+        const bool has_data = len != packet_error && len != packet_end_data;
+        if (has_data) {
+            slot->data.assign(packet, packet + len);
+
+            const char* buf = (const char*) slot->data.data() + 1;
+            const unsigned int event_len = len - 1;
+
+            if (len > LOG_EVENT_MINIMAL_HEADER_LEN + BINLOG_CHECKSUM_LEN + BINLOG_CHECKSUM_ALG_DESC_LEN) {
+                if (masterGe56() && buf[EVENT_TYPE_OFFSET] == FORMAT_DESCRIPTION_EVENT) {
+                    const enum_binlog_checksum_alg alg = static_cast<enum_binlog_checksum_alg>(
+                        *(buf + event_len - BINLOG_CHECKSUM_LEN - BINLOG_CHECKSUM_ALG_DESC_LEN));
+                    if (alg == BINLOG_CHECKSUM_ALG_OFF || alg == BINLOG_CHECKSUM_ALG_CRC32)
+                        checksum_alg = alg;
+                }
+
+                // Ignorable events are dropped by the processing thread without looking inside
+                if (checksum_alg == BINLOG_CHECKSUM_ALG_CRC32 && checksum_interval && !slave::ignorable_event(buf, event_len) &&
+                    ++checksum_counter >= checksum_interval) {
+                    checksum_counter = 0;
+                    slot->checksum_failed = !slave::verify_checksum(buf, event_len, event_stat);
+                }
+            }
+        }
+
+        queue.push(has_data ? len : 0);
+        if (has_data && event_stat)
+            event_stat->tickBacklog(bqPipeline, queue.queued(), queue.queuedBytes());
+
+        // Connection is handled by the owner thread after it gets error from the queue
+        if (!has_data)
+            break;
+    }
+
+    std::lock_guard<std::mutex> l(m_slave_thread_mutex);
+    m_slave_thread_id = owner_thread_id;
+}
+
+ulong Slave::read_queued_event(EventQueue& queue, std::thread& reader, const unsigned char*& packet)
+{
+    const EventQueue::Slot* slot = queue.front();
+    if (!slot)
+        return packet_error;
+
+    if (slot->len == packet_error || slot->len == packet_end_data) {
+        // Reader has finished, mysql structure can be used by this thread again
+        reader.join();
+        return slot->len;
+    }
+
+    if (slot->checksum_failed)
+        throw std::runtime_error("slave::read_log_event failed");
+
+    packet = slot->data.data();
+    return slot->len;
+}
+
 Position Slave::getLastBinlogPos() const
 {
     nanomysql::Connection conn(m_master_info.conn_options);
@@ -29,12 +29,17 @@
 #include <set>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #include <pthread.h>
 
 #include <mysql/mysql.h>
 
 #include "binlog_pos.h"
+#include "dispatcher.h"
+#include "event_queue.h"
+#include "packet_reader.h"
+#include "schema_snapshot.h"
 #include "slave_log_event.h"
 #include "SlaveStats.h"
 
@@ -49,18 +54,22 @@ public:
 
     typedef std::set<std::pair<std::string, std::string>> table_order_t;
     typedef std::map<std::pair<std::string, std::string>, callback> callbacks_t;
+    typedef std::map<std::pair<std::string, std::string>, batch_callback> batch_callbacks_t;
     typedef std::map<std::pair<std::string, std::string>, filter> filters_t;
 
     typedef std::vector<std::string> cols_t;
     typedef std::map<std::pair<std::string, std::string>, cols_t> column_filters_t;
     typedef std::map<std::pair<std::string, std::string>, RowType> row_types_t;
+    typedef std::map<std::pair<std::string, std::string>, ValueFormat> value_formats_t;
+    typedef std::map<std::pair<std::string, std::string>, columnar_callback> columnar_callbacks_t;
+    typedef std::map<std::pair<std::string, std::string>, BatchFlush> batch_flushes_t;
 
 private:
     static inline bool falseFunction() { return false; };
 
     MYSQL mysql;
 
-    int m_server_id;
+    int m_server_id = 0;
     int m_master_version = 0;
     bool m_gtid_enabled = false;
 
@@ -71,19 +80,80 @@ private:
 
     table_order_t m_table_order;
     callbacks_t m_callbacks;
+    batch_callbacks_t m_batch_callbacks;
     filters_t m_filters;
     column_filters_t m_column_filters;
     row_types_t m_row_types;
+    value_formats_t m_value_formats;
+    columnar_callbacks_t m_columnar_callbacks;
+    batch_flushes_t m_batch_flushes;
+    bool m_reuse_rows = false;
+    unsigned m_pipeline_depth = 0;
+    size_t m_flow_max_bytes = 0;
+    size_t m_read_chunk_size = 0;
+    bool m_schema_from_table_map = false;
+    bool m_early_table_filter = false;
+    bool m_skip_replication_filter = false;
+    // Tables changed by DDL, waiting for their next TABLE_MAP event
+    table_order_t m_stale_tables;
+    std::string m_schema_snapshot_path;
+    // Columns of the tables as read from the master, for the schema snapshot
+    table_columns_t m_schema;
+    // Set while the dump stream is read by own framing instead of libmysqlclient
+    std::unique_ptr<PacketReader> m_packet_reader;
+    // May be shared with other slaves, see setDispatcher()
+    std::shared_ptr<Dispatcher> m_dispatcher;
+    Dispatcher::Group m_dispatch_group;
 
     typedef std::function<void (unsigned int)> xid_callback_t;
     xid_callback_t m_xid_callback;
+    typedef std::function<void (unsigned int)> begin_callback_t;
+    begin_callback_t m_begin_callback;
 
     RelayLogInfo m_rli;
 
     pthread_t m_slave_thread_id = 0;
     std::mutex m_slave_thread_mutex;
 
-    void createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli) const;
+    void createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli);
+    // Columns of all tables in one information_schema query, SHOW FULL COLUMNS for the rest
+    void readColumns_(const table_order_t& tabs, table_columns_t& columns) const;
+    void readTableColumns_(nanomysql::Connection& conn, const std::pair<std::string, std::string>& key,
+                           const collate_map_t& collate_map, std::vector<ColumnInfo>& columns) const;
+    void createTable_(RelayLogInfo& rli, const std::pair<std::string, std::string>& key,
+                      const std::vector<ColumnInfo>& columns) const;
+    void markStale_(const std::pair<std::string, std::string>& key);
+    bool loadSchemaSnapshot_();
+    void saveSchemaSnapshot_(const Position& pos);
+    void dropSchemaSnapshot_();
+    void setupTable_(const std::pair<std::string, std::string>& key, Table& table);
+    void rebuildTable_(const std::pair<std::string, std::string>& key, const Table_map_event_info* tmi);
+    void drainDispatcher() { if (m_dispatcher) m_dispatcher->drain(m_dispatch_group); }
+    // Same, but an error of a dispatched callback is logged and counted instead of thrown,
+    // as for an inline one, so bookkeeping of the event that waits for workers goes on
+    void finishDispatched_();
+    // Passes rows of transaction-wide column batches to their callbacks, at the end of transaction
+    void flushColumnBatches_();
+
+    // Sends the dump request on the connected 'mysql' and sets up reading of the stream
+    void start_dump_(size_t read_chunk_size, bool nonblocking);
+    // Drops the raw event before its checksum is verified and it is parsed if nobody needs it
+    bool skip_event_(const char* buf, unsigned int event_len);
+    // Parses a packet of the dump stream and handles its event
+    void process_packet_(const unsigned char* packet, unsigned long len, gtid_t& gtid_next, bool verify_checksum);
+
+    // Stepwise reading of the dump stream by MultiSlave, on a non-blocking socket.
+    // open_dump_ tries to connect once, returns false if the master is unavailable.
+    // It blocks until the connection is set up, only reading the dump is non-blocking.
+    friend class MultiSlave;
+    enum DumpState { DUMP_IDLE, DUMP_BUSY, DUMP_LOST };
+    bool open_dump_(size_t read_chunk_size);
+    void close_dump_();
+    int dump_fd_() const { return mysql.net.fd; }
+    // Handles up to 'max_packets' received packets. Returns DUMP_IDLE when the socket
+    // has no more data, DUMP_BUSY when the limit is reached, DUMP_LOST on connection errors.
+    DumpState read_dump_(gtid_t& gtid_next, size_t max_packets);
+    bool m_dump_opened = false;
 
 public:
 
@@ -121,6 +191,8 @@ public:
         const std::pair<std::string, std::string> key = std::make_pair(_db_name, _tbl_name);
         m_table_order.insert(key);
         m_callbacks[key] = _callback;
+        m_batch_callbacks.erase(key);
+        m_columnar_callbacks.erase(key);
         m_filters[key] = filter;
         m_column_filters[key] = cols_t();
         m_row_types[key] = row_type;
@@ -128,25 +200,177 @@ public:
         ext_state.initTableCount(_db_name + "." + _tbl_name);
     }
 
+    // Format of DECIMAL, DATETIME and TIMESTAMP values of the table, ValueFormat::Default if not set.
+    // Makes sense only when get_remote_binlog is not started
+    void setValueFormat(const std::string& _db_name, const std::string& _tbl_name, ValueFormat format)
+    {
+        m_value_formats[std::make_pair(_db_name, _tbl_name)] = format;
+    }
+
+    // Same as setCallback, but the callback gets all rows of a *_ROWS_EVENT at once.
+    // Table statistics are updated once per batch.
+    void setBatchCallback(const std::string& _db_name, const std::string& _tbl_name, batch_callback _callback,
+                          const cols_t& column_filter, RowType row_type = RowType::Map, EventKind filter = eAll)
+    {
+        setBatchCallback(_db_name, _tbl_name, _callback, row_type, filter);
+        m_column_filters[std::make_pair(_db_name, _tbl_name)] = column_filter;
+    }
+
+    void setBatchCallback(const std::string& _db_name, const std::string& _tbl_name, batch_callback _callback,
+                          RowType row_type = RowType::Map, EventKind filter = eAll)
+    {
+        setCallback(_db_name, _tbl_name, callback(), row_type, filter);
+        m_batch_callbacks[std::make_pair(_db_name, _tbl_name)] = _callback;
+    }
+
+    // Same as setCallback, but rows are decoded straight into the columns of ColumnBatch, which
+    // is passed to the callback as 'flush' says. The batch and its memory are reused: it is cleared
+    // when the callback returns. Columns follow the table order, the column filter only selects them.
+    void setColumnarCallback(const std::string& _db_name, const std::string& _tbl_name, columnar_callback _callback,
+                             const cols_t& column_filter, BatchFlush flush = BatchFlush(), EventKind filter = eAll)
+    {
+        setColumnarCallback(_db_name, _tbl_name, _callback, flush, filter);
+        m_column_filters[std::make_pair(_db_name, _tbl_name)] = column_filter;
+    }
+
+    void setColumnarCallback(const std::string& _db_name, const std::string& _tbl_name, columnar_callback _callback,
+                             BatchFlush flush = BatchFlush(), EventKind filter = eAll)
+    {
+        setCallback(_db_name, _tbl_name, callback(), RowType::Map, filter);
+        const std::pair<std::string, std::string> key = std::make_pair(_db_name, _tbl_name);
+        m_columnar_callbacks[key] = _callback;
+        m_batch_flushes[key] = flush;
+    }
+
     void setXidCallback(xid_callback_t _callback)
     {
         m_xid_callback = _callback;
     }
 
-    void get_remote_binlog(const std::function<bool()>& _interruptFlag = &Slave::falseFunction);
+    // Called with server id on BEGIN of every transaction, before its row events.
+    // Makes sense only when get_remote_binlog is not started
+    void setBeginCallback(begin_callback_t _callback)
+    {
+        m_begin_callback = _callback;
+    }
 
-    void createDatabaseStructure() {
+    // Makes every table reuse one RecordSet for all its rows instead of building a new one
+    // per row. RecordSet passed to callback is valid only until the callback returns.
+    // Makes sense only when get_remote_binlog is not started
+    void enableRecordSetReuse(bool on = true)
+    {
+        m_reuse_rows = on;
+        for (auto& x : m_rli.m_table_map)
+            x.second->reuse_rows = on;
+    }
 
-        m_rli.clear();
+    // Makes get_remote_binlog read events from the master in a separate thread while the calling
+    // thread parses them and runs callbacks. Up to 'depth' events are buffered, so a slow callback
+    // does not stall the master. 0 (the default) reads and processes events in one thread.
+    // ExtStateIface and EventStatIface have to be thread-safe: network wait, checksum and
+    // backlog ticks come from the reading thread, the rest from the processing one.
+    // Makes sense only when get_remote_binlog is not started
+    void setPipelineDepth(unsigned depth)
+    {
+        m_pipeline_depth = depth;
+    }
 
-        createDatabaseStructure_(m_table_order, m_rli);
+    // Bounds memory held by events read from the master but not processed yet. Row events
+    // dispatched to worker threads are capped by 'max_events' and 'max_bytes', packets buffered
+    // by the pipelined reading by 'max_bytes' (their number is the pipeline depth). 0 means no cap.
+    // When a cap is reached, reading stops until callbacks catch up and TCP flow control holds
+    // the master back, so a huge transaction does not have to fit in memory.
+    // Under MultiSlave the caps are still per slave, but reaching one blocks the reading
+    // thread, so all masters wait for the callbacks of that slave.
+    // Makes sense only when get_remote_binlog is not started
+    void setFlowControl(size_t max_events, size_t max_bytes)
+    {
+        m_flow_max_bytes = max_bytes;
+        m_dispatch_group.setLimits(max_events, max_bytes);
+    }
+
+    // Makes get_remote_binlog receive the dump stream in chunks of up to 'size' bytes and split it
+    // into packets by itself instead of reading packet by packet through libmysqlclient, so bursts
+    // of small events cost less syscalls. Not used on SSL or compressed connections.
+    // 0 (the default) turns it off. Makes sense only when get_remote_binlog is not started
+    void setReadChunkSize(size_t size)
+    {
+        m_read_chunk_size = size;
+    }
+
+    // After ALTER TABLE or CREATE TABLE of a tracked table, rebuilds its columns from the next
+    // TABLE_MAP event instead of querying SHOW FULL COLUMNS on the master. Needs column names
+    // in the binlog (binlog_row_metadata=FULL, MySQL 8.0), otherwise SHOW FULL COLUMNS
+    // is used as before. Makes sense only when get_remote_binlog is not started
+    void enableSchemaFromTableMap(bool on = true)
+    {
+        m_schema_from_table_map = on;
+    }
+
+    // Drops TABLE_MAP events of tables without callbacks and ROWS events of such tables or of
+    // filtered out kinds right after the event header is read, before checksum verification
+    // and parsing. EventStatIface::processTableMap is not called for the dropped TABLE_MAP
+    // events then. MySQL can not filter the dump by table on its side, so this is the cheapest
+    // way to follow a few tables of a busy master. Makes sense only when get_remote_binlog is not started
+    void enableEarlyTableFilter(bool on = true)
+    {
+        m_early_table_filter = on;
+    }
+
+    // MariaDB only: asks the master not to send events written with @@skip_replication=1,
+    // as replicate_events_marked_for_skip=FILTER_ON_MASTER does. Other masters send them as
+    // usual. Makes sense only when get_remote_binlog is not started
+    void enableSkipReplicationFilter(bool on = true)
+    {
+        m_skip_replication_filter = on;
+    }
+
+    // Verifies binlog checksum of every 'interval'th event only: 1 (the default) verifies all
+    // of them, 0 disables verification. With pipelining enabled checksums are verified by the
+    // reading thread. Makes sense only when get_remote_binlog is not started
+    void setChecksumVerifyInterval(unsigned interval)
+    {
+        m_master_info.checksum_verify_interval = interval;
+    }
+
+    // Runs row event callbacks on 'threads' worker threads. All events of one table are handled
+    // by one worker in binlog order. Xid callback and binlog position update are done only after
+    // all workers have finished the transaction. Callbacks, ExtStateIface and EventStatIface
+    // have to be thread-safe. 0 (the default) runs callbacks in the binlog reading thread.
+    // Makes sense only when get_remote_binlog is not started
+    void setDispatchThreads(unsigned threads)
+    {
+        m_dispatcher.reset(threads ? new Dispatcher(threads) : nullptr);
+    }
 
-        for (RelayLogInfo::name_to_table_t::iterator i = m_rli.m_table_map.begin(); i != m_rli.m_table_map.end(); ++i) {
-            i->second->m_callback = m_callbacks[i->first];
-            i->second->m_filter = m_filters[i->first];
-            i->second->set_column_filter(m_column_filters[i->first]);
-            i->second->row_type = m_row_types[i->first];
-        }
+    // Same as setDispatchThreads, but workers are shared with other slaves which got
+    // the same dispatcher. Tables of different slaves may be handled by one worker.
+    // Makes sense only when get_remote_binlog is not started
+    void setDispatcher(std::shared_ptr<Dispatcher> dispatcher)
+    {
+        m_dispatcher = std::move(dispatcher);
+    }
+
+    void get_remote_binlog(const std::function<bool()>& _interruptFlag = &Slave::falseFunction);
+
+    // Replays events from local binlog or relay log files, given in binlog order, instead of
+    // reading them from the master. Event buffers point into memory mapped files.
+    // If the saved master position names one of the files, replay starts from it.
+    // Tables have to be set up as for get_remote_binlog. Returns at the end of the last file.
+    void get_local_binlog(const std::vector<std::string>& files,
+                          const std::function<bool()>& _interruptFlag = &Slave::falseFunction);
+
+    // Reads columns of all tables from the master, or from the schema snapshot
+    void createDatabaseStructure();
+
+    // Keeps columns of the tables in 'path' together with the binlog position they are valid
+    // from. createDatabaseStructure loads them from there instead of the master if the reading
+    // starts from that position or a later one. The snapshot is rewritten when a table is
+    // rebuilt after DDL, and removed while some table waits for its TABLE_MAP.
+    // Makes sense only when get_remote_binlog is not started
+    void setSchemaSnapshot(const std::string& path)
+    {
+        m_schema_snapshot_path = path;
     }
 
     table_order_t getTableOrder() const {
@@ -174,12 +398,18 @@ protected:
     void check_master_binlog_format();
     void check_master_gtid_mode();
 
+    // Tracks binlog position and gtid by the event, then processes it
+    void handle_event(const slave::Basic_event_info& event, gtid_t& gtid_next);
     int process_event(const slave::Basic_event_info& bei, RelayLogInfo& rli);
+    void dispatch_row_event(const Table* table, const Basic_event_info& bei, const Row_event_info& roi);
+    void resetTemporalField(Field_temporal* field, bool old_storage);
 
     void request_dump_wo_gtid(const std::string& logname, unsigned long start_position, MYSQL* mysql);
     void request_dump(const Position& pos, MYSQL* mysql);
 
-    ulong read_event(MYSQL* mysql);
+    ulong read_event(MYSQL* mysql, const unsigned char*& packet);
+    void read_events_to_queue(EventQueue& queue, pthread_t owner_thread_id);
+    ulong read_queued_event(EventQueue& queue, std::thread& reader, const unsigned char*& packet);
 
     void createTable(RelayLogInfo& rli,
                      const std::string& db_name, const std::string& tbl_name,
@@ -188,6 +418,7 @@ protected:
     void register_slave_on_master(MYSQL* mysql);
     void deregister_slave_on_master(MYSQL* mysql);
     void do_checksum_handshake(MYSQL* mysql);
+    void do_skip_replication(MYSQL* mysql);
 
     void generateSlaveId();
 
@@ -27,6 +27,8 @@
  */
 
 
+#include <atomic>
+#include <ctime>
 #include <memory>
 #include <string>
 #include <sys/time.h>
@@ -54,6 +56,10 @@ struct MasterInfo {
     enum_binlog_checksum_alg checksum_alg = BINLOG_CHECKSUM_ALG_OFF;
     bool is_old_storage = true;
     bool gtid_mode = false;
+    // Checksum of every checksum_verify_interval'th event is verified:
+    // 1 (the default) - of every event, 0 - of none
+    unsigned int checksum_verify_interval = 1;
+    unsigned int checksum_verify_counter = 0;
 
     MasterInfo() : connect_retry(10) {}
 
@@ -63,6 +69,17 @@ struct MasterInfo {
     {}
 
     bool checksumEnabled() const { return checksum_alg == BINLOG_CHECKSUM_ALG_CRC32; }
+
+    // Returns true if checksum of the current event has to be verified
+    bool sampleChecksum()
+    {
+        if (checksum_verify_interval == 0)
+            return false;
+        if (++checksum_verify_counter < checksum_verify_interval)
+            return false;
+        checksum_verify_counter = 0;
+        return true;
+    }
 };
 
 struct State {
@@ -109,6 +126,18 @@ struct ExtStateIface {
     // so there is no function for getting this statistics.
     virtual void initTableCount(const std::string& t) = 0;
     virtual void incTableCount(const std::string& t) = 0;
+    // Counts 'count' rows at once, used by batch callbacks.
+    virtual void incTableCount(const std::string& t, unsigned long count)
+    {
+        for (unsigned long i = 0; i < count; ++i)
+            incTableCount(t);
+    }
+    // Index-addressed counters for the hot path. tableCountIndex() is called once per table
+    // when Slave builds its structure; if it returns an index, rows of the table are counted
+    // with incTableCountAt(index, count) instead of incTableCount(name).
+    enum : size_t { no_table_index = static_cast<size_t>(-1) };
+    virtual size_t tableCountIndex(const std::string& /*t*/) { return no_table_index; }
+    virtual void incTableCountAt(size_t /*index*/, unsigned long /*count*/) {}
 
     virtual ~ExtStateIface() {}
 };
@@ -145,6 +174,7 @@ struct EmptyExtState: public ExtStateIface {
     bool getStateProcessing()                   override { return false; }
     void initTableCount(const std::string& t)   override {}
     void incTableCount(const std::string& t)    override {}
+    void incTableCount(const std::string& t, unsigned long count) override {}
 
 private:
     Position        position;
@@ -168,6 +198,42 @@ inline const EventKindList& eventKindList()
     return result;
 }
 
+// Stages of the event path reported by the probes, see probes.h
+enum ProbeStage
+{
+    psRead,
+    psChecksum,
+    psParse,
+    psDecode,
+    psCallback,
+    psStageCount
+};
+
+// Queues of events read from the master but not processed yet
+enum BacklogQueue
+{
+    bqPipeline,     // Packets read ahead, see Slave::setPipelineDepth
+    bqDispatch,     // Row events given to worker threads, see Slave::setDispatchThreads
+    bqQueueCount
+};
+
+// Timed places, each one is sampled on its own, see EventStatIface::sampleTiming
+enum TimingSite
+{
+    tsNetworkWait,
+    tsChecksum,
+    tsRow,          // Rows, or whole ROWS events for batch and columnar callbacks
+    tsSiteCount
+};
+
+// Clock of the timing hooks of EventStatIface, nanoseconds
+inline uint64_t monotonic_ns()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 // All stats calls are called independently.
 // E. g., processing UPDATE on a table, tick() + one of tickModifyIgnored/tickModifyDone/tickModifyFailed will be called.
 class EventStatIface
@@ -201,6 +267,46 @@ public:
     virtual void tickModifyRowDone(const unsigned long /*id*/, EventKind /*kind*/, uint64_t /*callbackWorkTimeNanoSeconds*/) {}
     // Errors during processing
     virtual void tickError() {}
+
+    // Only every timingSampleInterval()'th row or event (counted per TimingSite) is timed:
+    // 1 - all of them, 0 - none. Rows not timed are passed to tickModifyRowDone with 0.
+    virtual unsigned int timingSampleInterval() const { return 1; }
+    // Time spent waiting for the next event from the master.
+    virtual void tickNetworkWait(uint64_t /*nanoSeconds*/) {}
+    // Checksum verification of an event.
+    virtual void tickChecksum(uint64_t /*nanoSeconds*/) {}
+    // Decoding of a row, included into the time passed to tickModifyRowDone.
+    virtual void tickModifyRowDecoded(const unsigned long /*id*/, EventKind /*kind*/, uint64_t /*decodeTimeNanoSeconds*/) {}
+    // Replication lag of a processed UPDATE/INSERT/DELETE, time(NULL) - event time. Not sampled.
+    virtual void tickModifyEventLag(const unsigned long /*id*/, EventKind /*kind*/, time_t /*lagSeconds*/) {}
+
+    // Called only if the library is built with probes (SLAVE_WITH_PROBES), for every pass
+    // through a stage, not sampled. Bytes are of the packet, event or row handled.
+    virtual void tickStage(ProbeStage /*stage*/, uint64_t /*bytes*/, uint64_t /*nanoSeconds*/) {}
+    // Heap allocations of field values and rows made during a stage, if there were any.
+    virtual void tickAlloc(ProbeStage /*stage*/, uint64_t /*count*/, uint64_t /*bytes*/) {}
+
+    // Events and bytes in the queue after one more event is put into it, for depth and
+    // high-water mark tracking. Called from the thread that reads the master, not sampled.
+    virtual void tickBacklog(BacklogQueue /*queue*/, size_t /*events*/, size_t /*bytes*/) {}
+    // Reading from the master was stopped for this time because dispatched row events
+    // were at the caps of Slave::setFlowControl.
+    virtual void tickBackpressure(uint64_t /*nanoSeconds*/) {}
+
+    // Returns true if the current row or event has to be timed at 'site'
+    bool sampleTiming(TimingSite site) const
+    {
+        const unsigned int interval = timingSampleInterval();
+        if (interval <= 1)
+            return interval == 1;
+
+        // Workers sample rows concurrently, an exact interval between them does not matter
+        return m_sample_counters[site].fetch_add(1, std::memory_order_relaxed) % interval == interval - 1;
+    }
+
+private:
+
+    mutable std::atomic<unsigned int> m_sample_counters[tsSiteCount] = {};
 };
 }
 
@@ -0,0 +1,635 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Replays binlog event streams through read_log_event(), the TABLE_MAP/ROWS part of
+ * Slave::process_event() and apply_row_event() without a master connection.
+ *
+ * Usage: bench_events [-n iterations] [-s dir] [corpus ...]
+ *   -n  how many times every corpus is replayed, 10 by default
+ *   -s  save built-in corpora into 'dir', so they can be replayed by another build
+ *   corpus  binlog file (events as written by MySQL, with or without the binlog magic)
+ *           and '<corpus>.schema' next to it, with lines "<db>.<table> <column> <charset maxlen> <type>",
+ *           type as shown by SHOW FULL COLUMNS.
+ *
+ * Without corpus arguments built-in synthetic corpora are replayed: narrow and wide tables
+ * and one single-column table per column type of test/data/OneField.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mysql/mysql.h>
+
+#include "crc32.h"
+#include "field.h"
+#include "relayloginfo.h"
+#include "slave_log_event.h"
+
+namespace
+{
+size_t g_allocations = 0;
+}
+
+// Counts allocations made by the library while decoding rows
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    if (void* p = ::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    ::free(p);
+}
+
+namespace
+{
+
+struct Column
+{
+    std::string name;
+    std::string type;
+    int maxlen;
+};
+
+struct TableDef
+{
+    std::string db;
+    std::string name;
+    std::vector<Column> columns;
+};
+
+struct Corpus
+{
+    std::string name;
+    std::vector<TableDef> tables;
+    std::vector<char> events;
+};
+
+// How values of a column type are encoded in a row image
+enum class Kind { Fixed, Decimal, String };
+
+struct TypeInfo
+{
+    const char* name;
+    const char* type;
+    unsigned char mysql_type;
+    Kind kind;
+    // Length prefix size for String
+    unsigned prefix;
+};
+
+const TypeInfo types[] =
+{
+    { "TINYINT",   "tinyint(4)",            MYSQL_TYPE_TINY,       Kind::Fixed,   0 },
+    { "SMALLINT",  "smallint(6)",           MYSQL_TYPE_SHORT,      Kind::Fixed,   0 },
+    { "MEDIUMINT", "mediumint(9)",          MYSQL_TYPE_INT24,      Kind::Fixed,   0 },
+    { "INT",       "int(11)",               MYSQL_TYPE_LONG,       Kind::Fixed,   0 },
+    { "BIGINT",    "bigint(20)",            MYSQL_TYPE_LONGLONG,   Kind::Fixed,   0 },
+    { "FLOAT",     "float",                 MYSQL_TYPE_FLOAT,      Kind::Fixed,   0 },
+    { "DOUBLE",    "double",                MYSQL_TYPE_DOUBLE,     Kind::Fixed,   0 },
+    { "DECIMAL",   "decimal(10,2)",         MYSQL_TYPE_NEWDECIMAL, Kind::Decimal, 0 },
+    { "DATE",      "date",                  MYSQL_TYPE_DATE,       Kind::Fixed,   0 },
+    { "TIME",      "time",                  MYSQL_TYPE_TIME2,      Kind::Fixed,   0 },
+    { "DATETIME",  "datetime",              MYSQL_TYPE_DATETIME2,  Kind::Fixed,   0 },
+    { "TIMESTAMP", "timestamp",             MYSQL_TYPE_TIMESTAMP2, Kind::Fixed,   0 },
+    { "YEAR",      "year(4)",               MYSQL_TYPE_YEAR,       Kind::Fixed,   0 },
+    { "ENUM",      "enum('a','b','c')",     MYSQL_TYPE_STRING,     Kind::Fixed,   0 },
+    { "SET",       "set('a','b','c')",      MYSQL_TYPE_STRING,     Kind::Fixed,   0 },
+    { "BIT",       "bit(8)",                MYSQL_TYPE_BIT,        Kind::Fixed,   0 },
+    { "CHAR",      "char(16)",              MYSQL_TYPE_STRING,     Kind::String,  1 },
+    { "VARCHAR",   "varchar(64)",           MYSQL_TYPE_VARCHAR,    Kind::String,  1 },
+    { "TEXT",      "text",                  MYSQL_TYPE_BLOB,       Kind::String,  2 },
+    { "BLOB",      "blob",                  MYSQL_TYPE_BLOB,       Kind::String,  2 },
+};
+
+const TypeInfo& type_info(const std::string& type)
+{
+    for (const auto& t : types)
+        if (type == t.type)
+            return t;
+    throw std::runtime_error("bench: no encoder for type " + type);
+}
+
+uint32_t g_seed = 1;
+
+uint32_t rnd()
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return g_seed >> 8;
+}
+
+void put_int(std::vector<char>& out, uint64_t v, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; ++i)
+        out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+uint64_t get_int(const char* p, unsigned bytes)
+{
+    uint64_t v = 0;
+    for (unsigned i = bytes; i > 0; --i)
+        v = (v << 8) | static_cast<unsigned char>(p[i - 1]);
+    return v;
+}
+
+void put_packed(std::vector<char>& out, uint64_t v)
+{
+    if (v < 251)
+        put_int(out, v, 1);
+    else if (v < 0x10000)
+    {
+        out.push_back(static_cast<char>(252));
+        put_int(out, v, 2);
+    }
+    else if (v < 0x1000000)
+    {
+        out.push_back(static_cast<char>(253));
+        put_int(out, v, 3);
+    }
+    else
+    {
+        out.push_back(static_cast<char>(254));
+        put_int(out, v, 8);
+    }
+}
+
+// Writes binlog events with CRC32 checksums
+class EventWriter
+{
+public:
+
+    explicit EventWriter(std::vector<char>& out) : m_out(out) {}
+
+    void format_description()
+    {
+        std::vector<char> body;
+        put_int(body, 4, ST_BINLOG_VER_LEN);
+        body.resize(body.size() + ST_SERVER_VER_LEN, 0);
+        ::strcpy(&body[ST_SERVER_VER_OFFSET], "5.7.30-bench");
+        put_int(body, 0, 4);
+        body.push_back(LOG_EVENT_HEADER_LEN);
+
+        // LOG_EVENT_TYPES, the macro needs namespace slave
+        const unsigned event_types = slave::ENUM_END_EVENT - 1;
+        std::vector<char> lens(event_types, 0);
+        lens[slave::QUERY_EVENT - 1] = QUERY_HEADER_LEN;
+        lens[slave::ROTATE_EVENT - 1] = ROTATE_HEADER_LEN;
+        lens[slave::FORMAT_DESCRIPTION_EVENT - 1] = START_V3_HEADER_LEN + 1 + event_types;
+        lens[slave::TABLE_MAP_EVENT - 1] = TABLE_MAP_HEADER_LEN;
+        lens[slave::WRITE_ROWS_EVENT_V1 - 1] = lens[slave::UPDATE_ROWS_EVENT_V1 - 1] = lens[slave::DELETE_ROWS_EVENT_V1 - 1] = ROWS_HEADER_LEN_V1;
+        lens[slave::WRITE_ROWS_EVENT - 1] = lens[slave::UPDATE_ROWS_EVENT - 1] = lens[slave::DELETE_ROWS_EVENT - 1] = ROWS_HEADER_LEN;
+        body.insert(body.end(), lens.begin(), lens.end());
+        body.push_back(slave::BINLOG_CHECKSUM_ALG_CRC32);
+
+        event(slave::FORMAT_DESCRIPTION_EVENT, body);
+    }
+
+    void table_map(unsigned long table_id, const TableDef& def)
+    {
+        std::vector<char> body;
+        put_int(body, table_id, 6);
+        put_int(body, 1, 2);
+        body.push_back(def.db.size());
+        body.insert(body.end(), def.db.begin(), def.db.end());
+        body.push_back(0);
+        body.push_back(def.name.size());
+        body.insert(body.end(), def.name.begin(), def.name.end());
+        body.push_back(0);
+        put_packed(body, def.columns.size());
+        for (const auto& c : def.columns)
+            body.push_back(type_info(c.type).mysql_type);
+        // No metadata, all columns are nullable
+        put_packed(body, 0);
+        body.resize(body.size() + (def.columns.size() + 7) / 8, static_cast<char>(0xff));
+
+        event(slave::TABLE_MAP_EVENT, body);
+    }
+
+    void rows(slave::Log_event_type type, unsigned long table_id, const TableDef& def, unsigned count)
+    {
+        const size_t bitmap_len = (def.columns.size() + 7) / 8;
+        const bool update = type == slave::UPDATE_ROWS_EVENT;
+
+        std::vector<char> body;
+        put_int(body, table_id, 6);
+        // STMT_END_F
+        put_int(body, 1, 2);
+        // Extra data length, includes itself
+        put_int(body, 2, 2);
+        put_packed(body, def.columns.size());
+        body.resize(body.size() + bitmap_len * (update ? 2 : 1), static_cast<char>(0xff));
+
+        std::vector<unsigned> pack_lengths;
+        for (const auto& c : def.columns)
+        {
+            slave::collate_info ci;
+            ci.maxlen = c.maxlen;
+            pack_lengths.push_back(slave::create_field(c.name, c.type, ci, false)->pack_length());
+        }
+
+        for (unsigned i = 0; i < count * (update ? 2 : 1); ++i)
+            row(body, def, pack_lengths);
+
+        event(type, body);
+    }
+
+    void xid()
+    {
+        std::vector<char> body;
+        put_int(body, ++m_xid, 8);
+        event(slave::XID_EVENT, body);
+    }
+
+private:
+
+    void row(std::vector<char>& out, const TableDef& def, const std::vector<unsigned>& pack_lengths)
+    {
+        const size_t null_pos = out.size();
+        out.resize(out.size() + (def.columns.size() + 7) / 8, 0);
+
+        for (size_t i = 0; i < def.columns.size(); ++i)
+        {
+            const TypeInfo& t = type_info(def.columns[i].type);
+
+            // Every 20th value is NULL
+            if (rnd() % 20 == 0)
+            {
+                out[null_pos + i / 8] |= 1 << (i % 8);
+                continue;
+            }
+
+            switch (t.kind)
+            {
+            case Kind::Fixed:
+                for (unsigned j = 0; j < pack_lengths[i]; ++j)
+                    out.push_back(static_cast<char>(rnd()));
+                break;
+            case Kind::Decimal:
+            {
+                // decimal(10,2): 8 integer digits in 4 bytes and 2 fractional digits in 1 byte, big endian,
+                // sign bit inverted
+                const uint32_t intg = rnd() % 100000000;
+                out.push_back(static_cast<char>((intg >> 24) ^ 0x80));
+                out.push_back(static_cast<char>(intg >> 16));
+                out.push_back(static_cast<char>(intg >> 8));
+                out.push_back(static_cast<char>(intg));
+                out.push_back(static_cast<char>(rnd() % 100));
+                break;
+            }
+            case Kind::String:
+            {
+                const unsigned len = rnd() % 16;
+                put_int(out, len, t.prefix);
+                for (unsigned j = 0; j < len; ++j)
+                    out.push_back('a' + rnd() % 26);
+                break;
+            }
+            }
+        }
+    }
+
+    void event(slave::Log_event_type type, const std::vector<char>& body)
+    {
+        const uint32_t len = LOG_EVENT_HEADER_LEN + body.size() + BINLOG_CHECKSUM_LEN;
+        const size_t start = m_out.size();
+
+        m_pos += len;
+        put_int(m_out, 1500000000, 4);
+        m_out.push_back(type);
+        put_int(m_out, 1, 4);
+        put_int(m_out, len, 4);
+        put_int(m_out, m_pos, 4);
+        put_int(m_out, 0, 2);
+        m_out.insert(m_out.end(), body.begin(), body.end());
+        put_int(m_out, slave::checksum_crc32(0, (const unsigned char*)&m_out[start], m_out.size() - start), 4);
+    }
+
+    std::vector<char>& m_out;
+    // Position after the binlog magic
+    uint32_t m_pos = 4;
+    uint64_t m_xid = 0;
+};
+
+// Transactions of one ROWS event with 'rows' rows each
+Corpus make_corpus(const std::string& name, const std::vector<TableDef>& tables, slave::Log_event_type type,
+                   unsigned transactions, unsigned rows)
+{
+    Corpus corpus;
+    corpus.name = name;
+    corpus.tables = tables;
+
+    EventWriter writer(corpus.events);
+    writer.format_description();
+    for (unsigned i = 0; i < transactions; ++i)
+    {
+        const unsigned long table_id = 100 + i % tables.size();
+        const TableDef& def = tables[i % tables.size()];
+        writer.table_map(table_id, def);
+        writer.rows(type, table_id, def, rows);
+        writer.xid();
+    }
+    return corpus;
+}
+
+std::vector<Corpus> builtin_corpora()
+{
+    std::vector<Corpus> result;
+
+    TableDef narrow {"bench", "narrow", {{"id", "int(11)", 1}, {"value", "bigint(20)", 1}}};
+
+    TableDef wide {"bench", "wide", {}};
+    for (unsigned i = 0; i < 40; ++i)
+    {
+        const TypeInfo& t = types[i % (sizeof(types) / sizeof(types[0]))];
+        wide.columns.push_back({"c" + std::to_string(i), t.type, 1});
+    }
+
+    result.push_back(make_corpus("narrow_insert", {narrow}, slave::WRITE_ROWS_EVENT, 20000, 1));
+    result.push_back(make_corpus("narrow_batch", {narrow}, slave::WRITE_ROWS_EVENT, 1000, 100));
+    result.push_back(make_corpus("wide_update", {wide}, slave::UPDATE_ROWS_EVENT, 2000, 5));
+
+    for (const auto& t : types)
+    {
+        TableDef def {"bench", std::string("t_") + t.name, {{"value", t.type, 1}}};
+        result.push_back(make_corpus(t.name, {def}, slave::WRITE_ROWS_EVENT, 200, 100));
+    }
+
+    return result;
+}
+
+const char binlog_magic[] = "\xfe" "bin";
+
+void save_corpus(const Corpus& corpus, const std::string& dir)
+{
+    const std::string path = dir + "/" + corpus.name + ".binlog";
+
+    std::ofstream events(path, std::ios::binary);
+    events.write(binlog_magic, 4);
+    events.write(corpus.events.data(), corpus.events.size());
+
+    std::ofstream schema(path + ".schema");
+    for (const auto& t : corpus.tables)
+        for (const auto& c : t.columns)
+            schema << t.db << "." << t.name << " " << c.name << " " << c.maxlen << " " << c.type << "\n";
+
+    if (!events || !schema)
+        throw std::runtime_error("bench: failed to write " + path);
+}
+
+Corpus load_corpus(const std::string& path)
+{
+    Corpus corpus;
+    corpus.name = path;
+
+    std::ifstream events(path, std::ios::binary);
+    if (!events)
+        throw std::runtime_error("bench: failed to read " + path);
+    corpus.events.assign(std::istreambuf_iterator<char>(events), std::istreambuf_iterator<char>());
+    if (corpus.events.size() >= 4 && ::memcmp(corpus.events.data(), binlog_magic, 4) == 0)
+        corpus.events.erase(corpus.events.begin(), corpus.events.begin() + 4);
+
+    std::ifstream schema(path + ".schema");
+    if (!schema)
+        throw std::runtime_error("bench: failed to read " + path + ".schema");
+
+    std::string line;
+    while (std::getline(schema, line))
+    {
+        std::istringstream is(line);
+        std::string table, type;
+        Column c;
+        if (!(is >> table >> c.name >> c.maxlen) || !std::getline(is >> std::ws, c.type))
+            continue;
+
+        const auto dot = table.find('.');
+        if (dot == std::string::npos)
+            throw std::runtime_error("bench: bad table name in " + path + ".schema: " + table);
+
+        if (corpus.tables.empty() || corpus.tables.back().db + "." + corpus.tables.back().name != table)
+            corpus.tables.push_back({table.substr(0, dot), table.substr(dot + 1), {}});
+        corpus.tables.back().columns.push_back(c);
+    }
+
+    return corpus;
+}
+
+struct Result
+{
+    size_t events = 0;
+    size_t rows = 0;
+    size_t bytes = 0;
+    size_t allocations = 0;
+    double seconds = 0;
+};
+
+Result replay(const Corpus& corpus, slave::RowType row_type, unsigned iterations)
+{
+    Result result;
+    size_t fields = 0;
+
+    slave::RelayLogInfo rli;
+    for (const auto& def : corpus.tables)
+    {
+        slave::PtrTable table(new slave::Table(def.db, def.name));
+        for (const auto& c : def.columns)
+        {
+            slave::collate_info ci;
+            ci.maxlen = c.maxlen;
+            table->fields.push_back(slave::create_field(c.name, c.type, ci, false));
+        }
+        table->m_callback = [&](slave::RecordSet& rs)
+        {
+            ++result.rows;
+            fields += rs.m_row.size() + rs.m_row_vec.size() + rs.m_row_view.size();
+        };
+        table->m_filter = slave::eAll;
+        table->row_type = row_type;
+        rli.setTable(def.name, def.db, std::move(table));
+    }
+
+    slave::EmptyExtState ext_state;
+    slave::MasterInfo master_info;
+
+    const size_t allocations = g_allocations;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        const char* pos = corpus.events.data();
+        const char* end = pos + corpus.events.size();
+
+        while (end - pos >= LOG_EVENT_HEADER_LEN)
+        {
+            const uint32_t event_len = get_int(pos + EVENT_LEN_OFFSET, 4);
+            if (event_len < LOG_EVENT_HEADER_LEN || event_len > size_t(end - pos))
+                throw std::runtime_error("bench: truncated event in " + corpus.name);
+
+            slave::Basic_event_info bei;
+            const char* buf = pos;
+            pos += event_len;
+
+            ++result.events;
+            result.bytes += event_len;
+
+            if (!slave::read_log_event(buf, event_len, bei, nullptr, true, master_info))
+                continue;
+
+            switch (bei.type)
+            {
+            case slave::TABLE_MAP_EVENT:
+            {
+                slave::Table_map_event_info tmi(bei.buf, bei.event_len);
+                rli.setTableName(tmi.m_table_id, tmi.m_tblnam, tmi.m_dbnam);
+                break;
+            }
+            case slave::WRITE_ROWS_EVENT_V1:
+            case slave::UPDATE_ROWS_EVENT_V1:
+            case slave::DELETE_ROWS_EVENT_V1:
+            case slave::WRITE_ROWS_EVENT:
+            case slave::UPDATE_ROWS_EVENT:
+            case slave::DELETE_ROWS_EVENT:
+            {
+                if (slave::skip_row_event(rli, bei, nullptr))
+                    break;
+                slave::Row_event_info roi(bei.buf, bei.event_len, (bei.type == slave::UPDATE_ROWS_EVENT_V1 || bei.type == slave::UPDATE_ROWS_EVENT), true);
+                slave::apply_row_event(rli, bei, roi, ext_state, nullptr);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.allocations = g_allocations - allocations;
+
+    if (fields == 0 && result.rows != 0)
+        std::cerr << corpus.name << ": rows without fields" << std::endl;
+
+    return result;
+}
+
+const char* row_type_name(slave::RowType row_type)
+{
+    switch (row_type)
+    {
+    case slave::RowType::Map:    return "Map";
+    case slave::RowType::Vector: return "Vector";
+    case slave::RowType::View:   return "View";
+    }
+    return "";
+}
+
+const slave::RowType row_types[] = { slave::RowType::Map, slave::RowType::Vector, slave::RowType::View };
+
+void print_throughput(const Corpus& corpus, unsigned iterations)
+{
+    for (const auto row_type : row_types)
+    {
+        const Result r = replay(corpus, row_type, iterations);
+        char line[256];
+        ::snprintf(line, sizeof(line), "%-24s %-7s %12.0f %12.0f %9.1f %11.2f",
+                   corpus.name.c_str(), row_type_name(row_type),
+                   r.events / r.seconds, r.rows / r.seconds, r.bytes / r.seconds / (1 << 20),
+                   r.rows ? double(r.allocations) / r.rows : 0.0);
+        std::cout << line << std::endl;
+    }
+}
+
+void print_type_cost(const Corpus& corpus, unsigned iterations)
+{
+    char line[256];
+    int n = ::snprintf(line, sizeof(line), "%-24s", corpus.name.c_str());
+    for (const auto row_type : row_types)
+    {
+        const Result r = replay(corpus, row_type, iterations);
+        n += ::snprintf(line + n, sizeof(line) - n, " %10.1f %7.2f",
+                        r.rows ? r.seconds * 1e9 / r.rows : 0.0,
+                        r.rows ? double(r.allocations) / r.rows : 0.0);
+    }
+    std::cout << line << std::endl;
+}
+
+}// anonymous-namespace
+
+int main(int argc, char** argv)
+{
+    unsigned iterations = 10;
+    std::string save_dir;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            iterations = std::atoi(argv[++i]);
+        else if (arg == "-s" && i + 1 < argc)
+            save_dir = argv[++i];
+        else if (arg[0] == '-')
+        {
+            std::cerr << "Usage: " << argv[0] << " [-n iterations] [-s dir] [corpus ...]" << std::endl;
+            return 1;
+        }
+        else
+            files.push_back(arg);
+    }
+
+    try
+    {
+        std::vector<Corpus> corpora;
+        if (files.empty())
+            corpora = builtin_corpora();
+        for (const auto& f : files)
+            corpora.push_back(load_corpus(f));
+
+        if (!save_dir.empty())
+        {
+            for (const auto& c : corpora)
+                save_corpus(c, save_dir);
+            return 0;
+        }
+
+        std::cout << "corpus                   rowtype      events/s       rows/s      MB/s  allocs/row" << std::endl;
+        for (const auto& c : corpora)
+            if (c.tables.size() != 1 || c.tables[0].columns.size() != 1)
+                print_throughput(c, iterations);
+
+        std::cout << std::endl
+                  << "single column decode     Map ns/row  allocs  Vector ns/row  allocs  View ns/row  allocs" << std::endl;
+        for (const auto& c : corpora)
+            if (c.tables.size() == 1 && c.tables[0].columns.size() == 1)
+                print_type_cost(c, iterations);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binlog_file.h"
+#include "slave_log_event.h"
+
+#include "Logging.h"
+
+namespace
+{
+const char binlog_magic[] = { '\xfe', 'b', 'i', 'n' };
+
+uint32_t read_uint4(const char* p)
+{
+    uint32_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return le32toh(v);
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+const size_t BinlogFile::first_event_pos;
+
+BinlogFile::BinlogFile(const std::string& path) : m_path(path)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+        throw std::runtime_error("BinlogFile: can not open '" + path + "': " + ::strerror(errno));
+
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0)
+    {
+        const int err = errno;
+        ::close(m_fd);
+        throw std::runtime_error("BinlogFile: can not stat '" + path + "': " + ::strerror(err));
+    }
+    m_size = st.st_size;
+
+    if (m_size < sizeof(binlog_magic))
+    {
+        ::close(m_fd);
+        throw std::runtime_error("BinlogFile: '" + path + "' is not a binlog file");
+    }
+
+    void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        const int err = errno;
+        ::close(m_fd);
+        throw std::runtime_error("BinlogFile: can not mmap '" + path + "': " + ::strerror(err));
+    }
+    m_data = static_cast<const char*>(data);
+
+    // Events are read once from the beginning to the end
+    ::madvise(data, m_size, MADV_SEQUENTIAL);
+
+    if (::memcmp(m_data, binlog_magic, sizeof(binlog_magic)) != 0)
+    {
+        ::munmap(data, m_size);
+        ::close(m_fd);
+        throw std::runtime_error("BinlogFile: '" + path + "' is not a binlog file");
+    }
+}
+
+BinlogFile::~BinlogFile()
+{
+    ::munmap(const_cast<char*>(m_data), m_size);
+    ::close(m_fd);
+}
+
+std::string BinlogFile::name(const std::string& path)
+{
+    const auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void BinlogFile::seek(size_t pos)
+{
+    if (pos < first_event_pos || pos > m_size)
+        throw std::runtime_error("BinlogFile: position " + std::to_string(pos) + " is out of '" + m_path + "'");
+    m_pos = pos;
+}
+
+const char* BinlogFile::next(unsigned int& event_len)
+{
+    const size_t left = m_size - m_pos;
+    if (left == 0)
+        return nullptr;
+
+    if (left < LOG_EVENT_MINIMAL_HEADER_LEN)
+    {
+        LOG_WARNING(log, "BinlogFile: incomplete event header at " << m_pos << " in '" << m_path << "'");
+        return nullptr;
+    }
+
+    const char* event = m_data + m_pos;
+    event_len = read_uint4(event + EVENT_LEN_OFFSET);
+
+    if (event_len < LOG_EVENT_MINIMAL_HEADER_LEN)
+    {
+        LOG_ERROR(log, "BinlogFile: invalid event length " << event_len << " at " << m_pos << " in '" << m_path << "'");
+        throw std::runtime_error("BinlogFile::next failed");
+    }
+
+    if (event_len > left)
+    {
+        LOG_WARNING(log, "BinlogFile: incomplete event at " << m_pos << " in '" << m_path << "'");
+        return nullptr;
+    }
+
+    m_pos += event_len;
+    return event;
+}
+
+int BinlogFile::server_version() const
+{
+    const size_t pos = first_event_pos;
+    if (m_size < pos + LOG_EVENT_MINIMAL_HEADER_LEN + ST_SERVER_VER_OFFSET + ST_SERVER_VER_LEN)
+        return 0;
+
+    const char* event = m_data + pos;
+    if (event[EVENT_TYPE_OFFSET] != FORMAT_DESCRIPTION_EVENT)
+        return 0;
+
+    char version[ST_SERVER_VER_LEN + 1] = { 0, };
+    ::memcpy(version, event + LOG_EVENT_MINIMAL_HEADER_LEN + ST_SERVER_VER_OFFSET, ST_SERVER_VER_LEN);
+
+    int major, minor, patch;
+    if (3 != ::sscanf(version, "%d.%d.%d", &major, &minor, &patch))
+        return 0;
+
+    return major * 10000 + minor * 100 + patch;
+}
+
+}// slave
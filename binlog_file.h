@@ -0,0 +1,71 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_BINLOG_FILE_H_
+#define __SLAVE_BINLOG_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+namespace slave
+{
+
+// Binlog or relay log file mapped into memory read-only.
+// Events returned by next() point into the mapping and stay valid while the object exists.
+class BinlogFile
+{
+public:
+
+    // Offset of the first event, right after the binlog magic
+    static const size_t first_event_pos = 4;
+
+    explicit BinlogFile(const std::string& path);
+    ~BinlogFile();
+
+    BinlogFile(const BinlogFile&) = delete;
+    BinlogFile& operator=(const BinlogFile&) = delete;
+
+    const std::string& path() const { return m_path; }
+
+    // File name without directory, as it is used in binlog positions
+    std::string name() const { return name(m_path); }
+    static std::string name(const std::string& path);
+
+    size_t size() const { return m_size; }
+
+    // Offset of the event next() will return
+    size_t tell() const { return m_pos; }
+    void seek(size_t pos);
+
+    // Returns next event and sets 'event_len', or returns nullptr at the end of file.
+    // Incomplete event at the end of a file being written by the server is treated as
+    // the end of file, throws std::runtime_error on garbage.
+    const char* next(unsigned int& event_len);
+
+    // Server version from the format description event the file starts with,
+    // e.g. 50720 for 5.7.20; 0 if it can not be found
+    int server_version() const;
+
+private:
+
+    std::string m_path;
+    int m_fd = -1;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_pos = first_event_pos;
+};
+
+}// slave
+
+#endif
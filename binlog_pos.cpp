@@ -114,6 +114,29 @@ void parse_list_cont(const std::string& aList, Cont& aCont, const char* delim =
 namespace slave
 {
 
+ServerUuid::ServerUuid(const std::string& hex)
+{
+    std::string s;
+    std::remove_copy(hex.begin(), hex.end(), std::back_inserter(s), '-');
+    if (s.size() != bytes.size() * 2)
+        throw std::runtime_error("ServerUuid: bad uuid '" + hex + "'");
+    hex2bin(bytes.data(), s.data(), s.size());
+}
+
+std::string ServerUuid::str() const
+{
+    static const char* hex = "0123456789abcdef";
+
+    std::string result;
+    result.reserve(bytes.size() * 2);
+    for (const uint8_t c : bytes)
+    {
+        result += hex[c >> 4];
+        result += hex[c & 0x0f];
+    }
+    return result;
+}
+
 // parseGtid parse string with gtid
 // example:  ae00751a-cb5f-11e6-9d92-e03f490fd3db:1-12:15-17
 // gtid_set: uuid_set [, uuid_set] ... | ''
@@ -135,12 +158,12 @@ void Position::parseGtid(const std::string& input)
         cont.clear();
         parse_list_cont(token, cont, ":");
         bool uuid_parsed = false;
-        std::string sid;
+        ServerUuid sid;
         for (const auto& x : cont)
         {
             if (!uuid_parsed)
             {
-                std::remove_copy(x.begin(), x.end(), std::back_inserter(sid), '-');
+                sid = ServerUuid(x);
                 uuid_parsed = true;
             }
             else
@@ -167,48 +190,32 @@ void Position::parseGtid(const std::string& input)
 
 void Position::addGtid(const gtid_t& gtid)
 {
-    auto it = gtid_executed.find(gtid.first);
-    if (it == gtid_executed.end())
-    {
-        gtid_executed[gtid.first].emplace_back(gtid.second, gtid.second);
-        return;
-    }
+    gtid_intervals_t& intervals = gtid_executed[gtid.first];
+    const int64_t gno = gtid.second;
 
-    bool flag = true;
-    for (auto itr = it->second.begin(); itr != it->second.end(); ++itr)
+    // Transactions of a source usually come one after another
+    if (!intervals.empty() && intervals.back().second + 1 == gno)
     {
-        if (gtid.second >= itr->first && gtid.second <= itr->second)
-            return;
-        if (gtid.second + 1 == itr->first)
-        {
-            --itr->first;
-            flag = false;
-            break;
-        }
-        else if (gtid.second == itr->second + 1)
-        {
-            ++itr->second;
-            flag = false;
-            break;
-        }
-        else if (gtid.second < itr->first)
-        {
-            it->second.emplace(itr, gtid.second, gtid.second);
-            return;
-        }
+        ++intervals.back().second;
+        return;
     }
 
-    if (flag)
-        it->second.emplace_back(gtid.second, gtid.second);
+    // First interval which is not entirely before gno - 1
+    auto it = std::lower_bound(intervals.begin(), intervals.end(), gno,
+                               [](const gtid_interval_t& x, int64_t n) { return x.second + 1 < n; });
 
-    for (auto itr = it->second.begin(); itr != it->second.end(); ++itr)
+    if (it == intervals.end() || gno + 1 < it->first)
+        intervals.emplace(it, gno, gno);
+    else if (gno + 1 == it->first)
+        --it->first;
+    else if (gno == it->second + 1)
     {
-        auto next_itr = std::next(itr);
-        if (next_itr != it->second.end() && itr->second + 1 == next_itr->first)
+        ++it->second;
+        const auto next = std::next(it);
+        if (next != intervals.end() && next->first == gno + 1)
         {
-            itr->second = next_itr->second;
-            it->second.erase(next_itr);
-            break;
+            it->second = next->second;
+            intervals.erase(next);
         }
     }
 }
@@ -232,7 +239,7 @@ void Position::encodeGtid(unsigned char* buf)
     size_t offset = 8;
     for (const auto& x : gtid_executed)
     {
-        hex2bin(buf + offset, x.first.c_str(), ENCODED_SID_LENGTH * 2);
+        ::memcpy(buf + offset, x.first.bytes.data(), ENCODED_SID_LENGTH);
         offset += ENCODED_SID_LENGTH;
         int8store(buf + offset, x.second.size());
         offset += 8;
@@ -251,22 +258,22 @@ bool Position::reachedOtherPos(const Position& other) const
     if (gtid_executed.empty())
         return log_name > other.log_name ||
                (log_name == other.log_name && log_pos >= other.log_pos);
-    return gtid_executed == other.gtid_executed;
-}
-
-std::string Position::str() const
-{
-    std::string result = "'";
-    if (!log_name.empty() && log_pos)
-        result += log_name + ":" + std::to_string(log_pos) + ", ";
-
-    result += "GTIDs=";
-    if (gtid_executed.empty())
+    if (gtid_executed.size() != other.gtid_executed.size())
+        return false;
+    for (const auto& x : gtid_executed)
     {
-        result += "-'";
-        return result;
+        const auto it = other.gtid_executed.find(x.first);
+        // The last intervals are the ones which grow, so they differ first
+        if (it == other.gtid_executed.end() || x.second.size() != it->second.size()
+            || (!x.second.empty() && x.second.back() != it->second.back()) || x.second != it->second)
+            return false;
     }
+    return true;
+}
 
+std::string Position::formatGtid() const
+{
+    std::string result;
     bool first_a = true;
     for (const auto& gtid : gtid_executed)
     {
@@ -275,7 +282,7 @@ std::string Position::str() const
         else
             result += ",";
 
-        result += gtid.first + ":";
+        result += gtid.first.str() + ":";
         bool first_b = true;
         for (const auto& interv : gtid.second)
         {
@@ -289,6 +296,20 @@ std::string Position::str() const
                 result += "-" + std::to_string(interv.second);
         }
     }
+    return result;
+}
+
+std::string Position::str() const
+{
+    std::string result = "'";
+    if (!log_name.empty() && log_pos)
+        result += log_name + ":" + std::to_string(log_pos) + ", ";
+
+    result += "GTIDs=";
+    if (gtid_executed.empty())
+        result += "-";
+    else
+        result += formatGtid();
     result += "'";
     return result;
 }
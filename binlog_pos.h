@@ -1,21 +1,70 @@
 #pragma once
 
-#include <list>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <ostream>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace slave
 {
 
+// source server uuid in binary form, as it comes in GTID events
+struct ServerUuid
+{
+    std::array<uint8_t, 16> bytes;
+
+    ServerUuid() { bytes.fill(0); }
+    // from 32 hex digits, dashes are skipped
+    ServerUuid(const std::string& hex);
+    ServerUuid(const char* hex) : ServerUuid(std::string(hex)) {}
+
+    static ServerUuid fromBinary(const void* buf)
+    {
+        ServerUuid result;
+        ::memcpy(result.bytes.data(), buf, result.bytes.size());
+        return result;
+    }
+
+    bool empty() const { return *this == ServerUuid(); }
+    // 32 hex digits without dashes
+    std::string str() const;
+
+    bool operator==(const ServerUuid& other) const { return bytes == other.bytes; }
+    bool operator!=(const ServerUuid& other) const { return bytes != other.bytes; }
+    bool operator<(const ServerUuid& other) const { return bytes < other.bytes; }
+};
+
+struct ServerUuidHash
+{
+    size_t operator()(const ServerUuid& uuid) const
+    {
+        // uuids are random enough, a mix of both halves will do
+        uint64_t a, b;
+        ::memcpy(&a, uuid.bytes.data(), 8);
+        ::memcpy(&b, uuid.bytes.data() + 8, 8);
+        return a ^ (b * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const ServerUuid& uuid)
+{
+    os << uuid.str();
+    return os;
+}
+
 // interval of transactions with numbers from "first" to "second"
 using gtid_interval_t = std::pair<int64_t, int64_t>;
+// sorted disjoint intervals, not adjacent to each other
+using gtid_intervals_t = std::vector<gtid_interval_t>;
 // set of transactions:
-// key - source server uuid, value - list of transaction intervals
-using gtid_set_t = std::unordered_map<std::string, std::list<gtid_interval_t>>;
+// key - source server uuid, value - transaction intervals
+using gtid_set_t = std::unordered_map<ServerUuid, gtid_intervals_t, ServerUuidHash>;
 // single transaction: first - server uuid, second - transaction number
-using gtid_t = std::pair<std::string, int64_t>;
+using gtid_t = std::pair<ServerUuid, int64_t>;
 
 struct Position
 {
@@ -40,6 +89,9 @@ struct Position
 
     bool reachedOtherPos(const Position& other) const;
 
+    // gtid_executed as text which parseGtid() reads back, empty for an empty set
+    std::string formatGtid() const;
+
     std::string str() const;
 };
 
@@ -0,0 +1,187 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdexcept>
+#include <typeinfo>
+
+#include "column_batch.h"
+
+namespace
+{
+bool to_int(const slave::FieldValue& v, int64_t& x)
+{
+#if defined(SLAVE_USE_TAGGED_FIELD_VALUE)
+    switch (v.tag())
+    {
+    case slave::TaggedValue::Char:
+    case slave::TaggedValue::Int32:
+    case slave::TaggedValue::Int64:  x = v.i64(); return true;
+    case slave::TaggedValue::UInt16:
+    case slave::TaggedValue::UInt32:
+    case slave::TaggedValue::UInt64: x = v.u64(); return true;
+    default: return false;
+    }
+#else
+    const std::type_info& t = v.type();
+    if (t == typeid(uint32_t))
+        x = slave::get<uint32_t>(v);
+    else if (t == typeid(unsigned long long))
+        x = slave::get<unsigned long long>(v);
+    else if (t == typeid(int64_t))
+        x = slave::get<int64_t>(v);
+    else if (t == typeid(int32_t))
+        x = slave::get<int32_t>(v);
+    else if (t == typeid(uint16_t))
+        x = slave::get<uint16_t>(v);
+    else if (t == typeid(char))
+        x = slave::get<char>(v);
+#if !defined(SLAVE_USE_VARIANT_FOR_FIELD_VALUE)
+    // BIT values
+    else if (t == typeid(unsigned long))
+        x = slave::get<unsigned long>(v);
+#endif
+    else
+        return false;
+    return true;
+#endif
+}
+
+bool to_real(const slave::FieldValue& v, double& x)
+{
+#if defined(SLAVE_USE_TAGGED_FIELD_VALUE)
+    if (v.tag() != slave::TaggedValue::Float && v.tag() != slave::TaggedValue::Double)
+        return false;
+    x = v.f64();
+#else
+    if (v.type() == typeid(double))
+        x = slave::get<double>(v);
+    else if (v.type() == typeid(float))
+        x = slave::get<float>(v);
+    else
+        return false;
+#endif
+    return true;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+void ColumnBatch::Column::append(const FieldValue& v)
+{
+    if (isNullFieldValue(v))
+    {
+        appendNull();
+        return;
+    }
+
+    int64_t i = 0;
+    double d = 0;
+    switch (kind)
+    {
+    case Integer:
+        if (to_int(v, i))
+        {
+            appendInt(i);
+            return;
+        }
+        break;
+    case Real:
+        if (to_real(v, d))
+        {
+            appendReal(d);
+            return;
+        }
+        break;
+    case Binary:
+        if (v.type() == typeid(std::string))
+        {
+            const std::string& s = slave::get<std::string>(v);
+            appendBinary(s.data(), s.size());
+            return;
+        }
+        break;
+    }
+    throw std::runtime_error("ColumnBatch: value of column '" + name + "' does not match column kind");
+}
+
+void ColumnBatch::Column::clear()
+{
+    length = 0;
+    null_count = 0;
+    validity.clear();
+    ints.clear();
+    reals.clear();
+    offsets.assign(kind == Binary ? 1 : 0, 0);
+    data.clear();
+}
+
+void ColumnBatch::Column::truncate(size_t n)
+{
+    if (n >= length)
+        return;
+
+    for (size_t i = n; i < length; ++i)
+        if (isNull(i))
+            --null_count;
+    length = n;
+
+    validity.resize((n + 7) / 8);
+    if (n % 8)
+        validity.back() &= (1 << (n % 8)) - 1;
+
+    switch (kind)
+    {
+    case Integer: ints.resize(n); break;
+    case Real:    reals.resize(n); break;
+    case Binary:
+        offsets.resize(n + 1);
+        data.resize(offsets.back());
+        break;
+    }
+}
+
+size_t ColumnBatch::Column::bytes() const
+{
+    return validity.size() + ints.size() * sizeof(int64_t) + reals.size() * sizeof(double)
+        + offsets.size() * sizeof(uint32_t) + data.size();
+}
+
+size_t ColumnBatch::bytes() const
+{
+    size_t result = ops.size() * (sizeof(RowOp) + sizeof(time_t));
+    for (const auto& c : columns)
+        result += c.bytes();
+    return result;
+}
+
+void ColumnBatch::clear()
+{
+    for (auto& c : columns)
+        c.clear();
+    ops.clear();
+    when.clear();
+}
+
+void ColumnBatch::truncate(size_t n)
+{
+    for (auto& c : columns)
+        c.truncate(n);
+    if (n < ops.size())
+        ops.resize(n);
+    if (n < when.size())
+        when.resize(n);
+}
+
+}// slave
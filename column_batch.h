@@ -0,0 +1,137 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_COLUMN_BATCH_H_
+#define __SLAVE_COLUMN_BATCH_H_
+
+#include <ctime>
+#include <functional>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace slave
+{
+
+// Rows of one table in columnar form, with the layout of Apache Arrow arrays: every
+// column has a validity bitmap and either a contiguous array of numbers or string
+// offsets and data. See Slave::setColumnarCallback.
+struct ColumnBatch
+{
+    // Physical type of a column, chosen by its field: floating point columns (and
+    // DECIMAL unless ValueFormat::Native) are Real, strings and blobs are Binary,
+    // the rest is Integer with the same values as in RecordSet's
+    enum Kind { Integer, Real, Binary };
+
+    enum RowOp : unsigned char { Insert, Delete, UpdateBefore, UpdateAfter };
+
+    struct Column
+    {
+        std::string name;
+        std::string type;
+        Kind kind = Integer;
+
+        size_t length = 0;
+        size_t null_count = 0;
+        // Bit i (LSB first) is set if value i is not NULL. Columns missing from the row
+        // image (binlog_row_image != FULL) are NULL too.
+        std::vector<uint8_t> validity;
+        // Integer values, unsigned ones keep their bits; 0 for NULL
+        std::vector<int64_t> ints;
+        // Real values; 0 for NULL
+        std::vector<double> reals;
+        // Binary value i is data[offsets[i], offsets[i + 1]). Data of a batch is limited
+        // to 4 GiB per column, beyond that appending throws (see BatchFlush::max_bytes)
+        std::vector<uint32_t> offsets;
+        std::string data;
+
+        bool isNull(size_t i) const { return !(validity[i / 8] & (1 << (i & 7))); }
+
+        void appendNull()
+        {
+            setValid(false);
+            switch (kind)
+            {
+            case Integer: ints.push_back(0); break;
+            case Real:    reals.push_back(0); break;
+            case Binary:  offsets.push_back(data.size()); break;
+            }
+        }
+        void appendInt(int64_t v) { setValid(true); ints.push_back(v); }
+        void appendReal(double v) { setValid(true); reals.push_back(v); }
+        void appendBinary(const char* p, size_t len)
+        {
+            if (len > UINT32_MAX - data.size())
+                throw std::overflow_error("ColumnBatch: data of column '" + name + "' exceeds 32-bit offsets");
+            setValid(true);
+            data.append(p, len);
+            offsets.push_back(data.size());
+        }
+        // Slow path for fields without own Field::append_to, converts by kind
+        void append(const FieldValue& v);
+
+        void clear();
+        // Drops values past the first 'n'
+        void truncate(size_t n);
+        size_t bytes() const;
+
+    private:
+        void setValid(bool valid)
+        {
+            if (length % 8 == 0)
+                validity.push_back(0);
+            if (valid)
+                validity.back() |= 1 << (length % 8);
+            else
+                ++null_count;
+            ++length;
+        }
+    };
+
+    std::string db_name;
+    std::string tbl_name;
+    // Columns passing the column filter, in table order
+    std::vector<Column> columns;
+    // Per row: what it is and when it was written on the master. Update is two rows,
+    // the before image and the after image.
+    std::vector<RowOp> ops;
+    std::vector<time_t> when;
+
+    size_t rows() const { return ops.size(); }
+    // Memory taken by the values, for BatchFlush::max_bytes
+    size_t bytes() const;
+    // Drops the rows, keeps the columns and the memory
+    void clear();
+    // Drops rows past the first 'n', together with values of a partly appended row
+    void truncate(size_t n);
+};
+
+typedef std::function<void (ColumnBatch&)> columnar_callback;
+
+// When ColumnBatch'es are passed to the callback
+struct BatchFlush
+{
+    // After every ROWS event, or else at the end of transaction (XID or COMMIT)
+    bool per_event = true;
+    // Earlier than that, as soon as the batch has this many rows or bytes; 0 - no limit
+    size_t max_rows = 0;
+    size_t max_bytes = 0;
+};
+
+}// slave
+
+#endif
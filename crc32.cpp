@@ -0,0 +1,237 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include <zlib.h>
+
+#include "crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SLAVE_CRC32_PCLMUL
+#include <cpuid.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define SLAVE_CRC32_ARMV8
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+
+uint32_t crc32_zlib(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    // zlib takes uInt length
+    while (len)
+    {
+        const unsigned int chunk = len > (1U << 30) ? (1U << 30) : static_cast<unsigned int>(len);
+        crc = static_cast<uint32_t>(::crc32(crc, buf, chunk));
+        buf += chunk;
+        len -= chunk;
+    }
+    return crc;
+}
+
+#ifdef SLAVE_CRC32_PCLMUL
+
+bool cpu_has_pclmul()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+
+// Folding of 64-byte blocks with carry-less multiplication and Barrett reduction, see
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+// Constants are for the bit-reflected IEEE polynomial. 'len' must be at least 64 and
+// a multiple of 16. Takes and returns the inverted crc value.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32_pclmul_fold(const unsigned char* buf, size_t len, uint32_t crc)
+{
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+
+    buf += 64;
+    len -= 64;
+
+    // Parallel fold of 64-byte blocks
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    // Fold into 128 bits
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Single fold of 16-byte blocks
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    // Fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_extract_epi32(x1, 1);
+}
+
+uint32_t crc32_pclmul(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    if (len >= 64)
+    {
+        const size_t chunk = len & ~static_cast<size_t>(15);
+        crc = ~crc32_pclmul_fold(buf, chunk, ~crc);
+        buf += chunk;
+        len -= chunk;
+    }
+    return crc32_zlib(crc, buf, len);
+}
+
+#endif // SLAVE_CRC32_PCLMUL
+
+#ifdef SLAVE_CRC32_ARMV8
+
+uint32_t crc32_armv8(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    crc = ~crc;
+
+    for (; len >= 8; buf += 8, len -= 8)
+    {
+        uint64_t v;
+        ::memcpy(&v, buf, sizeof(v));
+        crc = __crc32d(crc, v);
+    }
+    for (; len; ++buf, --len)
+        crc = __crc32b(crc, *buf);
+
+    return ~crc;
+}
+
+#endif // SLAVE_CRC32_ARMV8
+
+typedef uint32_t (*crc32_func_t)(uint32_t, const unsigned char*, size_t);
+
+struct Engine
+{
+    crc32_func_t func;
+    const char* name;
+};
+
+Engine select_engine()
+{
+#if defined(SLAVE_CRC32_PCLMUL)
+    if (cpu_has_pclmul())
+        return Engine { &crc32_pclmul, "pclmul" };
+#elif defined(SLAVE_CRC32_ARMV8)
+    return Engine { &crc32_armv8, "armv8" };
+#endif
+    return Engine { &crc32_zlib, "zlib" };
+}
+
+const Engine& engine()
+{
+    static const Engine e = select_engine();
+    return e;
+}
+
+}// anonymous-namespace
+
+namespace slave
+{
+
+uint32_t checksum_crc32(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    return engine().func(crc, buf, len);
+}
+
+const char* checksum_crc32_engine()
+{
+    return engine().name;
+}
+
+}// slave
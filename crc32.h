@@ -0,0 +1,34 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_CRC32_H_
+#define __SLAVE_CRC32_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace slave
+{
+
+// CRC-32 with IEEE polynomial, the one used for binlog checksums; gives the same
+// result as zlib's crc32(). Uses PCLMULQDQ folding on x86 or CRC32 instructions on
+// ARMv8 if the CPU has them, and zlib otherwise.
+uint32_t checksum_crc32(uint32_t crc, const unsigned char* buf, size_t len);
+
+// Name of the implementation selected for this CPU: "pclmul", "armv8" or "zlib"
+const char* checksum_crc32_engine();
+
+}// slave
+
+#endif
@@ -0,0 +1,140 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dispatcher.h"
+
+#include <chrono>
+
+namespace slave
+{
+
+Dispatcher::Dispatcher(unsigned workers)
+{
+    if (workers == 0)
+        workers = 1;
+
+    m_workers.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i)
+        m_workers.emplace_back(new Worker);
+
+    for (auto& w : m_workers)
+        w->thread = std::thread(&Dispatcher::run, this, std::ref(*w));
+}
+
+Dispatcher::~Dispatcher()
+{
+    for (auto& w : m_workers)
+    {
+        {
+            std::lock_guard<std::mutex> l(w->mutex);
+            w->stopped = true;
+        }
+        w->cond.notify_one();
+    }
+
+    for (auto& w : m_workers)
+        w->thread.join();
+}
+
+Dispatcher::Backlog Dispatcher::dispatch(Group& group, size_t shard, task_t task, size_t bytes)
+{
+    Backlog backlog;
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+
+        auto has_room = [&group, bytes]
+        {
+            return group.pending == 0 ||
+                ((!group.max_tasks || group.pending < group.max_tasks) &&
+                 (!group.max_bytes || group.bytes + bytes <= group.max_bytes));
+        };
+
+        backlog.wait_ns = 0;
+        if (!has_room())
+        {
+            const auto start = std::chrono::steady_clock::now();
+            group.waiting = true;
+            m_room.wait(l, has_room);
+            group.waiting = false;
+            backlog.wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        ++group.pending;
+        group.bytes += bytes;
+        backlog.tasks = group.pending;
+        backlog.bytes = group.bytes;
+    }
+
+    Worker& w = *m_workers[shard % m_workers.size()];
+    {
+        std::lock_guard<std::mutex> l(w.mutex);
+        w.tasks.push_back(Worker::Task{&group, std::move(task), bytes});
+    }
+    w.cond.notify_one();
+
+    return backlog;
+}
+
+void Dispatcher::drain(Group& group)
+{
+    std::unique_lock<std::mutex> l(m_mutex);
+    m_done.wait(l, [&group] { return group.pending == 0; });
+
+    if (group.error)
+    {
+        std::exception_ptr e;
+        std::swap(e, group.error);
+        std::rethrow_exception(e);
+    }
+}
+
+void Dispatcher::run(Worker& w)
+{
+    while (true)
+    {
+        Worker::Task task;
+        {
+            std::unique_lock<std::mutex> l(w.mutex);
+            w.cond.wait(l, [&w] { return w.stopped || !w.tasks.empty(); });
+            if (w.tasks.empty())
+                return;
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            task.fn();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        // Data held by the task is freed before it stops being counted
+        task.fn = nullptr;
+
+        Group* group = task.group;
+        std::lock_guard<std::mutex> l(m_mutex);
+        if (error && !group->error)
+            group->error = error;
+        group->bytes -= task.bytes;
+        if (--group->pending == 0)
+            m_done.notify_all();
+        if (group->waiting)
+            m_room.notify_all();
+    }
+}
+
+}// slave
@@ -0,0 +1,123 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_DISPATCHER_H_
+#define __SLAVE_DISPATCHER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace slave
+{
+
+// Pool of worker threads, each one with its own FIFO of tasks.
+// Tasks with the same shard key run on the same worker in the order they were dispatched.
+// Several clients may share one pool: tasks dispatched to a Group are drained separately
+// from tasks of other groups. A group may be capped by the number and the size of its tasks
+// in flight, then dispatch() blocks until workers catch up.
+class Dispatcher
+{
+public:
+
+    typedef std::function<void ()> task_t;
+
+    // Tasks of one client. Must outlive its dispatched tasks, drain() before destroying.
+    class Group
+    {
+    public:
+        // 0 means no cap. At least one task is let through whatever its size is.
+        // Must not be changed while tasks of the group are in flight.
+        void setLimits(size_t max_tasks_, size_t max_bytes_)
+        {
+            max_tasks = max_tasks_;
+            max_bytes = max_bytes_;
+        }
+
+    private:
+        friend class Dispatcher;
+        size_t pending = 0;
+        size_t bytes = 0;
+        size_t max_tasks = 0;
+        size_t max_bytes = 0;
+        bool waiting = false;
+        std::exception_ptr error;
+    };
+
+    // Tasks of the group in flight after a dispatch(), including the dispatched one
+    struct Backlog
+    {
+        size_t tasks;
+        size_t bytes;
+        // Time dispatch() was blocked by the group limits
+        uint64_t wait_ns;
+    };
+
+    explicit Dispatcher(unsigned workers);
+    ~Dispatcher();
+
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    // 'bytes' is the size of the data the task holds, as counted by the group limits
+    Backlog dispatch(size_t shard, task_t task, size_t bytes = 0) { return dispatch(m_group, shard, std::move(task), bytes); }
+    Backlog dispatch(Group& group, size_t shard, task_t task, size_t bytes = 0);
+
+    // Waits until all tasks of the group are done. Rethrows the first exception
+    // thrown by its task since the previous drain().
+    void drain() { drain(m_group); }
+    void drain(Group& group);
+
+    unsigned workers() const { return m_workers.size(); }
+
+private:
+
+    struct Worker
+    {
+        struct Task
+        {
+            Group* group;
+            task_t fn;
+            size_t bytes;
+        };
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<Task> tasks;
+        bool stopped = false;
+        std::thread thread;
+    };
+
+    void run(Worker& worker);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Guards counters and errors of all groups
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    // Signalled when a task of a group blocked by its limits is done
+    std::condition_variable m_room;
+    Group m_group;
+};
+
+}// slave
+
+#endif
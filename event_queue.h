@@ -0,0 +1,148 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_EVENT_QUEUE_H_
+#define __SLAVE_EVENT_QUEUE_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace slave
+{
+
+// Bounded single producer / single consumer queue of raw binlog packets.
+// Slots and their buffers are allocated once and reused, so a warmed up queue
+// does not allocate memory. Besides the number of slots, the queue may be capped
+// by the total size of the queued packets.
+class EventQueue
+{
+public:
+
+    struct Slot
+    {
+        std::vector<unsigned char> data;
+        // Packet length as returned by Slave::read_event(), may be packet_error or packet_end_data
+        unsigned long len = 0;
+        // Set by the producer if it has verified checksum of the packet and it did not match
+        bool checksum_failed = false;
+        // As counted by push()
+        size_t bytes = 0;
+    };
+
+    // 'max_bytes' of 0 means no cap, a packet is let in the empty queue whatever its size is
+    explicit EventQueue(size_t depth, size_t max_bytes = 0) : m_slots(depth ? depth : 1), m_max_bytes(max_bytes) {}
+
+    // Producer side: returns free slot to fill, blocks while the queue is full.
+    // Returns nullptr if the queue was stopped.
+    Slot* acquire()
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        m_not_full.wait(l, [this] { return m_stopped || (m_tail - m_head < m_slots.size() &&
+                                                         (!m_max_bytes || m_bytes < m_max_bytes || m_head == m_tail)); });
+        if (m_stopped)
+            return nullptr;
+        return &m_slots[m_tail % m_slots.size()];
+    }
+
+    // Producer side: publishes slot returned by acquire(), 'bytes' is the size of its packet
+    void push(size_t bytes = 0)
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            if (m_stopped)
+                return;
+            m_slots[m_tail % m_slots.size()].bytes = bytes;
+            m_bytes += bytes;
+            ++m_tail;
+        }
+        m_not_empty.notify_one();
+    }
+
+    // Consumer side: returns oldest published slot, blocks while the queue is empty.
+    // Returns nullptr if the queue was stopped.
+    Slot* front()
+    {
+        std::unique_lock<std::mutex> l(m_mutex);
+        m_not_empty.wait(l, [this] { return m_stopped || m_head != m_tail; });
+        if (m_stopped)
+            return nullptr;
+        return &m_slots[m_head % m_slots.size()];
+    }
+
+    // Consumer side: releases slot returned by front()
+    void pop()
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            if (m_head != m_tail) {
+                m_bytes -= m_slots[m_head % m_slots.size()].bytes;
+                ++m_head;
+            }
+        }
+        m_not_full.notify_one();
+    }
+
+    // Wakes up both sides, all subsequent calls return immediately
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> l(m_mutex);
+            m_stopped = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+    // Drops queued packets and makes queue usable again, must not be called while producer is running
+    void reset()
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_head = m_tail = 0;
+        m_bytes = 0;
+        m_stopped = false;
+    }
+
+    size_t depth() const { return m_slots.size(); }
+
+    // Published packets not released by the consumer yet
+    size_t queued()
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        return m_tail - m_head;
+    }
+
+    size_t queuedBytes()
+    {
+        std::lock_guard<std::mutex> l(m_mutex);
+        return m_bytes;
+    }
+
+private:
+
+    std::vector<Slot> m_slots;
+    size_t m_head = 0;
+    size_t m_tail = 0;
+    const size_t m_max_bytes;
+    size_t m_bytes = 0;
+    bool m_stopped = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+};
+
+}// slave
+
+#endif
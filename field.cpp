@@ -14,6 +14,7 @@
 
 
 #include <cstdio>
+#include <cstring>
 #include <inttypes.h>
 #include <vector>
 #include <stdexcept>
@@ -29,14 +30,67 @@
 #include "field.h"
 
 #include "Logging.h"
+#include "probes.h"
 
 
+namespace
+{
+// Unsigned big endian number of 'bytes' bytes
+uint64_t read_be(const char* from, unsigned bytes)
+{
+    uint64_t x = 0;
+    for (unsigned i = 0; i < bytes; ++i)
+        x = (x << 8) | static_cast<unsigned char>(from[i]);
+    return x;
+}
 
+// Fractional seconds of TIMESTAMP2, DATETIME2 and TIME2: 1 byte for 1-2 digits
+// (hundredths), 2 bytes for 3-4 digits and 3 bytes for 5-6 digits (microseconds)
+int64_t frac_us(const char* from, unsigned bytes)
+{
+    switch (bytes)
+    {
+    case 1: return read_be(from, 1) * 10000;
+    case 2: return read_be(from, 2) * 100;
+    case 3: return read_be(from, 3);
+    default: return 0;
+    }
+}
 
-namespace slave
+// Microseconds since 1970-01-01 without timezone conversion, so no mktime() and its
+// lock per value. Days are counted with the proleptic Gregorian calendar;
+// zero month or day as in '2011-00-00' are counted as the first ones.
+int64_t civil_us(unsigned year, unsigned month, unsigned day, unsigned hour, unsigned minute, unsigned second, int64_t us)
 {
+    if (year == 0 && month == 0 && day == 0)
+        return 0;
+    if (month == 0)
+        month = 1;
+    if (day == 0)
+        day = 1;
+
+    // Years start in March, so the leap day is the last one
+    const int64_t y = int64_t(year) - (month <= 2);
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const int64_t yoe = y - era * 400;
+    const int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const int64_t days = era * 146097 + doe - 719468;
+
+    return ((days * 24 + hour) * 60 + minute) * 60 * 1000000 + int64_t(second) * 1000000 + us;
+}
+}// anonymous-namespace
 
+namespace slave
+{
 
+const char* Field::append_to(ColumnBatch::Column& column, const char* from)
+{
+    from = unpack(from);
+    SLAVE_PROBE_FIELD_VALUE(field_data);
+    column.append(field_data);
+    return from;
+}
 
 Field_num::Field_num(const std::string& field_name_arg, const std::string& type):
     Field(field_name_arg, type) {}
@@ -94,6 +148,12 @@ const char* Field_long::unpack(const char* from) {
     return from + pack_length();
 }
 
+const char* Field_long::append_to(ColumnBatch::Column& column, const char* from) {
+
+    column.appendInt(uint4korr(from));
+    return from + pack_length();
+}
+
 Field_longlong::Field_longlong(const std::string& field_name_arg, const std::string& type):
     Field_num(field_name_arg, type) {}
 
@@ -107,6 +167,12 @@ const char* Field_longlong::unpack(const char* from) {
     return from + pack_length();
 }
 
+const char* Field_longlong::append_to(ColumnBatch::Column& column, const char* from) {
+
+    column.appendInt(uint8korr(from));
+    return from + pack_length();
+}
+
 Field_real::Field_real(const std::string& field_name_arg, const std::string& type):
     Field_num(field_name_arg, type) {}
 
@@ -123,6 +189,15 @@ const char* Field_double::unpack(const char* from) {
     return from + pack_length();
 }
 
+const char* Field_double::append_to(ColumnBatch::Column& column, const char* from) {
+
+    // Values in the event are not aligned
+    double tmp;
+    ::memcpy(&tmp, from, sizeof(tmp));
+    column.appendReal(tmp);
+    return from + pack_length();
+}
+
 
 Field_float::Field_float(const std::string& field_name_arg, const std::string& type):
     Field_real(field_name_arg, type) {}
@@ -137,6 +212,15 @@ const char* Field_float::unpack(const char* from) {
     return from + pack_length();
 }
 
+const char* Field_float::append_to(ColumnBatch::Column& column, const char* from) {
+
+    // Values in the event are not aligned
+    float tmp;
+    ::memcpy(&tmp, from, sizeof(tmp));
+    column.appendReal(tmp);
+    return from + pack_length();
+}
+
 
 Field_str::Field_str(const std::string& field_name_arg, const std::string& type):
     Field(field_name_arg, type) {}
@@ -192,6 +276,18 @@ void Field_timestamp::reset(bool old_storage, bool ctor_call)
 
 const char* Field_timestamp::unpack(const char* from) {
 
+    if (is_native)
+    {
+        int64_t us;
+        if (is_old_storage)
+            us = int64_t(uint4korr(from)) * 1000000;
+        else
+            us = int64_t(read_be(from, 4)) * 1000000 + frac_us(from + 4, field_length - 4);
+        field_data = us;
+        LOG_TRACE(log, "  timestamp: " << us << "us // " << pack_length());
+        return from + pack_length();
+    }
+
     uint32 tmp;
     if (is_old_storage)
     {
@@ -265,6 +361,29 @@ void Field_datetime::reset(bool old_storage, bool ctor_call)
 
 const char* Field_datetime::unpack(const char* from)
 {
+    if (is_native)
+    {
+        int64_t us;
+        if (is_old_storage)
+        {
+            // YYYYMMDDhhmmss
+            const ulonglong v = uint8korr(from);
+            us = civil_us(v / 10000000000, (v / 100000000) % 100, (v / 1000000) % 100,
+                          (v / 10000) % 100, (v / 100) % 100, v % 100, 0);
+        }
+        else
+        {
+            // Same layout as below
+            const uint64_t v = read_be(from, 5);
+            const uint64_t year_month = (v >> 22) & ((1 << 17) - 1);
+            us = civil_us(year_month / 13, year_month % 13, (v >> 17) & 31,
+                          (v >> 12) & 31, (v >> 6) & 63, v & 63, frac_us(from + 5, field_length - 5));
+        }
+        field_data = us;
+        LOG_TRACE(log, "  datetime: " << us << "us // " << pack_length());
+        return from + pack_length();
+    }
+
     ulonglong tmp;
     if (is_old_storage)
     {
@@ -526,6 +645,7 @@ const char* Field_varstring::unpack(const char* from) {
         from++;
     }
 
+    SLAVE_PROBE_STRING_ALLOC(length_row);
     std::string tmp(from, length_row);
 
     LOG_TRACE(log, "  varstr: '" << tmp << "' // " << length_bytes << " " << length_row);
@@ -534,6 +654,36 @@ const char* Field_varstring::unpack(const char* from) {
     return from + length_row;
 }
 
+const char* Field_varstring::skip(const char* from) const {
+
+    if (length_bytes == 1)
+        return from + 1 + (unsigned int) (unsigned char) (*from);
+
+    return from + 2 + uint2korr(from);
+}
+
+const char* Field_varstring::append_to(ColumnBatch::Column& column, const char* from) {
+
+    unsigned length_row;
+    if (length_bytes == 1)
+        length_row = (unsigned int) (unsigned char) (*from++);
+    else {
+        length_row = uint2korr(from);
+        from += 2;
+    }
+
+    column.appendBinary(from, length_row);
+    return from + length_row;
+}
+
+StringRef Field_varstring::string_ref(const char* from) const {
+
+    if (length_bytes == 1)
+        return StringRef(from + 1, (unsigned int) (unsigned char) (*from));
+
+    return StringRef(from + 2, uint2korr(from));
+}
+
 
 Field_blob::Field_blob(const std::string& field_name_arg, const std::string& type):
     Field_longstr(field_name_arg, type), packlength(2) {}
@@ -552,6 +702,7 @@ const char* Field_blob::unpack(const char* from) {
     const unsigned length_row = get_length(from);
     from += packlength;
 
+    SLAVE_PROBE_STRING_ALLOC(length_row);
     std::string tmp(from, length_row);
 
     LOG_TRACE(log, "  blob: '" << tmp << "' // " << packlength << " " << length_row);
@@ -560,8 +711,27 @@ const char* Field_blob::unpack(const char* from) {
     return from + length_row;
 }
 
+const char* Field_blob::skip(const char* from) const {
+
+    return from + packlength + get_length(from);
+}
+
+const char* Field_blob::append_to(ColumnBatch::Column& column, const char* from) {
 
-unsigned int Field_blob::get_length(const char *pos) {
+    const unsigned length_row = get_length(from);
+    from += packlength;
+
+    column.appendBinary(from, length_row);
+    return from + length_row;
+}
+
+StringRef Field_blob::string_ref(const char* from) const {
+
+    return StringRef(from + packlength, get_length(from));
+}
+
+
+unsigned int Field_blob::get_length(const char *pos) const {
 
     switch (packlength)
     {
@@ -634,11 +804,57 @@ Field_decimal::Field_decimal(const std::string& field_name_arg, const std::strin
 
 const char* Field_decimal::unpack(const char *from)
 {
+    if (is_native)
+    {
+        field_data = dec2scaled(from);
+        return from + pack_length();
+    }
+
     double result = dec2double(from);
     field_data = result;
     return from + pack_length();
 }
 
+// Reads the binary format of dec_util::bin2dec straight into an integer: groups of 9
+// digits in 4 bytes and partial leading and trailing groups in fewer bytes, big endian,
+// the sign bit inverted and all bits of negative numbers inverted
+int64_t Field_decimal::dec2scaled(const char* from) const
+{
+    static const int dig2bytes[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+    static const int64_t powers10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(from);
+    const uint32_t mask = (p[0] & 0x80) ? 0 : 0xffffffff;
+    bool first = true;
+
+    const auto read = [&p, &mask, &first](int bytes) -> int64_t
+    {
+        uint32_t x = 0;
+        for (int i = 0; i < bytes; ++i)
+        {
+            unsigned char c = *p++;
+            if (first)
+            {
+                c ^= 0x80;
+                first = false;
+            }
+            x = (x << 8) | c;
+        }
+        // Mask only as many bytes as were read
+        return (x ^ mask) & (bytes == 4 ? 0xffffffff : (uint32_t(1) << (bytes * 8)) - 1);
+    };
+
+    int64_t value = 0;
+    if (intg % 9)
+        value = read(dig2bytes[intg % 9]);
+    for (int i = 0; i < intg / 9 + frac / 9; ++i)
+        value = value * powers10[9] + read(4);
+    if (frac % 9)
+        value = value * powers10[frac % 9] + read(dig2bytes[frac % 9]);
+
+    return mask ? -value : value;
+}
+
 double Field_decimal::dec2double(const char* from)
 {
     decimal_t val;
@@ -691,4 +907,115 @@ const char* Field_bit::unpack(const char *from)
     return from + _pack_length;
 }
 
+std::string field_type_name(const std::string& type)
+{
+    std::string extract_field;
+
+    for (size_t tmpi = 0; tmpi < type.size(); ++tmpi) {
+
+        if (!((type[tmpi] >= 'a' && type[tmpi] <= 'z') ||
+              (type[tmpi] >= 'A' && type[tmpi] <= 'Z'))) {
+
+            extract_field = type.substr(0, tmpi);
+            break;
+        }
+
+        if (tmpi == type.size()-1) {
+            extract_field = type;
+            break;
+        }
+    }
+
+    if (extract_field.empty())
+        throw std::runtime_error("Slave::create_table(): Regexp error, type not found");
+
+    return extract_field;
+}
+
+std::unique_ptr<Field> create_field(const std::string& name, const std::string& type, const collate_info& ci, bool old_storage)
+{
+    const std::string extract_field = field_type_name(type);
+
+    if (extract_field == "int")
+        return std::unique_ptr<Field>(new Field_long(name, type));
+
+    if (extract_field == "double")
+        return std::unique_ptr<Field>(new Field_double(name, type));
+
+    if (extract_field == "float")
+        return std::unique_ptr<Field>(new Field_float(name, type));
+
+    if (extract_field == "timestamp")
+        return std::unique_ptr<Field>(new Field_timestamp(name, type, old_storage));
+
+    if (extract_field == "datetime")
+        return std::unique_ptr<Field>(new Field_datetime(name, type, old_storage));
+
+    if (extract_field == "date")
+        return std::unique_ptr<Field>(new Field_date(name, type));
+
+    if (extract_field == "year")
+        return std::unique_ptr<Field>(new Field_year(name, type));
+
+    if (extract_field == "time")
+        return std::unique_ptr<Field>(new Field_time(name, type, old_storage));
+
+    if (extract_field == "enum")
+        return std::unique_ptr<Field>(new Field_enum(name, type));
+
+    if (extract_field == "set")
+        return std::unique_ptr<Field>(new Field_set(name, type));
+
+    if (extract_field == "varchar")
+        return std::unique_ptr<Field>(new Field_varstring(name, type, ci));
+
+    if (extract_field == "char")
+        return std::unique_ptr<Field>(new Field_varstring(name, type, ci));
+
+    if (extract_field == "tinyint")
+        return std::unique_ptr<Field>(new Field_tiny(name, type));
+
+    if (extract_field == "smallint")
+        return std::unique_ptr<Field>(new Field_short(name, type));
+
+    if (extract_field == "mediumint")
+        return std::unique_ptr<Field>(new Field_medium(name, type));
+
+    if (extract_field == "bigint")
+        return std::unique_ptr<Field>(new Field_longlong(name, type));
+
+    if (extract_field == "text")
+        return std::unique_ptr<Field>(new Field_blob(name, type));
+
+    if (extract_field == "tinytext")
+        return std::unique_ptr<Field>(new Field_tinyblob(name, type));
+
+    if (extract_field == "mediumtext")
+        return std::unique_ptr<Field>(new Field_mediumblob(name, type));
+
+    if (extract_field == "longtext")
+        return std::unique_ptr<Field>(new Field_longblob(name, type));
+
+    if (extract_field == "blob")
+        return std::unique_ptr<Field>(new Field_blob(name, type));
+
+    if (extract_field == "tinyblob")
+        return std::unique_ptr<Field>(new Field_tinyblob(name, type));
+
+    if (extract_field == "mediumblob")
+        return std::unique_ptr<Field>(new Field_mediumblob(name, type));
+
+    if (extract_field == "longblob")
+        return std::unique_ptr<Field>(new Field_longblob(name, type));
+
+    if (extract_field == "decimal")
+        return std::unique_ptr<Field>(new Field_decimal(name, type));
+
+    if (extract_field == "bit")
+        return std::unique_ptr<Field>(new Field_bit(name, type));
+
+    LOG_ERROR(log, "createTable: class name don't exist: " << extract_field );
+    throw std::runtime_error("class name does not exist: " + extract_field);
+}
+
 } // namespace slave
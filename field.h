@@ -16,11 +16,13 @@
 #ifndef __SLAVE_FIELD_H_
 #define __SLAVE_FIELD_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <list>
 
 #include "collate.h"
+#include "column_batch.h"
 #include "types.h"
 
 // conflict with macro defined in mysql
@@ -37,6 +39,7 @@ public:
     const std::string field_type;
     const std::string field_name;
 
+    // Value decoded by the last unpack(), rows take it over by moving
     FieldValue field_data;
 
     virtual const char* unpack(const char *from) = 0;
@@ -50,6 +53,22 @@ public:
 
     virtual unsigned int pack_length() const = 0;
 
+    // Returns pointer past the value packed at 'from' without decoding it.
+    virtual const char* skip(const char* from) const { return from + pack_length(); }
+
+    // Only DECIMAL, DATETIME and TIMESTAMP fields have other formats than Default
+    virtual void set_value_format(ValueFormat) {}
+
+    // Kind of ColumnBatch column for the values, Integer if not overridden
+    virtual ColumnBatch::Kind column_kind() const { return ColumnBatch::Integer; }
+
+    // Decodes the value packed at 'from' into the end of 'column', returns pointer past it.
+    // Goes through field_data unless the field writes its value into the column directly.
+    virtual const char* append_to(ColumnBatch::Column& column, const char* from);
+
+    // Bytes of the value packed at 'from' without its length, for fields of ColumnBatch::Binary kind
+    virtual StringRef string_ref(const char* from) const { return StringRef(); }
+
     const std::string getFieldName() {
         return field_name;
     }
@@ -83,6 +102,8 @@ public:
 class Field_real: public Field_num {
 public:
     Field_real(const std::string& field_name_arg, const std::string& type);
+
+    ColumnBatch::Kind column_kind() const { return ColumnBatch::Real; }
 };
 
 class Field_tiny: public Field_num {
@@ -114,6 +135,7 @@ public:
     Field_long(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+    const char* append_to(ColumnBatch::Column& column, const char* from);
 };
 
 class Field_longlong: public Field_num {
@@ -122,6 +144,7 @@ public:
     Field_longlong(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+    const char* append_to(ColumnBatch::Column& column, const char* from);
 };
 
 class Field_float: public Field_real {
@@ -130,6 +153,7 @@ public:
     Field_float(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+    const char* append_to(ColumnBatch::Column& column, const char* from);
 };
 
 class Field_double: public Field_real {
@@ -138,6 +162,7 @@ public:
     Field_double(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+    const char* append_to(ColumnBatch::Column& column, const char* from);
 };
 
 class Field_temporal: public Field_longstr {
@@ -148,14 +173,18 @@ public:
     virtual ~Field_temporal() {}
 
     virtual void reset(bool old_storage, bool ctor_call = false) = 0;
+
+    bool old_storage() const { return is_old_storage; }
 };
 
 class Field_timestamp: public Field_temporal {
+    bool is_native = false;
 public:
     Field_timestamp(const std::string& field_name_arg, const std::string& type, bool old_storage);
 
     void reset(bool old_storage, bool ctor_call = false);
     const char* unpack(const char* from);
+    void set_value_format(ValueFormat format) { is_native = format == ValueFormat::Native; }
 };
 
 class Field_year: public Field_tiny {
@@ -180,11 +209,13 @@ public:
 };
 
 class Field_datetime: public Field_temporal {
+    bool is_native = false;
 public:
     Field_datetime(const std::string& field_name_arg, const std::string& type, bool old_storage);
 
     void reset(bool old_storage, bool ctor_call = false);
     const char* unpack(const char* from);
+    void set_value_format(ValueFormat format) { is_native = format == ValueFormat::Native; }
 };
 
 class Field_varstring: public Field_longstr {
@@ -199,14 +230,22 @@ public:
                     const collate_info& collate);
 
     const char* unpack(const char* from);
+    const char* skip(const char* from) const;
+    ColumnBatch::Kind column_kind() const { return ColumnBatch::Binary; }
+    const char* append_to(ColumnBatch::Column& column, const char* from);
+    StringRef string_ref(const char* from) const;
 };
 
 class Field_blob: public Field_longstr {
-    unsigned int get_length(const char *ptr);
+    unsigned int get_length(const char *ptr) const;
 public:
     Field_blob(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+    const char* skip(const char* from) const;
+    ColumnBatch::Kind column_kind() const { return ColumnBatch::Binary; }
+    const char* append_to(ColumnBatch::Column& column, const char* from);
+    StringRef string_ref(const char* from) const;
 
 protected:
     // Number of bytes for holding the data length
@@ -263,11 +302,16 @@ public:
 
 class Field_decimal : public Field_longstr {
     double dec2double(const char*);
+    int64_t dec2scaled(const char*) const;
     int intg;
     int frac;
+    bool is_native = false;
 public:
     Field_decimal(const std::string& field_name_arg, const std::string& type);
     const char* unpack(const char *from);
+    // Decimals wider than 18 digits do not fit into MY_DECIMAL_SCALED and stay doubles
+    void set_value_format(ValueFormat format) { is_native = format == ValueFormat::Native && intg + frac <= 18; }
+    ColumnBatch::Kind column_kind() const { return is_native ? ColumnBatch::Integer : ColumnBatch::Real; }
 };
 
 class Field_bit : public Field
@@ -284,6 +328,12 @@ public:
     }
 };
 
+// Base type of column type as shown by SHOW FULL COLUMNS: "int" for "int(10) unsigned"
+std::string field_type_name(const std::string& type);
+
+// Creates field for column type as shown by SHOW FULL COLUMNS,
+// throws std::runtime_error if the type is not supported
+std::unique_ptr<Field> create_field(const std::string& name, const std::string& type, const collate_info& ci, bool old_storage);
 
 }
 
@@ -37,6 +37,17 @@ struct mysql_conn_opts
     unsigned int mysql_connect_timeout  = 10;
     unsigned int mysql_read_timeout     = 60 * 15;
     unsigned int mysql_write_timeout    = 60 * 15;
+    // Size of the client network buffer, 0 - libmysqlclient default
+    unsigned long mysql_net_buffer_length = 0;
+    // SO_RCVBUF of the socket, 0 - system default
+    int         mysql_rcvbuf            = 0;
+    // Protocol compression (CLIENT_COMPRESS)
+    bool        mysql_compress          = false;
+    // Used with mysql_compress when libmysqlclient >= 8.0.18, e.g. "zstd,zlib";
+    // empty - libmysqlclient default (zlib)
+    std::string mysql_compression_algorithms;
+    // 0 - libmysqlclient default
+    unsigned int mysql_zstd_compression_level = 0;
 };
 
 class Connection {
@@ -112,6 +123,31 @@ public:
         {
             mysql_options(connection, MYSQL_OPT_WRITE_TIMEOUT, &write_timeout);
         }
+#if MYSQL_VERSION_ID >= 50709
+        if (opts.mysql_net_buffer_length > 0)
+        {
+            mysql_options(connection, MYSQL_OPT_NET_BUFFER_LENGTH, &opts.mysql_net_buffer_length);
+        }
+#endif
+        if (opts.mysql_compress)
+        {
+#if MYSQL_VERSION_ID >= 80018
+            if (!opts.mysql_compression_algorithms.empty())
+            {
+                mysql_options(connection, MYSQL_OPT_COMPRESSION_ALGORITHMS, opts.mysql_compression_algorithms.c_str());
+                if (opts.mysql_zstd_compression_level > 0)
+                {
+                    mysql_options(connection, MYSQL_OPT_ZSTD_COMPRESSION_LEVEL, &opts.mysql_zstd_compression_level);
+                }
+            }
+            else
+            {
+                mysql_options(connection, MYSQL_OPT_COMPRESS, nullptr);
+            }
+#else
+            mysql_options(connection, MYSQL_OPT_COMPRESS, nullptr);
+#endif
+        }
 
         mysql_ssl_set( connection
                      , opts.mysql_ssl_key.empty() ? nullptr : opts.mysql_ssl_key.c_str()
@@ -0,0 +1,146 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "packet_reader.h"
+
+namespace
+{
+// Payload of this length means the packet continues in the next one
+const unsigned long max_packet_length = 0xffffff;
+const size_t header_length = 4;
+}// anonymous-namespace
+
+namespace slave
+{
+
+PacketReader::PacketReader(size_t chunk_size) : m_buf(chunk_size > header_length ? chunk_size : header_length) {}
+
+void PacketReader::reset(int fd, unsigned int timeout, bool nonblocking)
+{
+    m_fd = fd;
+    m_timeout = timeout;
+    m_nonblocking = nonblocking;
+    m_would_block = false;
+    m_begin = m_end = 0;
+    m_large.clear();
+    m_large_returned = false;
+    m_error.clear();
+}
+
+bool PacketReader::fill(size_t n)
+{
+    if (m_end - m_begin >= n)
+        return true;
+
+    if (m_begin == m_end)
+        m_begin = m_end = 0;
+    else if (m_buf.size() - m_begin < n)
+    {
+        // Move the tail to the beginning to fit the rest of the packet
+        ::memmove(m_buf.data(), m_buf.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    // Packet larger than the chunk
+    if (m_buf.size() < n)
+        m_buf.resize(n);
+
+    while (m_end - m_begin < n)
+    {
+        if (m_timeout && !m_nonblocking)
+        {
+            pollfd pfd = { m_fd, POLLIN, 0 };
+            const int rc = ::poll(&pfd, 1, m_timeout * 1000);
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc == 0)
+            {
+                m_error = "read timeout";
+                return false;
+            }
+        }
+
+        ++m_recv_calls;
+        const ssize_t rc = ::recv(m_fd, m_buf.data() + m_end, m_buf.size() - m_end, m_nonblocking ? MSG_DONTWAIT : 0);
+        if (rc > 0)
+        {
+            m_end += rc;
+            continue;
+        }
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0 && m_nonblocking && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            m_would_block = true;
+            return false;
+        }
+
+        m_error = rc == 0 ? "connection closed by server" : std::string("recv failed: ") + ::strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+bool PacketReader::read(const unsigned char*& data, unsigned long& len)
+{
+    m_would_block = false;
+    if (m_large_returned)
+    {
+        m_large.clear();
+        m_large_returned = false;
+    }
+
+    while (true)
+    {
+        if (!fill(header_length))
+            return false;
+
+        const unsigned char* header = m_buf.data() + m_begin;
+        const unsigned long part = header[0] | (header[1] << 8) | (header[2] << 16);
+
+        if (!fill(header_length + part))
+            return false;
+
+        const unsigned char* payload = m_buf.data() + m_begin + header_length;
+        m_begin += header_length + part;
+
+        if (part < max_packet_length && m_large.empty())
+        {
+            ++m_packets;
+            data = payload;
+            len = part;
+            return true;
+        }
+
+        m_large.insert(m_large.end(), payload, payload + part);
+
+        if (part < max_packet_length)
+        {
+            ++m_packets;
+            m_large_returned = true;
+            data = m_large.data();
+            len = m_large.size();
+            return true;
+        }
+    }
+}
+
+}// slave
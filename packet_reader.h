@@ -0,0 +1,79 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_PACKET_READER_H_
+#define __SLAVE_PACKET_READER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace slave
+{
+
+// Reads MySQL protocol packets from a plain (not SSL, not compressed) socket.
+// Data is received in chunks of up to 'chunk_size' bytes and split into packets here,
+// so a burst of small events costs one recv() instead of one or two per packet.
+class PacketReader
+{
+public:
+
+    explicit PacketReader(size_t chunk_size);
+
+    // Starts reading from a new connection, buffered data is dropped.
+    // 'timeout' is in seconds, 0 waits forever. In non-blocking mode 'timeout' is not used
+    // and read() returns false with wouldBlock() set instead of waiting for data.
+    void reset(int fd, unsigned int timeout, bool nonblocking = false);
+
+    // Reads next packet. On success sets 'data' to its payload, which stays valid until
+    // the next call, and returns true. Returns false if the connection was lost or timed out,
+    // or if the packet is not received completely yet in non-blocking mode.
+    bool read(const unsigned char*& data, unsigned long& len);
+
+    // Last read() has failed only because there is not enough data in the socket
+    bool wouldBlock() const { return m_would_block; }
+
+    // Description of the last read() failure
+    const std::string& error() const { return m_error; }
+
+    size_t recvCalls() const { return m_recv_calls; }
+    size_t packets() const { return m_packets; }
+
+private:
+
+    // Makes at least 'n' bytes available from m_begin
+    bool fill(size_t n);
+
+    int m_fd = -1;
+    unsigned int m_timeout = 0;
+    bool m_nonblocking = false;
+    bool m_would_block = false;
+
+    std::vector<unsigned char> m_buf;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+
+    // Payload of packets split into several 16M protocol packets, kept between
+    // non-blocking reads until the last part arrives
+    std::vector<unsigned char> m_large;
+    bool m_large_returned = false;
+
+    std::string m_error;
+    size_t m_recv_calls = 0;
+    size_t m_packets = 0;
+};
+
+}// slave
+
+#endif
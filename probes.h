@@ -0,0 +1,189 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_PROBES_H_
+#define __SLAVE_PROBES_H_
+
+// Probes of the event path: read, checksum, parse, decode and callback stages.
+// They are compiled in only with SLAVE_WITH_PROBES defined (cmake -DWITH_PROBES=ON),
+// otherwise every macro below expands to nothing.
+//
+// Each pass through a stage is reported to EventStatIface::tickStage, together with
+// heap allocations of field values and rows made meanwhile (EventStatIface::tickAlloc).
+// Only allocations at the probe points are counted: strings, boost::any holders of
+// decoded values, row nodes and vector growth. Values read through RowView, exceptions,
+// logging and the callbacks' own allocations are left out, so the numbers are a lower
+// bound of what operator new sees.
+// With SLAVE_WITH_SDT the stages are also USDT tracepoints, provider 'libslave':
+// stage_begin(stage) and stage_end(stage, bytes, nanoseconds), usable by perf, bpftrace
+// and SystemTap on a running process.
+
+#if defined(SLAVE_WITH_PROBES)
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+
+#include "SlaveStats.h"
+#include "types.h"
+
+#if defined(SLAVE_WITH_SDT)
+#include <sys/sdt.h>
+#define SLAVE_TRACEPOINT1(name, a)          DTRACE_PROBE1(libslave, name, a)
+#define SLAVE_TRACEPOINT3(name, a, b, c)    DTRACE_PROBE3(libslave, name, a, b, c)
+#else
+#define SLAVE_TRACEPOINT1(name, a)
+#define SLAVE_TRACEPOINT3(name, a, b, c)
+#endif
+
+namespace slave
+{
+
+struct AllocCounter
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// Allocations counted on this thread so far
+inline AllocCounter& alloc_counter()
+{
+    static thread_local AllocCounter counter;
+    return counter;
+}
+
+inline void probe_alloc(size_t bytes)
+{
+    AllocCounter& c = alloc_counter();
+    ++c.count;
+    c.bytes += bytes;
+}
+
+// Strings up to the small string capacity are kept inside the object
+inline void probe_string_alloc(size_t size)
+{
+    static const size_t local_capacity = std::string().capacity();
+    if (size > local_capacity)
+        probe_alloc(size + 1);
+}
+
+// Assignment of 'size' bytes to a string which has less capacity
+inline void probe_string_assign(const std::string& to, size_t size)
+{
+    if (size > to.capacity())
+        probe_alloc(size + 1);
+}
+
+// Holder boost::any allocates for a value, the other kinds of FieldValue keep values
+// inline. Scalar values take at most 8 bytes.
+inline void probe_field_value(const FieldValue& v)
+{
+#if !defined(SLAVE_USE_TAGGED_FIELD_VALUE) && !defined(SLAVE_USE_VARIANT_FOR_FIELD_VALUE)
+    if (!v.empty())
+        probe_alloc(sizeof(void*) + (v.type() == typeid(std::string) ? sizeof(std::string) : sizeof(uint64_t)));
+#endif
+}
+
+// Holder of a string about to be set in place of a value which is not a string
+inline void probe_string_value(const FieldValue& v)
+{
+#if !defined(SLAVE_USE_TAGGED_FIELD_VALUE) && !defined(SLAVE_USE_VARIANT_FOR_FIELD_VALUE)
+    if (v.type() != typeid(std::string))
+        probe_alloc(sizeof(void*) + sizeof(std::string));
+#endif
+}
+
+// Node and name of a new column of a Row, counted before the column is set
+template <typename Row>
+inline void probe_row_insert(const Row& row, const std::string& name)
+{
+    if (row.find(name) == row.end()) {
+        probe_alloc(sizeof(typename Row::value_type));
+        probe_string_alloc(name.size());
+    }
+}
+
+// Reallocation of a full vector, counted before an element is added
+template <typename Vector>
+inline void probe_push(const Vector& v)
+{
+    if (v.size() == v.capacity())
+        probe_alloc((v.capacity() ? 2 * v.capacity() : 1) * sizeof(typename Vector::value_type));
+}
+
+// One pass through a stage, from construction to end(). Passes left by an exception
+// or an early return are not reported. Nested stages are counted in the enclosing one too.
+class StageProbe
+{
+public:
+
+    StageProbe(EventStatIface* stat, ProbeStage stage)
+        : m_stat(stat), m_stage(stage), m_allocs(alloc_counter()), m_start(monotonic_ns())
+    {
+        SLAVE_TRACEPOINT1(stage_begin, (int) stage);
+    }
+
+    StageProbe(const StageProbe&) = delete;
+    StageProbe& operator=(const StageProbe&) = delete;
+
+    void end(uint64_t bytes)
+    {
+        const uint64_t ns = monotonic_ns() - m_start;
+        SLAVE_TRACEPOINT3(stage_end, (int) m_stage, bytes, ns);
+
+        if (!m_stat)
+            return;
+        m_stat->tickStage(m_stage, bytes, ns);
+
+        const AllocCounter& c = alloc_counter();
+        if (c.count != m_allocs.count)
+            m_stat->tickAlloc(m_stage, c.count - m_allocs.count, c.bytes - m_allocs.bytes);
+    }
+
+private:
+
+    EventStatIface* const m_stat;
+    const ProbeStage m_stage;
+    const AllocCounter m_allocs;
+    const uint64_t m_start;
+};
+
+}// slave
+
+#define SLAVE_PROBE_BEGIN(name, stat, stage)    slave::StageProbe name(stat, stage)
+#define SLAVE_PROBE_END(name, bytes)            name.end(bytes)
+#define SLAVE_PROBE_ALLOC(bytes)                slave::probe_alloc(bytes)
+#define SLAVE_PROBE_STRING_ALLOC(size)          slave::probe_string_alloc(size)
+#define SLAVE_PROBE_STRING_ASSIGN(to, size)     slave::probe_string_assign(to, size)
+#define SLAVE_PROBE_FIELD_VALUE(v)              slave::probe_field_value(v)
+#define SLAVE_PROBE_STRING_VALUE(v)             slave::probe_string_value(v)
+#define SLAVE_PROBE_ROW_INSERT(row, name)       slave::probe_row_insert(row, name)
+#define SLAVE_PROBE_PUSH(v)                     slave::probe_push(v)
+
+#else
+
+#define SLAVE_PROBE_BEGIN(name, stat, stage)
+#define SLAVE_PROBE_END(name, bytes)
+#define SLAVE_PROBE_ALLOC(bytes)
+#define SLAVE_PROBE_STRING_ALLOC(size)
+#define SLAVE_PROBE_STRING_ASSIGN(to, size)
+#define SLAVE_PROBE_FIELD_VALUE(v)
+#define SLAVE_PROBE_STRING_VALUE(v)
+#define SLAVE_PROBE_ROW_INSERT(row, name)
+#define SLAVE_PROBE_PUSH(v)
+
+#endif
+
+#endif
@@ -0,0 +1,273 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "query_scanner.h"
+
+namespace
+{
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Characters of unquoted identifiers, bytes >= 0x80 are parts of multibyte characters
+inline bool is_ident(char c)
+{
+    const unsigned char u = c;
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9')
+        || u == '_' || u == '$' || u >= 0x80;
+}
+
+inline char to_upper(char c)
+{
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+std::string QueryIdent::str() const
+{
+    if (len < 2 || ptr[0] != '`')
+        return std::string(ptr, len);
+
+    // Doubled backquotes stand for one
+    std::string s;
+    s.reserve(len - 2);
+    for (size_t i = 1; i + 1 < len; ++i)
+    {
+        s += ptr[i];
+        if (ptr[i] == '`')
+            ++i;
+    }
+    return s;
+}
+
+DdlScanner::DdlScanner(const char* query, size_t len) : m_p(query), m_end(query + len)
+{
+    // Almost every QUERY_EVENT of row based replication
+    if (len == 5 && ::memcmp(query, "BEGIN", 5) == 0)
+    {
+        m_query_kind = QUERY_BEGIN;
+        return;
+    }
+
+    if (keyword("BEGIN") || (keyword("START") && keyword("TRANSACTION")))
+        m_query_kind = QUERY_BEGIN;
+    else if (keyword("COMMIT"))
+        m_query_kind = QUERY_COMMIT;
+    else if (keyword("ROLLBACK"))
+    {
+        keyword("WORK");
+        // ROLLBACK TO SAVEPOINT does not end the transaction
+        if (!keyword("TO"))
+            m_query_kind = QUERY_ROLLBACK;
+    }
+    else if (keyword("XA"))
+        m_query_kind = keyword("START") || keyword("BEGIN") ? QUERY_BEGIN : QUERY_XA;
+    else if (keyword("ALTER"))
+    {
+        if (!keyword("ONLINE"))
+            keyword("OFFLINE");
+        keyword("IGNORE");
+        if (keyword("TABLE"))
+            m_kind = ALTER_TABLE;
+    }
+    else if (keyword("CREATE"))
+    {
+        if (keyword("OR") && !keyword("REPLACE"))
+            return;
+        m_temporary = keyword("TEMPORARY");
+        if (keyword("TABLE"))
+        {
+            m_kind = CREATE_TABLE;
+            if (keyword("IF") && !(keyword("NOT") && keyword("EXISTS")))
+                m_kind = NOT_DDL;
+        }
+    }
+    else if (keyword("DROP"))
+    {
+        m_temporary = keyword("TEMPORARY");
+        if (keyword("TABLE") || keyword("TABLES"))
+        {
+            m_kind = DROP_TABLE;
+            if (keyword("IF") && !keyword("EXISTS"))
+                m_kind = NOT_DDL;
+        }
+    }
+    else if (keyword("RENAME"))
+    {
+        if (keyword("TABLE") || keyword("TABLES"))
+            m_kind = RENAME_TABLE;
+    }
+    else if (keyword("TRUNCATE"))
+    {
+        keyword("TABLE");
+        m_kind = TRUNCATE_TABLE;
+    }
+
+    if (m_kind != NOT_DDL)
+        m_query_kind = QUERY_DDL;
+}
+
+void DdlScanner::skipSpace()
+{
+    while (m_p < m_end)
+    {
+        const size_t left = m_end - m_p;
+        if (is_space(*m_p))
+            ++m_p;
+        else if (*m_p == '#' || (left >= 2 && m_p[0] == '-' && m_p[1] == '-' && (left == 2 || is_space(m_p[2]))))
+        {
+            const void* eol = ::memchr(m_p, '\n', left);
+            m_p = eol ? static_cast<const char*>(eol) + 1 : m_end;
+        }
+        else if (left >= 3 && m_p[0] == '/' && m_p[1] == '*' && m_p[2] == '!')
+        {
+            // Executable comment: its text is a part of the statement
+            m_p += 3;
+            while (m_p < m_end && *m_p >= '0' && *m_p <= '9')
+                ++m_p;
+        }
+        else if (left >= 2 && m_p[0] == '/' && m_p[1] == '*')
+        {
+            m_p += 2;
+            while (m_p < m_end && !(m_p[0] == '*' && m_p + 1 < m_end && m_p[1] == '/'))
+                ++m_p;
+            m_p = m_p < m_end ? m_p + 2 : m_end;
+        }
+        else if (left >= 2 && m_p[0] == '*' && m_p[1] == '/')
+            // End of executable comment
+            m_p += 2;
+        else
+            break;
+    }
+}
+
+bool DdlScanner::keyword(const char* kw)
+{
+    skipSpace();
+
+    const char* p = m_p;
+    for (; *kw; ++kw, ++p)
+    {
+        if (p == m_end || to_upper(*p) != *kw)
+            return false;
+    }
+    if (p != m_end && is_ident(*p))
+        return false;
+
+    m_p = p;
+    return true;
+}
+
+bool DdlScanner::ident(QueryIdent& id)
+{
+    skipSpace();
+
+    const char* p = m_p;
+    if (p == m_end)
+        return false;
+
+    if (*p == '`')
+    {
+        for (++p; ; ++p)
+        {
+            if (p == m_end)
+                return false;
+            if (*p == '`')
+            {
+                if (p + 1 == m_end || p[1] != '`')
+                    break;
+                ++p;
+            }
+        }
+        ++p;
+        if (p - m_p == 2)
+            return false;
+    }
+    else
+    {
+        while (p != m_end && is_ident(*p))
+            ++p;
+        if (p == m_p)
+            return false;
+    }
+
+    id.ptr = m_p;
+    id.len = p - m_p;
+    m_p = p;
+    return true;
+}
+
+bool DdlScanner::next(DdlTable& table)
+{
+    if (m_kind == NOT_DDL)
+        return false;
+
+    if (m_tables > 0)
+    {
+        switch (m_kind)
+        {
+        case DROP_TABLE:
+            skipSpace();
+            if (m_p == m_end || *m_p != ',')
+                return false;
+            ++m_p;
+            break;
+        case RENAME_TABLE:
+            if (m_tables % 2)
+            {
+                if (!keyword("TO"))
+                    return false;
+            }
+            else
+            {
+                skipSpace();
+                if (m_p == m_end || *m_p != ',')
+                    return false;
+                ++m_p;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+
+    QueryIdent first;
+    if (!ident(first))
+        return false;
+
+    skipSpace();
+    if (m_p != m_end && *m_p == '.')
+    {
+        ++m_p;
+        table.db = first;
+        if (!ident(table.table))
+            return false;
+    }
+    else
+    {
+        table.db = QueryIdent();
+        table.table = first;
+    }
+
+    ++m_tables;
+    return true;
+}
+
+}// slave
@@ -0,0 +1,102 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_QUERY_SCANNER_H_
+#define __SLAVE_QUERY_SCANNER_H_
+
+#include <cstddef>
+#include <string>
+
+namespace slave
+{
+
+// Identifier as it is written in the query, backquotes are kept
+struct QueryIdent
+{
+    const char* ptr = nullptr;
+    size_t len = 0;
+
+    bool empty() const { return len == 0; }
+    // Unquoted name
+    std::string str() const;
+};
+
+struct DdlTable
+{
+    // Empty if the name is not qualified with a database
+    QueryIdent db;
+    QueryIdent table;
+};
+
+// Statement classes of QUERY_EVENT
+enum QueryKind
+{
+    // BEGIN, START TRANSACTION or XA START
+    QUERY_BEGIN,
+    QUERY_COMMIT,
+    QUERY_ROLLBACK,
+    // XA statements other than XA START
+    QUERY_XA,
+    // One of DdlScanner::Kind
+    QUERY_DDL,
+    QUERY_OTHER
+};
+
+// Classifies a QUERY_EVENT statement: transaction control, DDL which changes table
+// structure (then lists the tables it touches) or anything else. Scanning is linear
+// and does not allocate: whitespace, comments and keywords are skipped in place,
+// names point into the query text, which must outlive the scanner.
+class DdlScanner
+{
+public:
+
+    enum Kind
+    {
+        NOT_DDL,
+        ALTER_TABLE,
+        CREATE_TABLE,
+        DROP_TABLE,
+        // Tables come in pairs: old name, then new name
+        RENAME_TABLE,
+        TRUNCATE_TABLE
+    };
+
+    DdlScanner(const char* query, size_t len);
+    explicit DdlScanner(const std::string& query) : DdlScanner(query.data(), query.size()) {}
+
+    QueryKind queryKind() const { return m_query_kind; }
+    Kind kind() const { return m_kind; }
+    // CREATE or DROP of a TEMPORARY table, which may shadow a real one in its session only
+    bool temporary() const { return m_temporary; }
+
+    // Reads the next table of the statement, returns false when there are no more
+    bool next(DdlTable& table);
+
+private:
+
+    void skipSpace();
+    bool keyword(const char* kw);
+    bool ident(QueryIdent& id);
+
+    const char* m_p;
+    const char* m_end;
+    QueryKind m_query_kind = QUERY_OTHER;
+    Kind m_kind = NOT_DDL;
+    bool m_temporary = false;
+    size_t m_tables = 0;
+};
+
+}// slave
+
+#endif
@@ -18,6 +18,7 @@
 #include <map>
 #include <string>
 
+#include "rowview.h"
 #include "types.h"
 
 namespace slave
@@ -33,6 +34,8 @@ struct RecordSet
     Row       m_old_row;
     RowVector m_row_vec;
     RowVector m_old_row_vec;
+    RowView   m_row_view;
+    RowView   m_old_row_view;
     RowType   row_type = RowType::Map;
 
     std::string tbl_name;
@@ -20,6 +20,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 
 
@@ -38,15 +39,38 @@ public:
     typedef std::map<std::pair<std::string, std::string>, PtrTable> name_to_table_t;
     name_to_table_t m_table_map;
 
+    // Table for every table_id seen in TABLE_MAP events, nullptr for tables without callback
+    typedef std::unordered_map<unsigned long, Table*> id_to_table_t;
+    id_to_table_t m_map_table_id;
+
 
     void clear() {
         m_map_table_name.clear();
         m_table_map.clear();
+        m_map_table_id.clear();
     }
 
 
     void setTableName(unsigned long table_id, const std::string& table_name, const std::string& db_name) {
-        m_map_table_name[table_id] = std::make_pair(db_name, table_name);
+        auto key = std::make_pair(db_name, table_name);
+        m_map_table_id[table_id] = getTable(key).get();
+        m_map_table_name[table_id] = std::move(key);
+    }
+
+    // Id of a table without callback, whose TABLE_MAP is not handled
+    void unbindTableId(unsigned long table_id) {
+        m_map_table_id[table_id] = nullptr;
+        m_map_table_name.erase(table_id);
+    }
+
+    Table* getTableById(unsigned long table_id) const
+    {
+        id_to_table_t::const_iterator p = m_map_table_id.find(table_id);
+
+        if (p != m_map_table_id.end())
+            return p->second;
+
+        return nullptr;
     }
 
     const std::pair<std::string,std::string> getTableNameById(int table_id) const
@@ -73,7 +97,14 @@ public:
 
     void setTable(const std::string& table_name, const std::string& db_name, PtrTable&& table)
     {
-        m_table_map[std::make_pair(db_name, table_name)] = std::move(table);
+        const auto key = std::make_pair(db_name, table_name);
+        PtrTable& stored = m_table_map[key];
+        stored = std::move(table);
+
+        // Table is rebuilt after ALTER, so ids bound to the old one have to follow
+        for (const auto& x : m_map_table_name)
+            if (x.second == key)
+                m_map_table_id[x.first] = stored.get();
     }
 
 };
@@ -0,0 +1,139 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_ROWVIEW_H_
+#define __SLAVE_ROWVIEW_H_
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "field.h"
+#include "types.h"
+
+namespace slave
+{
+
+// Row image which is not decoded in advance: only the position of every column
+// inside the event buffer is recorded, values are unpacked on demand.
+// The view points into the binlog packet and must not be used after the callback
+// has returned. Columns excluded by the column filter or missing from the row
+// image (binlog_row_image != FULL) are reported as absent.
+class RowView
+{
+public:
+
+    enum State : unsigned char { Absent, Null, Present };
+
+    void reset(const std::vector<std::unique_ptr<Field>>& fields)
+    {
+        m_fields = &fields;
+        m_columns.assign(fields.size(), Column());
+    }
+
+    void setNull(unsigned i) { m_columns[i].state = Null; }
+
+    void setValue(unsigned i, const char* begin, const char* end)
+    {
+        Column& c = m_columns[i];
+        c.state = Present;
+        c.begin = begin;
+        c.end = end;
+    }
+
+    size_t size() const { return m_columns.size(); }
+
+    bool has(unsigned i) const { return m_columns[i].state != Absent; }
+    bool isNull(unsigned i) const { return m_columns[i].state == Null; }
+
+    const std::string& name(unsigned i) const { return (*m_fields)[i]->field_name; }
+    const std::string& type(unsigned i) const { return (*m_fields)[i]->field_type; }
+
+    // Returns column index by name or -1 if there is no such column.
+    int index(const std::string& name) const
+    {
+        for (size_t i = 0; i < size(); ++i)
+            if ((*m_fields)[i]->field_name == name)
+                return i;
+        return -1;
+    }
+
+    // Packed column value as it is stored in the binlog; nullptr for NULL and absent columns.
+    const char* data(unsigned i) const { return m_columns[i].state == Present ? m_columns[i].begin : nullptr; }
+    size_t length(unsigned i) const { return m_columns[i].state == Present ? m_columns[i].end - m_columns[i].begin : 0; }
+
+    // Decodes column the same way RowType::Map and RowType::Vector do.
+    FieldValue value(unsigned i) const
+    {
+        const Column& c = m_columns.at(i);
+        if (c.state == Absent)
+            throw std::runtime_error("RowView::value(): column '" + name(i) + "' is not in the row image");
+        if (c.state == Null)
+            return nullFieldValue();
+
+        Field& field = *(*m_fields)[i];
+        field.unpack(c.begin);
+        return std::move(field.field_data);
+    }
+
+    template <typename T>
+    T get(unsigned i) const { return slave::get<T>(value(i)); }
+
+    // Bytes of a CHAR, VARCHAR, TEXT or BLOB column without copying them out of the event buffer,
+    // so the reference is valid only as long as the view. Empty for NULL, throws for absent
+    // columns and other types.
+    StringRef stringRef(unsigned i) const
+    {
+        const Column& c = m_columns.at(i);
+        if (c.state == Absent)
+            throw std::runtime_error("RowView::stringRef(): column '" + name(i) + "' is not in the row image");
+
+        const Field& field = *(*m_fields)[i];
+        if (field.column_kind() != ColumnBatch::Binary)
+            throw std::runtime_error("RowView::stringRef(): column '" + name(i) + "' is not a string");
+        return c.state == Null ? StringRef() : field.string_ref(c.begin);
+    }
+
+    // Passes a string value to 'fn(const char* data, size_t size)' in pieces of at most 'chunk_size'
+    // bytes, for consumers of large BLOB/TEXT values which write them out by parts.
+    // 'chunk_size' has to be positive.
+    template <typename F>
+    void forEachChunk(unsigned i, size_t chunk_size, F fn) const
+    {
+        if (chunk_size == 0)
+            throw std::invalid_argument("RowView::forEachChunk(): chunk_size is 0");
+
+        const StringRef ref = stringRef(i);
+        for (size_t pos = 0; pos < ref.size; pos += chunk_size)
+            fn(ref.data + pos, std::min(chunk_size, ref.size - pos));
+    }
+
+private:
+
+    struct Column
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        State state = Absent;
+    };
+
+    const std::vector<std::unique_ptr<Field>>* m_fields = nullptr;
+    std::vector<Column> m_columns;
+};
+
+}// slave
+
+#endif
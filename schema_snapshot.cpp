@@ -0,0 +1,191 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "Logging.h"
+#include "schema_snapshot.h"
+
+namespace
+{
+const char* const header = "libslave-schema\t1";
+
+// Fields are separated by tabs, so tabs, newlines and backslashes are escaped
+std::string escape(const std::string& s)
+{
+    std::string r;
+    r.reserve(s.size());
+    for (const char c : s)
+    {
+        switch (c)
+        {
+        case '\\': r += "\\\\"; break;
+        case '\t': r += "\\t"; break;
+        case '\n': r += "\\n"; break;
+        default: r += c;
+        }
+    }
+    return r;
+}
+
+bool split(const std::string& line, std::vector<std::string>& fields)
+{
+    fields.assign(1, std::string());
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        const char c = line[i];
+        if (c == '\t')
+            fields.emplace_back();
+        else if (c != '\\')
+            fields.back() += c;
+        else if (++i == line.size())
+            return false;
+        else if (line[i] == 't')
+            fields.back() += '\t';
+        else if (line[i] == 'n')
+            fields.back() += '\n';
+        else
+            fields.back() += line[i];
+    }
+    return true;
+}
+
+bool parse_number(const std::string& s, unsigned long& v)
+{
+    if (s.empty())
+        return false;
+    char* end = nullptr;
+    v = std::strtoul(s.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// Binlog file names are "<basename>.<sequence number>"
+bool split_log_name(const std::string& name, std::string& base, unsigned long& seq)
+{
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+    base = name.substr(0, dot);
+    return parse_number(name.substr(dot + 1), seq);
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+bool SchemaSnapshot::usableFrom(const Position& snapshot, const Position& start)
+{
+    if (snapshot.log_name.empty() || start.log_name.empty())
+        return false;
+    if (snapshot.log_name == start.log_name)
+        return snapshot.log_pos <= start.log_pos;
+
+    std::string snapshot_base, start_base;
+    unsigned long snapshot_seq, start_seq;
+    return split_log_name(snapshot.log_name, snapshot_base, snapshot_seq)
+        && split_log_name(start.log_name, start_base, start_seq)
+        && snapshot_base == start_base && snapshot_seq < start_seq;
+}
+
+bool SchemaSnapshot::load(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        return false;
+
+    Position pos;
+    table_columns_t result;
+    std::vector<ColumnInfo>* columns = nullptr;
+
+    std::string line;
+    std::vector<std::string> f;
+    if (!std::getline(in, line) || line != header)
+    {
+        LOG_WARNING(log, "Schema snapshot " << path << " has unknown format");
+        return false;
+    }
+
+    while (std::getline(in, line))
+    {
+        unsigned long n = 0;
+        if (!split(line, f))
+            break;
+        if (f[0] == "position" && f.size() == 3 && parse_number(f[2], n))
+        {
+            pos.log_name = f[1];
+            pos.log_pos = n;
+        }
+        else if (f[0] == "table" && f.size() == 3)
+            columns = &result[std::make_pair(f[1], f[2])];
+        else if (f[0] == "column" && f.size() == 6 && columns && parse_number(f[5], n))
+        {
+            ColumnInfo c;
+            c.name = f[1];
+            c.type = f[2];
+            c.collate.name = f[3];
+            c.collate.charset = f[4];
+            c.collate.maxlen = n;
+            columns->push_back(c);
+        }
+        else if (f[0] == "end" && f.size() == 1)
+        {
+            position = pos;
+            tables.swap(result);
+            return true;
+        }
+        else
+            break;
+    }
+
+    // Without the end mark the file is truncated
+    LOG_WARNING(log, "Schema snapshot " << path << " is broken");
+    return false;
+}
+
+void SchemaSnapshot::save(const std::string& path) const
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::trunc);
+        out << header << "\n";
+        out << "position\t" << escape(position.log_name) << "\t" << position.log_pos << "\n";
+        for (const auto& t : tables)
+        {
+            out << "table\t" << escape(t.first.first) << "\t" << escape(t.first.second) << "\n";
+            for (const auto& c : t.second)
+                out << "column\t" << escape(c.name) << "\t" << escape(c.type) << "\t" << escape(c.collate.name)
+                    << "\t" << escape(c.collate.charset) << "\t" << c.collate.maxlen << "\n";
+        }
+        out << "end\n";
+        out.flush();
+        if (!out)
+        {
+            LOG_ERROR(log, "Can't write schema snapshot " << tmp);
+            throw std::runtime_error("SchemaSnapshot::save(): can't write " + tmp);
+        }
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        LOG_ERROR(log, "Can't rename schema snapshot " << tmp << ": " << std::strerror(errno));
+        throw std::runtime_error("SchemaSnapshot::save(): can't rename " + tmp);
+    }
+}
+
+}// slave
@@ -0,0 +1,59 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_SCHEMA_SNAPSHOT_H_
+#define __SLAVE_SCHEMA_SNAPSHOT_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "binlog_pos.h"
+#include "collate.h"
+
+namespace slave
+{
+
+// Column as described by SHOW FULL COLUMNS, enough to create its Field
+struct ColumnInfo
+{
+    std::string name;
+    std::string type;
+    // Only for char and varchar columns
+    collate_info collate;
+};
+
+typedef std::map<std::pair<std::string, std::string>, std::vector<ColumnInfo>> table_columns_t;
+
+// Columns of tables as they were at a binlog position, stored in a text file
+struct SchemaSnapshot
+{
+    Position position;
+    table_columns_t tables;
+
+    // Returns false if the file does not exist or is not a valid snapshot
+    bool load(const std::string& path);
+
+    // Writes a temporary file and renames it, so a crash never leaves a partial snapshot
+    void save(const std::string& path) const;
+
+    // True if the snapshot taken at 'snapshot' may be used to start reading from 'start':
+    // same binlog sequence and 'start' is not before 'snapshot'
+    static bool usableFrom(const Position& snapshot, const Position& start);
+};
+
+}// slave
+
+#endif
@@ -12,6 +12,8 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <map>
@@ -26,34 +28,47 @@
 
 #include <zlib.h>
 
+#ifdef SLAVE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "crc32.h"
 #include "relayloginfo.h"
 #include "slave_log_event.h"
 
 #include "SlaveStats.h"
 #include "Logging.h"
+#include "probes.h"
 
 
 namespace
 {
-void bin2hex_nz(char* dst, const uint8_t* src, size_t sz_src)
+// Same as net_field_length_ll(), but does not read past 'end'
+uint64_t read_packed_length(const unsigned char*& p, const unsigned char* end)
 {
-    if (!src || !dst) return;
-
-    static const char* hex = "0123456789abcdef";
+    if (p >= end)
+        throw std::runtime_error("read_packed_length: truncated value");
 
-    for (size_t i = 0; i < sz_src; ++i)
+    const unsigned char first = *p++;
+    size_t n = 0;
+    switch (first)
     {
-        *dst++ = hex[src[i] >> 4];
-        *dst++ = hex[src[i] & 0x0f];
+    case 251: throw std::runtime_error("read_packed_length: unexpected NULL");
+    case 252: n = 2; break;
+    case 253: n = 3; break;
+    case 254: n = 8; break;
+    case 255: throw std::runtime_error("read_packed_length: invalid value");
+    default:  return first;
     }
-}
 
-std::string bin2hex(const uint8_t* src, size_t sz_src)
-{
-    std::string res;
-    res.resize(sz_src * 2);
-    bin2hex_nz(const_cast<char*>(res.data()), src, sz_src);
-    return res;
+    if (end - p < (ptrdiff_t)n)
+        throw std::runtime_error("read_packed_length: truncated value");
+
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i)
+        v |= uint64_t(p[i]) << (8 * i);
+    p += n;
+    return v;
 }
 } // namespace anonymous
 
@@ -93,22 +108,59 @@ Rotate_event_info::Rotate_event_info(const char* buf, unsigned int event_len) {
 }
 
 
-Query_event_info::Query_event_info(const char* buf, unsigned int event_len) {
+Query_event_view::Query_event_view(const char* buf, unsigned int event_len) {
 
     if (event_len < LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN) {
         LOG_ERROR(log, "Sanity check failed: " << event_len << " " << LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN);
-        throw std::runtime_error("Query_event_info::Query_event_info failed");
+        throw std::runtime_error("Query_event_view::Query_event_view failed");
     }
 
-    unsigned int db_len = (unsigned int)buf[LOG_EVENT_HEADER_LEN + Q_DB_LEN_OFFSET];
+    db_len = (unsigned char)buf[LOG_EVENT_HEADER_LEN + Q_DB_LEN_OFFSET];
+
+    const unsigned int status_vars_len = uint2korr(buf + LOG_EVENT_HEADER_LEN + Q_STATUS_VARS_LEN_OFFSET);
+
+    const size_t data_len = event_len - (LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN);
+    if (data_len < status_vars_len + db_len + 1) {
+        LOG_ERROR(log, "Sanity check failed: QUERY_EVENT data length " << data_len);
+        throw std::runtime_error("Query_event_view::Query_event_view failed");
+    }
+
+    db_name = buf + LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN + status_vars_len;
+    query = db_name + db_len + 1;
+    query_len = data_len - status_vars_len - db_len - 1;
+}
+
+
+Table_map_event_view::Table_map_event_view(const char* buf, unsigned int event_len) {
+
+    if (event_len < LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN + 2) {
+        LOG_ERROR(log, "Sanity check failed: " << event_len << " " << LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN + 2);
+        throw std::runtime_error("Table_map_event_view::Table_map_event_view failed");
+    }
+
+    // Each name is stored with its length byte before and a zero byte after
+    const size_t data_len = event_len - (LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN);
+
+    db_name = buf + LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN + 1;
+    db_len = (unsigned char)db_name[-1];
+
+    if (data_len < db_len + 3 || data_len < db_len + 4 + (unsigned char)db_name[db_len + 1]) {
+        LOG_ERROR(log, "Sanity check failed: TABLE_MAP_EVENT data length " << data_len);
+        throw std::runtime_error("Table_map_event_view::Table_map_event_view failed");
+    }
+
+    table_id = uint6korr(buf + LOG_EVENT_HEADER_LEN + TM_MAPID_OFFSET);
+    tbl_name = db_name + db_len + 2;
+    tbl_len = (unsigned char)tbl_name[-1];
+}
+
 
-    unsigned int status_vars_len = uint2korr(buf + LOG_EVENT_HEADER_LEN + Q_STATUS_VARS_LEN_OFFSET);
+Query_event_info::Query_event_info(const char* buf, unsigned int event_len) {
 
-    size_t data_len = event_len - (LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN) - status_vars_len;
+    const Query_event_view view(buf, event_len);
 
-    db_name.assign(buf + LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN + status_vars_len, db_len);
-    query.assign(buf + LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN + status_vars_len + db_len + 1,
-                 data_len - db_len - 1);
+    db_name.assign(view.db_name, view.db_len);
+    query.assign(view.query, view.query_len);
 }
 
 
@@ -135,6 +187,301 @@ Table_map_event_info::Table_map_event_info(const char* buf, unsigned int event_l
     unsigned long width = net_field_length(&p_width);
 
     m_cols_types.assign(p_width, p_width + width);
+
+    m_meta = p_width + width;
+    m_end = (const unsigned char*)buf + event_len;
+}
+
+namespace
+{
+// MYSQL_TYPE_JSON, absent in old client headers
+const unsigned char binlog_type_json = 245;
+
+// Optional metadata field types
+enum
+{
+    TM_SIGNEDNESS = 1,
+    TM_COLUMN_NAME = 4,
+    TM_SET_STR_VALUE = 5,
+    TM_ENUM_STR_VALUE = 6
+};
+
+// Real type of MYSQL_TYPE_STRING column stored in its metadata
+unsigned char string_real_type(uint16_t meta)
+{
+    return (meta >> 8) | 0x30;
+}
+
+bool is_numeric_type(unsigned char type)
+{
+    switch (type)
+    {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_NEWDECIMAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string read_packed_string(const unsigned char*& p, const unsigned char* end)
+{
+    const uint64_t len = read_packed_length(p, end);
+    if ((uint64_t)(end - p) < len)
+        throw std::runtime_error("read_packed_string: truncated value");
+    std::string result((const char*)p, len);
+    p += len;
+    return result;
+}
+
+// Values of ENUM or SET columns
+void read_str_values(const unsigned char* p, const unsigned char* end, const std::vector<unsigned char>& types,
+                     Table_map_metadata& md, unsigned char real_type)
+{
+    for (size_t i = 0; i < types.size() && p < end; ++i)
+    {
+        if (types[i] != MYSQL_TYPE_STRING || string_real_type(md.m_cols_meta[i]) != real_type)
+            continue;
+
+        const uint64_t count = read_packed_length(p, end);
+        for (uint64_t j = 0; j < count; ++j)
+            md.m_cols_values[i].push_back(read_packed_string(p, end));
+    }
+}
+
+std::string str_values_type(const char* name, const std::vector<std::string>& values, size_t placeholders)
+{
+    // Field_enum and Field_set only need the number of values
+    const bool use_values = !values.empty() &&
+        std::none_of(values.begin(), values.end(), [](const std::string& v) { return v.find_first_of(",'") != std::string::npos; });
+
+    std::string result = name;
+    result += '(';
+    const size_t n = use_values ? values.size() : placeholders;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i)
+            result += ',';
+        result += '\'';
+        if (use_values)
+            result += values[i];
+        result += '\'';
+    }
+    result += ')';
+    return result;
+}
+}// anonymous-namespace
+
+void Table_map_event_info::parse_metadata(Table_map_metadata& md) const
+{
+    const size_t width = m_cols_types.size();
+    md.m_cols_meta.assign(width, 0);
+    md.m_cols_names.clear();
+    md.m_cols_unsigned.assign(width, 0);
+    md.m_cols_values.assign(width, std::vector<std::string>());
+
+    const unsigned char* p = m_meta;
+    const uint64_t meta_len = read_packed_length(p, m_end);
+    if ((uint64_t)(m_end - p) < meta_len) {
+        LOG_ERROR(log, "Sanity check failed: TABLE_MAP metadata length " << meta_len);
+        throw std::runtime_error("Table_map_event_info::parse_metadata failed");
+    }
+    const unsigned char* meta_end = p + meta_len;
+
+    for (size_t i = 0; i < width; ++i)
+    {
+        size_t len = 0;
+        switch (m_cols_types[i])
+        {
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+        case MYSQL_TYPE_BLOB:
+        case MYSQL_TYPE_GEOMETRY:
+        case binlog_type_json:
+        case MYSQL_TYPE_TIMESTAMP2:
+        case MYSQL_TYPE_DATETIME2:
+        case MYSQL_TYPE_TIME2:
+            len = 1;
+            break;
+        case MYSQL_TYPE_VARCHAR:
+        case MYSQL_TYPE_BIT:
+        case MYSQL_TYPE_NEWDECIMAL:
+        case MYSQL_TYPE_VAR_STRING:
+        case MYSQL_TYPE_STRING:
+        case MYSQL_TYPE_ENUM:
+        case MYSQL_TYPE_SET:
+            len = 2;
+            break;
+        default:
+            break;
+        }
+
+        if (meta_end - p < (ptrdiff_t)len) {
+            LOG_ERROR(log, "Sanity check failed: TABLE_MAP metadata is too short for column " << i);
+            throw std::runtime_error("Table_map_event_info::parse_metadata failed");
+        }
+
+        if (len == 1)
+            md.m_cols_meta[i] = p[0];
+        else if (len == 2 && m_cols_types[i] == MYSQL_TYPE_VARCHAR)
+            md.m_cols_meta[i] = p[0] | (p[1] << 8);
+        else if (len == 2)
+            md.m_cols_meta[i] = (p[0] << 8) | p[1];
+        p += len;
+    }
+
+    // Null bitmap
+    p = meta_end + (width + 7) / 8;
+
+    while (p < m_end)
+    {
+        const unsigned char type = *p++;
+        const uint64_t len = read_packed_length(p, m_end);
+        if ((uint64_t)(m_end - p) < len) {
+            LOG_ERROR(log, "Sanity check failed: TABLE_MAP optional metadata " << (int)type << " length " << len);
+            throw std::runtime_error("Table_map_event_info::parse_metadata failed");
+        }
+        const unsigned char* value = p;
+        const unsigned char* value_end = p + len;
+        p = value_end;
+
+        switch (type)
+        {
+        case TM_SIGNEDNESS:
+        {
+            // One bit per numeric column, most significant first
+            size_t bit = 0;
+            for (size_t i = 0; i < width; ++i)
+            {
+                if (!is_numeric_type(m_cols_types[i]))
+                    continue;
+                if (value + bit / 8 >= value_end)
+                    break;
+                md.m_cols_unsigned[i] = (value[bit / 8] >> (7 - bit % 8)) & 1;
+                ++bit;
+            }
+            break;
+        }
+        case TM_COLUMN_NAME:
+            while (value < value_end)
+                md.m_cols_names.push_back(read_packed_string(value, value_end));
+            if (md.m_cols_names.size() != width) {
+                LOG_ERROR(log, "Sanity check failed: TABLE_MAP has " << md.m_cols_names.size() << " column names for " << width << " columns");
+                throw std::runtime_error("Table_map_event_info::parse_metadata failed");
+            }
+            break;
+        case TM_SET_STR_VALUE:
+            read_str_values(value, value_end, m_cols_types, md, MYSQL_TYPE_SET);
+            break;
+        case TM_ENUM_STR_VALUE:
+            read_str_values(value, value_end, m_cols_types, md, MYSQL_TYPE_ENUM);
+            break;
+        default:
+            // Charsets, primary key, visibility etc. are not needed
+            break;
+        }
+    }
+}
+
+std::string Table_map_event_info::column_type(const Table_map_metadata& md, size_t i) const
+{
+    const uint16_t meta = md.m_cols_meta[i];
+    const std::string sign = md.m_cols_unsigned[i] ? " unsigned" : "";
+    const auto precision = [&](const char* name) { return meta ? name + ("(" + std::to_string(meta) + ")") : std::string(name); };
+
+    switch (m_cols_types[i])
+    {
+    case MYSQL_TYPE_TINY:       return "tinyint" + sign;
+    case MYSQL_TYPE_SHORT:      return "smallint" + sign;
+    case MYSQL_TYPE_INT24:      return "mediumint" + sign;
+    case MYSQL_TYPE_LONG:       return "int" + sign;
+    case MYSQL_TYPE_LONGLONG:   return "bigint" + sign;
+    case MYSQL_TYPE_FLOAT:      return "float" + sign;
+    case MYSQL_TYPE_DOUBLE:     return "double" + sign;
+    case MYSQL_TYPE_NEWDECIMAL:
+        return "decimal(" + std::to_string(meta >> 8) + "," + std::to_string(meta & 0xff) + ")" + sign;
+    case MYSQL_TYPE_YEAR:       return "year";
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_NEWDATE:    return "date";
+    case MYSQL_TYPE_TIMESTAMP:  return "timestamp";
+    case MYSQL_TYPE_DATETIME:   return "datetime";
+    case MYSQL_TYPE_TIME:       return "time";
+    case MYSQL_TYPE_TIMESTAMP2: return precision("timestamp");
+    case MYSQL_TYPE_DATETIME2:  return precision("datetime");
+    case MYSQL_TYPE_TIME2:      return precision("time");
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_VAR_STRING: return "varchar(" + std::to_string(meta) + ")";
+    case MYSQL_TYPE_STRING:
+    {
+        // Lengths above 255 keep two high bits in the type byte
+        const unsigned char type_byte = meta >> 8;
+        const unsigned int length = ((((type_byte & 0x30) ^ 0x30) << 4) | (meta & 0xff));
+
+        switch (string_real_type(meta))
+        {
+        case MYSQL_TYPE_ENUM: return str_values_type("enum", md.m_cols_values[i], length == 1 ? 1 : 255);
+        case MYSQL_TYPE_SET:  return str_values_type("set", md.m_cols_values[i], length * 8);
+        default:              return "char(" + std::to_string(length) + ")";
+        }
+    }
+    case MYSQL_TYPE_BLOB:
+        switch (meta)
+        {
+        case 1:  return "tinyblob";
+        case 2:  return "blob";
+        case 3:  return "mediumblob";
+        case 4:  return "longblob";
+        default: return "";
+        }
+    case MYSQL_TYPE_BIT:
+        return "bit(" + std::to_string((meta & 0xff) * 8 + (meta >> 8)) + ")";
+    default:
+        return "";
+    }
+}
+
+bool create_fields(const Table_map_event_info& tmi, std::vector<std::unique_ptr<Field> >& fields)
+{
+    Table_map_metadata md;
+    tmi.parse_metadata(md);
+
+    if (md.m_cols_names.empty())
+        return false;
+
+    // Lengths of strings are given in bytes
+    collate_info ci;
+    ci.maxlen = 1;
+
+    std::vector<std::unique_ptr<Field> > result;
+    for (size_t i = 0; i < tmi.m_cols_types.size(); ++i)
+    {
+        const std::string type = tmi.column_type(md, i);
+        if (type.empty()) {
+            LOG_DEBUG(log, "Column " << md.m_cols_names[i] << " of type " << (int)tmi.m_cols_types[i] << " can not be restored from TABLE_MAP");
+            return false;
+        }
+
+        const unsigned char binlog_type = tmi.m_cols_types[i];
+        const bool old_storage = binlog_type == MYSQL_TYPE_TIMESTAMP || binlog_type == MYSQL_TYPE_DATETIME || binlog_type == MYSQL_TYPE_TIME;
+        try
+        {
+            result.push_back(create_field(md.m_cols_names[i], type, ci, old_storage));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_DEBUG(log, "Column " << md.m_cols_names[i] << " of type " << type << " can not be created: " << e.what());
+            return false;
+        }
+    }
+
+    fields = std::move(result);
+    return true;
 }
 
 Row_event_info::Row_event_info(const char* buf, unsigned int event_len, bool do_update, bool master_ge_56) {
@@ -173,10 +520,182 @@ Gtid_event_info::Gtid_event_info(const char* buf, unsigned int event_len)
         throw std::runtime_error("Gtid_event_info::Gtid_event_info failed");
     }
 
-    m_sid = bin2hex((uchar*)buf + LOG_EVENT_HEADER_LEN + ENCODED_FLAG_LENGTH, ENCODED_SID_LENGTH);
+    m_sid = ServerUuid::fromBinary(buf + LOG_EVENT_HEADER_LEN + ENCODED_FLAG_LENGTH);
     m_gno = sint8korr(buf + LOG_EVENT_HEADER_LEN + ENCODED_FLAG_LENGTH + ENCODED_SID_LENGTH);
 }
 
+#ifdef SLAVE_WITH_ZSTD
+struct Transaction_payload_event_info::Decompressor
+{
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    bool frame_done = false;
+
+    Decompressor()
+    {
+        if (!stream)
+            throw std::runtime_error("Transaction_payload_event_info: ZSTD_createDStream failed");
+        ZSTD_initDStream(stream);
+    }
+    ~Decompressor() { ZSTD_freeDStream(stream); }
+};
+#else
+struct Transaction_payload_event_info::Decompressor {};
+#endif
+
+Transaction_payload_event_info::Transaction_payload_event_info(const char* buf, unsigned int event_len)
+    : m_compression_type(COMPRESSION_NONE), m_payload_size(0), m_uncompressed_size(0)
+    , m_payload(NULL), m_payload_pos(0), m_begin(0), m_end(0)
+{
+    if (event_len < LOG_EVENT_HEADER_LEN) {
+        LOG_ERROR(log, "Sanity check failed: " << event_len << " " << LOG_EVENT_HEADER_LEN);
+        throw std::runtime_error("Transaction_payload_event_info::Transaction_payload_event_info failed");
+    }
+
+    // Header is a list of (type, length, value) fields, all encoded as packed integers
+    enum { END_MARK = 0, PAYLOAD_SIZE = 1, COMPRESSION_TYPE = 2, UNCOMPRESSED_SIZE = 3 };
+
+    const unsigned char* p = (const unsigned char*)buf + LOG_EVENT_HEADER_LEN;
+    const unsigned char* end = (const unsigned char*)buf + event_len;
+
+    bool has_size = false;
+    while (true)
+    {
+        const uint64_t type = read_packed_length(p, end);
+        if (type == END_MARK)
+            break;
+
+        const uint64_t length = read_packed_length(p, end);
+        if ((uint64_t)(end - p) < length)
+            throw std::runtime_error("Transaction_payload_event_info: truncated header");
+
+        const unsigned char* value = p;
+        switch (type)
+        {
+        case PAYLOAD_SIZE:
+            m_payload_size = read_packed_length(value, p + length);
+            has_size = true;
+            break;
+        case COMPRESSION_TYPE:
+            m_compression_type = read_packed_length(value, p + length);
+            break;
+        case UNCOMPRESSED_SIZE:
+            m_uncompressed_size = read_packed_length(value, p + length);
+            break;
+        default:
+            // Fields of newer servers
+            break;
+        }
+        p += length;
+    }
+
+    if (!has_size || m_payload_size != (uint64_t)(end - p)) {
+        LOG_ERROR(log, "Transaction payload size " << m_payload_size << " does not match event size " << event_len);
+        throw std::runtime_error("Transaction_payload_event_info::Transaction_payload_event_info failed");
+    }
+    m_payload = (const char*)p;
+
+    if (m_compression_type == COMPRESSION_ZSTD) {
+#ifdef SLAVE_WITH_ZSTD
+        m_decompressor.reset(new Decompressor);
+        m_buf.resize(ZSTD_DStreamOutSize());
+#else
+        LOG_ERROR(log, "Transaction payload is compressed with zstd, but libslave is built without zstd");
+        throw std::runtime_error("Transaction_payload_event_info::Transaction_payload_event_info failed");
+#endif
+    } else if (m_compression_type != COMPRESSION_NONE) {
+        LOG_ERROR(log, "Unknown transaction payload compression type: " << m_compression_type);
+        throw std::runtime_error("Transaction_payload_event_info::Transaction_payload_event_info failed");
+    }
+}
+
+Transaction_payload_event_info::~Transaction_payload_event_info() {}
+
+bool Transaction_payload_event_info::decompress()
+{
+#ifdef SLAVE_WITH_ZSTD
+    Decompressor& d = *m_decompressor;
+    if (d.frame_done && m_payload_pos == m_payload_size)
+        return false;
+
+    // Keep the incomplete event and make room after it
+    if (m_begin != 0) {
+        ::memmove(m_buf.data(), m_buf.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_end == m_buf.size())
+        m_buf.resize(m_buf.size() * 2);
+
+    ZSTD_inBuffer in = { m_payload, (size_t)m_payload_size, m_payload_pos };
+    ZSTD_outBuffer out = { m_buf.data(), m_buf.size(), m_end };
+
+    const size_t rc = ZSTD_decompressStream(d.stream, &out, &in);
+    if (ZSTD_isError(rc)) {
+        LOG_ERROR(log, "Transaction payload decompression failed: " << ZSTD_getErrorName(rc));
+        throw std::runtime_error("Transaction_payload_event_info::next failed");
+    }
+    d.frame_done = rc == 0;
+
+    const bool progress = in.pos != m_payload_pos || out.pos != m_end;
+    m_payload_pos = in.pos;
+    m_end = out.pos;
+
+    if (!progress && !d.frame_done) {
+        LOG_ERROR(log, "Transaction payload is truncated");
+        throw std::runtime_error("Transaction_payload_event_info::next failed");
+    }
+    return progress;
+#else
+    return false;
+#endif
+}
+
+const char* Transaction_payload_event_info::next(unsigned int& event_len)
+{
+    if (m_compression_type == COMPRESSION_NONE) {
+        // Events are laid out as is, no copying needed
+        const size_t left = m_payload_size - m_payload_pos;
+        if (left == 0)
+            return NULL;
+
+        const char* ev = m_payload + m_payload_pos;
+        if (left < LOG_EVENT_MINIMAL_HEADER_LEN || (event_len = uint4korr(ev + EVENT_LEN_OFFSET)) < LOG_EVENT_MINIMAL_HEADER_LEN ||
+            event_len > left) {
+            LOG_ERROR(log, "Invalid event inside transaction payload at " << m_payload_pos);
+            throw std::runtime_error("Transaction_payload_event_info::next failed");
+        }
+        m_payload_pos += event_len;
+        return ev;
+    }
+
+    while (true) {
+        const size_t left = m_end - m_begin;
+        if (left >= LOG_EVENT_MINIMAL_HEADER_LEN) {
+            const char* ev = m_buf.data() + m_begin;
+            event_len = uint4korr(ev + EVENT_LEN_OFFSET);
+            if (event_len < LOG_EVENT_MINIMAL_HEADER_LEN) {
+                LOG_ERROR(log, "Invalid event length inside transaction payload: " << event_len);
+                throw std::runtime_error("Transaction_payload_event_info::next failed");
+            }
+            if (event_len <= left) {
+                m_begin += event_len;
+                return ev;
+            }
+            // Event larger than the buffer
+            if (m_buf.size() < event_len)
+                m_buf.resize(event_len);
+        }
+
+        if (!decompress()) {
+            if (m_begin != m_end) {
+                LOG_ERROR(log, "Transaction payload ends with incomplete event");
+                throw std::runtime_error("Transaction_payload_event_info::next failed");
+            }
+            return NULL;
+        }
+    }
+}
+
 /////////////////////////
 
 
@@ -247,13 +766,50 @@ inline void check_format_description(const char* buf, unsigned int event_len, bo
 }
 
 
-inline uint32_t checksum_crc32(uint32_t crc, const unsigned char* pos, size_t length)
+bool verify_checksum(const char* buf, unsigned int event_len, EventStatIface* event_stat)
 {
-    return static_cast<uint32_t>(::crc32(static_cast<unsigned int>(crc), pos, static_cast<unsigned int>(length)));
+    if (event_len < BINLOG_CHECKSUM_LEN)
+        return false;
+
+    uint32_t incoming;
+    ::memcpy(&incoming, buf + event_len - BINLOG_CHECKSUM_LEN, sizeof(incoming));
+    incoming = le32toh(incoming);
+
+    const bool timed = event_stat && event_stat->sampleTiming(tsChecksum);
+    const uint64_t start = timed ? monotonic_ns() : 0;
+    SLAVE_PROBE_BEGIN(probe, event_stat, psChecksum);
+
+    const uint32_t computed = checksum_crc32(0, (const unsigned char*)buf, event_len - BINLOG_CHECKSUM_LEN);
+
+    SLAVE_PROBE_END(probe, event_len);
+    if (timed)
+        event_stat->tickChecksum(monotonic_ns() - start);
+
+    if (incoming != computed)
+    {
+        LOG_ERROR(log, "CRC32 check failed: incoming (" << incoming << ") != computed (" << computed << ")");
+        return false;
+    }
+    return true;
 }
 
+bool ignorable_event(const char* buf, unsigned int event_len)
+{
+    if (event_len < LOG_EVENT_HEADER_LEN)
+        return false;
+
+    switch ((unsigned char)buf[EVENT_TYPE_OFFSET]) {
+    case IGNORABLE_LOG_EVENT:
+    case ROWS_QUERY_LOG_EVENT:
+    case ANNOTATE_ROWS_EVENT:
+        return true;
+    default:
+        return uint2korr(buf + FLAGS_OFFSET) & LOG_EVENT_IGNORABLE_F;
+    }
+}
 
-bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info)
+bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info,
+                    bool verify)
 
 {
 
@@ -279,24 +835,16 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
 
     if (master_info.checksumEnabled())
     {
-        uint32_t incoming;
-        ::memcpy(&incoming, buf + event_len - BINLOG_CHECKSUM_LEN, sizeof(incoming));
-        incoming = le32toh(incoming);
-
-        uint32_t computed = checksum_crc32(0L, nullptr, 0);
-        computed = checksum_crc32(computed, (const unsigned char*)buf, event_len - BINLOG_CHECKSUM_LEN);
-
-        if (incoming != computed)
-        {
-            LOG_ERROR(log, "CRC32 check failed: incoming (" << incoming << ") != computed (" << computed << ")");
+        if (verify && master_info.sampleChecksum() && !verify_checksum(buf, event_len, event_stat))
             throw std::runtime_error("slave::read_log_event failed");
-        }
+
         bei.event_len -= BINLOG_CHECKSUM_LEN;
     }
 
     if (event_stat)
         if (bei.type != FORMAT_DESCRIPTION_EVENT && bei.type != ROTATE_EVENT &&
-            bei.type != HEARTBEAT_LOG_EVENT && bei.type != PREVIOUS_GTIDS_LOG_EVENT)
+            bei.type != HEARTBEAT_LOG_EVENT && bei.type != HEARTBEAT_LOG_EVENT_V2 &&
+            bei.type != PREVIOUS_GTIDS_LOG_EVENT)
             event_stat->tick(bei.when);
 
     switch (bei.type) {
@@ -338,6 +886,9 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
         break;
     case GTID_LOG_EVENT:
         return true;
+    case TRANSACTION_PAYLOAD_EVENT:
+        // Inner events are read by Slave::handle_event one by one.
+        return true;
     case LOAD_EVENT:
     case NEW_LOAD_EVENT:
     case SLAVE_EVENT: /* can never happen (unused event) */
@@ -364,6 +915,8 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
     case TRANSACTION_CONTEXT_EVENT:
     case VIEW_CHANGE_EVENT:
     case XA_PREPARE_LOG_EVENT:
+    case PARTIAL_UPDATE_ROWS_EVENT: /* binlog_row_value_options=PARTIAL_JSON is not supported */
+    case HEARTBEAT_LOG_EVENT_V2:
         if (event_stat)
             event_stat->tickOther();
         return false;
@@ -397,35 +950,105 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
 size_t n_set_bits(const std::vector<unsigned char>& b, unsigned int count) {
 
     size_t ret = 0;
+    const unsigned int bytes = count / 8;
 
-    for (unsigned int i = 0; i < count; ++i) {
+    for (unsigned int i = 0; i < bytes; ++i)
+        ret += __builtin_popcount(b[i]);
 
-        if (b[i / 8] & (1 << (i & 7)))
-            ret++;
-    }
+    if (count & 7)
+        ret += __builtin_popcount(b[bytes] & ((1U << (count & 7)) - 1));
 
     return ret;
 }
 
+namespace // anonymous
+{
+    // True if none of the bytes is set, checks 8 bytes at once
+    inline bool all_zero(const unsigned char* p, size_t len)
+    {
+        uint64_t acc = 0;
+        for (; len >= 8; p += 8, len -= 8) {
+            uint64_t w;
+            ::memcpy(&w, p, 8);
+            acc |= w;
+        }
+        for (; len; ++p, --len)
+            acc |= *p;
+        return acc == 0;
+    }
+} // namespace anonymous
+
+typedef std::pair<std::string, slave::FieldValue> ColumnValue;
+
+// Place of the column in the row, nullptr if the column is filtered out.
+// 'filled' counts columns put into the row so far.
 template <typename T>
-void fill_row(const slave::Table& table, T& row, unsigned index, const slave::FieldValue& value);
+ColumnValue* column_slot(const slave::Table& table, T& row, const slave::Table::DecodeStep& step, size_t& filled);
 
 template <>
-void fill_row<slave::Row>(const slave::Table& table, slave::Row& row, unsigned index, const slave::FieldValue& value)
+ColumnValue* column_slot<slave::Row>(const slave::Table& table, slave::Row& row, const slave::Table::DecodeStep& step, size_t& filled)
 {
-    const auto& field = table.fields[index];
-    if (table.column_filter.empty() || table.column_filter[index / 8] & (1 << (index & 7)))
-        row[field->getFieldName()] = std::make_pair(field->field_type, value);
+    if (!step.wanted)
+        return nullptr;
+    SLAVE_PROBE_ROW_INSERT(row, step.field->field_name);
+    return &row[step.field->field_name];
 }
 
 template <>
-void fill_row<slave::RowVector>(const slave::Table& table, slave::RowVector& row, unsigned index, const slave::FieldValue& value)
+ColumnValue* column_slot<slave::RowVector>(const slave::Table& table, slave::RowVector& row, const slave::Table::DecodeStep& step, size_t& filled)
 {
-    const auto& field = table.fields[index];
-    if (table.column_filter.empty())
-        row.emplace_back(field->field_type, value);
-    else if (table.column_filter[index / 8] & (1 << (index & 7)))
-        row[table.column_filter_fields[index]] = std::make_pair(field->field_type, value);
+    if (!table.column_filter.empty())
+        return step.wanted ? &row[step.output] : nullptr;
+
+    if (filled == row.size()) {
+        SLAVE_PROBE_PUSH(row);
+        row.emplace_back();
+    }
+    return &row[filled++];
+}
+
+// Type and value are assigned in place, so a reused row keeps buffers of its strings
+
+inline void fill_type(ColumnValue& column, const slave::Table::DecodeStep& step)
+{
+    SLAVE_PROBE_STRING_ASSIGN(column.first, step.field->field_type.size());
+    column.first = step.field->field_type;
+}
+
+template <typename T>
+void fill_row(const slave::Table& table, T& row, const slave::Table::DecodeStep& step, slave::FieldValue&& value, size_t& filled)
+{
+    if (ColumnValue* column = column_slot(table, row, step, filled)) {
+        fill_type(*column, step);
+        column->second = std::move(value);
+    }
+}
+
+// Strings are copied right out of the event buffer
+template <typename T>
+void fill_string(const slave::Table& table, T& row, const slave::Table::DecodeStep& step, const slave::StringRef& value, size_t& filled)
+{
+    if (ColumnValue* column = column_slot(table, row, step, filled)) {
+        fill_type(*column, step);
+        SLAVE_PROBE_STRING_VALUE(column->second);
+        std::string& s = slave::stringFieldValue(column->second);
+        SLAVE_PROBE_STRING_ASSIGN(s, value.size);
+        s.assign(value.data, value.size);
+    }
+}
+
+// Column of the table absent from the row image
+template <typename T>
+void skip_column(const slave::Table& table, T& row, const slave::Table::DecodeStep& step) {}
+
+template <>
+void skip_column<slave::RowVector>(const slave::Table& table, slave::RowVector& row, const slave::Table::DecodeStep& step)
+{
+    // Filtered row has a place for it, which may be left from the previous row
+    if (!table.column_filter.empty() && step.wanted) {
+        row[step.output].first.clear();
+        row[step.output].second = slave::FieldValue();
+    }
 }
 
 template <typename T>
@@ -440,6 +1063,61 @@ void reserve_row<slave::RowVector>(const slave::Table& table, slave::RowVector&
         row.resize(table.column_filter_count);
 }
 
+// Drops columns a reused row had past the ones filled now
+template <typename T>
+void finish_row(const slave::Table& table, T& row, size_t filled) {}
+
+template <>
+void finish_row<slave::RowVector>(const slave::Table& table, slave::RowVector& row, size_t filled)
+{
+    if (table.column_filter.empty())
+        row.resize(filled);
+}
+
+namespace // anonymous
+{
+    // Layout of the row image header: which columns are present and which are NULL
+    struct RowImage
+    {
+        const unsigned char* null_bits;
+        unsigned char* data;
+        bool all_present;
+        bool no_nulls;
+
+        RowImage(const slave::Table& table, unsigned int colcnt, unsigned char* row, const std::vector<unsigned char>& cols)
+        {
+            if (colcnt != table.fields.size()) {
+                LOG_ERROR(log, "Field count mismatch in unpacking row for "
+                          << table.full_name << ": " << colcnt << " != " << table.fields.size());
+                throw std::runtime_error("unpack_row failed");
+            }
+
+            const size_t present = cols.empty() ? colcnt : n_set_bits(cols, colcnt);
+            const size_t master_null_byte_count = (present + 7) / 8;
+            const size_t full_bytes = present / 8;
+            const unsigned tail_bits = present & 7;
+
+            null_bits = row;
+            data = row + master_null_byte_count;
+            all_present = present == colcnt;
+            // MySQL 5.x and MariaDB set unused bits of the last byte, they are masked out
+            no_nulls = all_zero(null_bits, full_bytes)
+                && !(tail_bits && (null_bits[full_bytes] & ((1 << tail_bits) - 1)));
+        }
+
+        bool present(const std::vector<unsigned char>& cols, unsigned i) const
+        {
+            return all_present || (cols[i / 8] & (1 << (i & 7)));
+        }
+
+        // 'n' is the number of the column among present ones
+        bool is_null(unsigned n) const
+        {
+            return !no_nulls && (null_bits[n / 8] & (1 << (n & 7)));
+        }
+    };
+} // namespace anonymous
+
 template <typename T>
 unsigned char* unpack_row(const slave::Table& table,
                           T& _row,
@@ -451,44 +1129,31 @@ unsigned char* unpack_row(const slave::Table& table,
     LOG_TRACE(log, "Unpacking row: " << "fields in the table " << table.fields.size() << ", fields in the event " << colcnt
              << ", bitfield width " << cols.size());
 
-    if (colcnt != table.fields.size()) {
-        LOG_ERROR(log, "Field count mismatch in unpacking row for "
-                  << table.full_name << ": " << colcnt << " != " << table.fields.size());
-        throw std::runtime_error("unpack_row failed");
-    }
-
-
-    // pointer to start of data; skip master_null_bytes
-
-    size_t master_null_byte_count = (n_set_bits(cols, colcnt) + 7) / 8;
-
-    unsigned char* ptr = row + master_null_byte_count;
-
-    //
-    unsigned char* null_ptr = row;
-    unsigned int null_mask = 1U;
-    unsigned char null_bits = *null_ptr++;
+    const RowImage image(table, colcnt, row, cols);
+    unsigned char* ptr = image.data;
+    unsigned n = 0;
+    size_t filled = 0;
 
     reserve_row<T>(table, _row);
 
-    for (unsigned i = 0; i < colcnt; i++)
+    for (const auto& step : table.decode_plan())
     {
-        const auto& field = table.fields[i];
-
-        if (!cols.empty() && !(cols[i / 8] & (1 << (i & 7)))) {
+        if (!image.present(cols, step.index)) {
 
-            LOG_TRACE(log, "field " << field->getFieldName() << " is not in column list.");
+            LOG_TRACE(log, "field " << step.field->field_name << " is not in column list.");
+            skip_column<T>(table, _row, step);
             continue;
         }
 
-        if ((null_mask & 0xFF) == 0) {
-            null_mask = 1U;
-            null_bits = *null_ptr++;
+        if (!step.wanted) {
 
-            LOG_TRACE(log, "null mask reset.");
+            // Filtered out columns are not decoded, only their length is read
+            if (!image.is_null(n++))
+                ptr = (unsigned char*)step.field->skip((const char*)ptr);
+            continue;
         }
 
-        if (null_bits & null_mask) {
+        if (image.is_null(n++)) {
 
             LOG_TRACE(log, "field with NULL value found");
 
@@ -496,38 +1161,110 @@ unsigned char* unpack_row(const slave::Table& table,
             // and put empty slave::FieldValue value to slave::Row's value
             // in order to indicate presence of NULL value.
 
-            fill_row<T>(table, _row, i, nullFieldValue());
+            fill_row<T>(table, _row, step, nullFieldValue(), filled);
+        }
+        else if (step.field->column_kind() == ColumnBatch::Binary)
+        {
+            const StringRef value = step.field->string_ref((const char*)ptr);
+            ptr = (unsigned char*)step.field->skip((const char*)ptr);
+            fill_string<T>(table, _row, step, value, filled);
         }
         else
         {
             // We unpack the field to some certain value if it was NOT NULL
-            ptr = (unsigned char*)field->unpack((const char*)ptr);
-            fill_row<T>(table, _row, i, field->field_data);
+            ptr = (unsigned char*)step.field->unpack((const char*)ptr);
+            SLAVE_PROBE_FIELD_VALUE(step.field->field_data);
+            fill_row<T>(table, _row, step, std::move(step.field->field_data), filled);
         }
 
-        null_mask <<= 1;
-
-        LOG_TRACE(log, "field: " << field->getFieldName());
+        LOG_TRACE(log, "field: " << step.field->field_name);
 
     }
 
+    finish_row<T>(table, _row, filled);
     return ptr;
 }
 
+unsigned char* unpack_row_view(const slave::Table& table,
+                               slave::RowView& _view,
+                               unsigned int colcnt,
+                               unsigned char* row,
+                               const std::vector<unsigned char>& cols)
+{
+    const RowImage image(table, colcnt, row, cols);
+    const char* ptr = (const char*)image.data;
+    unsigned n = 0;
 
-unsigned char* do_writedelete_row(const slave::Table& table,
-                                  const Basic_event_info& bei,
-                                  const Row_event_info& roi,
-                                  unsigned char* row_start,
-                                  ExtStateIface &ext_state) {
+    _view.reset(table.fields);
+
+    for (const auto& step : table.decode_plan())
+    {
+        if (!image.present(cols, step.index))
+            continue;
+
+        // Filtered out columns are skipped but left absent in the view
+        if (image.is_null(n++)) {
+            if (step.wanted)
+                _view.setNull(step.index);
+        } else {
+            const char* end = step.field->skip(ptr);
+            if (step.wanted)
+                _view.setValue(step.index, ptr, end);
+            ptr = end;
+        }
+    }
+
+    return (unsigned char*)ptr;
+}
+
+// Appends the row to table.column_batch(), absent columns become NULL
+unsigned char* unpack_row_columns(const slave::Table& table,
+                                  unsigned int colcnt,
+                                  unsigned char* row,
+                                  const std::vector<unsigned char>& cols)
+{
+    const RowImage image(table, colcnt, row, cols);
+    const char* ptr = (const char*)image.data;
+    unsigned n = 0;
+    auto column = table.column_batch().columns.begin();
+
+    for (const auto& step : table.decode_plan())
+    {
+        if (!image.present(cols, step.index)) {
+            if (step.wanted)
+                (column++)->appendNull();
+            continue;
+        }
+
+        if (!step.wanted) {
+            if (!image.is_null(n++))
+                ptr = step.field->skip(ptr);
+            continue;
+        }
+
+        if (image.is_null(n++))
+            column->appendNull();
+        else
+            ptr = step.field->append_to(*column, ptr);
+        ++column;
+    }
+
+    return (unsigned char*)ptr;
+}
 
-    slave::RecordSet _record_set;
+unsigned char* unpack_writedelete_row(const slave::Table& table,
+                                      const Basic_event_info& bei,
+                                      const Row_event_info& roi,
+                                      unsigned char* row_start,
+                                      slave::RecordSet& _record_set) {
 
     unsigned char* t = nullptr;
     if (table.row_type == RowType::Map)
         t = unpack_row(table, _record_set.m_row, roi.m_width, row_start, roi.m_cols);
-    else
+    else if (table.row_type == RowType::Vector)
         t = unpack_row(table, _record_set.m_row_vec, roi.m_width, row_start, roi.m_cols);
+    else
+        t = unpack_row_view(table, _record_set.m_row_view, roi.m_width, row_start, roi.m_cols);
 
     if (t == NULL) {
         return NULL;
@@ -540,24 +1277,22 @@ unsigned char* do_writedelete_row(const slave::Table& table,
     _record_set.type_event = (bei.type == WRITE_ROWS_EVENT_V1 || bei.type == WRITE_ROWS_EVENT ? slave::RecordSet::Write : slave::RecordSet::Delete);
     _record_set.master_id = bei.server_id;
 
-    table.call_callback(_record_set, ext_state);
-
     return t;
 }
 
-unsigned char* do_update_row(const slave::Table& table,
-                             const Basic_event_info& bei,
-                             const Row_event_info& roi,
-                             unsigned char* row_start,
-                             ExtStateIface &ext_state) {
-
-    slave::RecordSet _record_set;
+unsigned char* unpack_update_row(const slave::Table& table,
+                                 const Basic_event_info& bei,
+                                 const Row_event_info& roi,
+                                 unsigned char* row_start,
+                                 slave::RecordSet& _record_set) {
 
     unsigned char* t = nullptr;
     if (table.row_type == RowType::Map)
         t = unpack_row(table, _record_set.m_old_row, roi.m_width, row_start, roi.m_cols);
-    else
+    else if (table.row_type == RowType::Vector)
         t = unpack_row(table, _record_set.m_old_row_vec, roi.m_width, row_start, roi.m_cols);
+    else
+        t = unpack_row_view(table, _record_set.m_old_row_view, roi.m_width, row_start, roi.m_cols);
 
     if (t == NULL) {
         return NULL;
@@ -565,8 +1300,10 @@ unsigned char* do_update_row(const slave::Table& table,
 
     if (table.row_type == RowType::Map)
         t = unpack_row(table, _record_set.m_row, roi.m_width, t, roi.m_cols_ai);
-    else
+    else if (table.row_type == RowType::Vector)
         t = unpack_row(table, _record_set.m_row_vec, roi.m_width, t, roi.m_cols_ai);
+    else
+        t = unpack_row_view(table, _record_set.m_row_view, roi.m_width, t, roi.m_cols_ai);
 
     if (t == NULL) {
         return NULL;
@@ -579,7 +1316,63 @@ unsigned char* do_update_row(const slave::Table& table,
     _record_set.type_event = slave::RecordSet::Update;
     _record_set.master_id = bei.server_id;
 
+    return t;
+}
+
+unsigned char* do_writedelete_row(const slave::Table& table,
+                                  const Basic_event_info& bei,
+                                  const Row_event_info& roi,
+                                  unsigned char* row_start,
+                                  ExtStateIface &ext_state,
+                                  EventStatIface* event_stat,
+                                  uint64_t* decoded_at) {
+
+    slave::RecordSet _local_record_set;
+    slave::RecordSet& _record_set = table.reuse_rows
+        ? table.reuse_record_set(false, roi.m_cols, roi.m_cols_ai)
+        : _local_record_set;
+
+    SLAVE_PROBE_BEGIN(decode_probe, event_stat, psDecode);
+    unsigned char* t = unpack_writedelete_row(table, bei, roi, row_start, _record_set);
+    if (t == NULL) {
+        return NULL;
+    }
+    SLAVE_PROBE_END(decode_probe, t - row_start);
+    if (decoded_at)
+        *decoded_at = monotonic_ns();
+
+    SLAVE_PROBE_BEGIN(callback_probe, event_stat, psCallback);
     table.call_callback(_record_set, ext_state);
+    SLAVE_PROBE_END(callback_probe, t - row_start);
+
+    return t;
+}
+
+unsigned char* do_update_row(const slave::Table& table,
+                             const Basic_event_info& bei,
+                             const Row_event_info& roi,
+                             unsigned char* row_start,
+                             ExtStateIface &ext_state,
+                             EventStatIface* event_stat,
+                             uint64_t* decoded_at) {
+
+    slave::RecordSet _local_record_set;
+    slave::RecordSet& _record_set = table.reuse_rows
+        ? table.reuse_record_set(true, roi.m_cols, roi.m_cols_ai)
+        : _local_record_set;
+
+    SLAVE_PROBE_BEGIN(decode_probe, event_stat, psDecode);
+    unsigned char* t = unpack_update_row(table, bei, roi, row_start, _record_set);
+    if (t == NULL) {
+        return NULL;
+    }
+    SLAVE_PROBE_END(decode_probe, t - row_start);
+    if (decoded_at)
+        *decoded_at = monotonic_ns();
+
+    SLAVE_PROBE_BEGIN(callback_probe, event_stat, psCallback);
+    table.call_callback(_record_set, ext_state);
+    SLAVE_PROBE_END(callback_probe, t - row_start);
 
     return t;
 }
@@ -604,21 +1397,54 @@ namespace // anonymous
 
     inline time_stamp now()
     {
-        timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        return ts.tv_sec * 1000000000 + ts.tv_nsec;
+        return monotonic_ns();
     }
 
 } // namespace anonymous
 
 
+bool skip_row_event(const slave::RelayLogInfo& rli, const Basic_event_info& bei, EventStatIface* event_stat) {
+    // Too short events are left for Row_event_info to report
+    if (bei.event_len < LOG_EVENT_HEADER_LEN + RW_MAPID_OFFSET + 6)
+        return false;
+
+    const unsigned long table_id = uint6korr(bei.buf + LOG_EVENT_HEADER_LEN + RW_MAPID_OFFSET);
+    const Table* table = rli.getTableById(table_id);
+    const EventKind kind = eventKind(bei.type);
+
+    if (table && should_process(table->m_filter, kind))
+        return false;
+
+    if (event_stat) {
+        if (table)
+            event_stat->tickModifyEventFiltered(table_id, kind);
+        event_stat->tickModifyEventIgnored(table_id, kind);
+    }
+    return true;
+}
+
+bool skip_table_map_event(slave::RelayLogInfo& rli, const char* buf, unsigned int event_len,
+                          const std::set<std::pair<std::string, std::string>>& tables) {
+    const Table_map_event_view tmv(buf, event_len);
+
+    if (tables.count(std::make_pair(std::string(tmv.db_name, tmv.db_len), std::string(tmv.tbl_name, tmv.tbl_len))))
+        return false;
+
+    // Otherwise ROWS events of this table would be decoded as the table that had the id before
+    rli.unbindTableId(tmv.table_id);
+    return true;
+}
+
 void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface &ext_state, EventStatIface* event_stat) {
-    EventKind kind = eventKind(bei.type);
-    std::pair<std::string,std::string> key = rli.getTableNameById(roi.m_table_id);
+    const Table* table = rli.getTableById(roi.m_table_id);
+
+    LOG_DEBUG(log, "applyRowEvent(): " << roi.m_table_id << " " << (table ? table->full_name : std::string()));
 
-    LOG_DEBUG(log, "applyRowEvent(): " << roi.m_table_id << " " << key.first << "." << key.second);
+    apply_row_event(table, bei, roi, ext_state, event_stat);
+}
 
-    const auto& table = rli.getTable(key);
+void apply_row_event(const Table* table, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface &ext_state, EventStatIface* event_stat) {
+    EventKind kind = eventKind(bei.type);
 
     if (table) {
 
@@ -627,18 +1453,132 @@ void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, cons
 
         unsigned char* row_start = roi.m_rows_buf;
 
+        if (should_process(table->m_filter, kind) && table->m_columnar_callback) {
+            slave::ColumnBatch& batch = table->column_batch();
+            const BatchFlush& flush = table->batch_flush;
+            const slave::ColumnBatch::RowOp op = kind == eInsert ? slave::ColumnBatch::Insert : slave::ColumnBatch::Delete;
+            const bool timed = event_stat && event_stat->sampleTiming(tsRow);
+            const time_stamp start = timed ? now() : 0;
+            size_t rows = 0;
+            // Rows of earlier events, kept if this one fails
+            size_t kept = batch.rows();
+            try
+            {
+                // Columnar callbacks called on the row and byte limits are counted in decoding too
+                SLAVE_PROBE_BEGIN(decode_probe, event_stat, psDecode);
+                while (row_start < roi.m_rows_end) {
+                    if (kind == eUpdate) {
+                        row_start = unpack_row_columns(*table, roi.m_width, row_start, roi.m_cols);
+                        batch.ops.push_back(slave::ColumnBatch::UpdateBefore);
+                        batch.when.push_back(bei.when);
+                        row_start = unpack_row_columns(*table, roi.m_width, row_start, roi.m_cols_ai);
+                        batch.ops.push_back(slave::ColumnBatch::UpdateAfter);
+                    } else {
+                        row_start = unpack_row_columns(*table, roi.m_width, row_start, roi.m_cols);
+                        batch.ops.push_back(op);
+                    }
+                    batch.when.push_back(bei.when);
+                    ++rows;
+
+                    if ((flush.max_rows && batch.rows() >= flush.max_rows) ||
+                        (flush.max_bytes && batch.bytes() >= flush.max_bytes)) {
+                        kept = 0;
+                        SLAVE_PROBE_BEGIN(callback_probe, event_stat, psCallback);
+                        table->call_columnar_callback(ext_state);
+                        SLAVE_PROBE_END(callback_probe, roi.m_rows_end - roi.m_rows_buf);
+                    }
+                }
+                SLAVE_PROBE_END(decode_probe, roi.m_rows_end - roi.m_rows_buf);
+
+                if (flush.per_event) {
+                    SLAVE_PROBE_BEGIN(callback_probe, event_stat, psCallback);
+                    table->call_columnar_callback(ext_state);
+                    SLAVE_PROBE_END(callback_probe, roi.m_rows_end - roi.m_rows_buf);
+                }
+            }
+            catch (...)
+            {
+                // Rows of this event are dropped, a partly decoded one may leave columns
+                // with different lengths. The batch is empty if the callback failed.
+                batch.truncate(kept);
+                if (event_stat)
+                    event_stat->tickModifyEventFailed(roi.m_table_id, kind);
+                throw;
+            }
+            if (event_stat) {
+                // Rows are not timed separately, every row gets the average
+                const time_stamp per_row = timed && rows ? (now() - start) / rows : 0;
+                for (size_t i = 0; i < rows; ++i)
+                    event_stat->tickModifyRowDone(roi.m_table_id, kind, per_row);
+                event_stat->tickModifyEventLag(roi.m_table_id, kind, ::time(NULL) - bei.when);
+                event_stat->tickModifyEventDone(roi.m_table_id, kind);
+            }
+            return;
+        }
+
+        if (should_process(table->m_filter, kind) && table->m_batch_callback) {
+            std::vector<slave::RecordSet> batch;
+            const bool timed = event_stat && event_stat->sampleTiming(tsRow);
+            const time_stamp start = timed ? now() : 0;
+            time_stamp decoded = 0;
+            try
+            {
+                SLAVE_PROBE_BEGIN(decode_probe, event_stat, psDecode);
+                while (row_start < roi.m_rows_end &&
+                       row_start != NULL) {
+                    batch.emplace_back();
+                    if (kind == eUpdate)
+                        row_start = unpack_update_row(*table, bei, roi, row_start, batch.back());
+                    else
+                        row_start = unpack_writedelete_row(*table, bei, roi, row_start, batch.back());
+                }
+                if (row_start == NULL)
+                    batch.pop_back();
+                SLAVE_PROBE_END(decode_probe, roi.m_rows_end - roi.m_rows_buf);
+
+                if (timed)
+                    decoded = now();
+                SLAVE_PROBE_BEGIN(callback_probe, event_stat, psCallback);
+                table->call_batch_callback(batch, ext_state);
+                SLAVE_PROBE_END(callback_probe, roi.m_rows_end - roi.m_rows_buf);
+            }
+            catch (...)
+            {
+                if (event_stat)
+                    event_stat->tickModifyEventFailed(roi.m_table_id, kind);
+                throw;
+            }
+            if (event_stat) {
+                // Rows of a batch are not timed separately, every row gets the average
+                time_stamp per_row = 0;
+                if (timed && !batch.empty()) {
+                    per_row = (now() - start) / batch.size();
+                    const time_stamp decode_per_row = (decoded - start) / batch.size();
+                    for (size_t i = 0; i < batch.size(); ++i)
+                        event_stat->tickModifyRowDecoded(roi.m_table_id, kind, decode_per_row);
+                }
+                for (size_t i = 0; i < batch.size(); ++i)
+                    event_stat->tickModifyRowDone(roi.m_table_id, kind, per_row);
+                event_stat->tickModifyEventLag(roi.m_table_id, kind, ::time(NULL) - bei.when);
+                event_stat->tickModifyEventDone(roi.m_table_id, kind);
+            }
+            return;
+        }
+
         if (should_process(table->m_filter, kind)) {
             while (row_start < roi.m_rows_end &&
                    row_start != NULL) {
-                time_stamp start = now();
+                const bool timed = event_stat && event_stat->sampleTiming(tsRow);
+                const time_stamp start = timed ? now() : 0;
+                time_stamp decoded = 0;
                 try
                 {
                     if (kind == eUpdate) {
 
-                        row_start = do_update_row(*table, bei, roi, row_start, ext_state);
+                        row_start = do_update_row(*table, bei, roi, row_start, ext_state, event_stat, timed ? &decoded : NULL);
 
                     } else {
-                        row_start = do_writedelete_row(*table, bei, roi, row_start, ext_state);
+                        row_start = do_writedelete_row(*table, bei, roi, row_start, ext_state, event_stat, timed ? &decoded : NULL);
                     }
                 }
                 catch (...)
@@ -647,12 +1587,20 @@ void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, cons
                         event_stat->tickModifyEventFailed(roi.m_table_id, kind);
                     throw;
                 }
-                if (event_stat)
-                    event_stat->tickModifyRowDone(roi.m_table_id, kind, now() - start);
+                if (timed) {
+                    const time_stamp done = now();
+                    if (decoded)
+                        event_stat->tickModifyRowDecoded(roi.m_table_id, kind, decoded - start);
+                    event_stat->tickModifyRowDone(roi.m_table_id, kind, done - start);
+                }
+                else if (event_stat)
+                    event_stat->tickModifyRowDone(roi.m_table_id, kind, 0);
             }
 
-            if (event_stat)
+            if (event_stat) {
+                event_stat->tickModifyEventLag(roi.m_table_id, kind, ::time(NULL) - bei.when);
                 event_stat->tickModifyEventDone(roi.m_table_id, kind);
+            }
             return;
         }
         else if (event_stat)
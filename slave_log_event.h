@@ -16,7 +16,13 @@
 #ifndef __SLAVE_SLAVE_LOG_EVENT_H
 #define __SLAVE_SLAVE_LOG_EVENT_H
 
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "binlog_pos.h"
 #include "relayloginfo.h"
 
 
@@ -87,6 +93,14 @@ enum Log_event_type
 
   XA_PREPARE_LOG_EVENT= 38,
 
+  // 8.0 new events
+
+  PARTIAL_UPDATE_ROWS_EVENT= 39,
+
+  TRANSACTION_PAYLOAD_EVENT= 40,
+
+  HEARTBEAT_LOG_EVENT_V2= 41,
+
   ENUM_END_EVENT
 };
 
@@ -107,6 +121,15 @@ enum Temporal_type
 #define SERVER_ID_OFFSET     5
 #define EVENT_LEN_OFFSET     9
 #define LOG_POS_OFFSET       13
+#define FLAGS_OFFSET         17
+
+// Set on events a slave may skip if it does not know their type
+#define LOG_EVENT_IGNORABLE_F         0x80
+// MariaDB: event written with @@skip_replication=1
+#define LOG_EVENT_SKIP_REPLICATION_F  0x8000
+
+// MariaDB: query of the following rows events, sent with BINLOG_SEND_ANNOTATE_ROWS_EVENT dump flag only
+#define ANNOTATE_ROWS_EVENT  160
 
 #define LOG_EVENT_HEADER_LEN 19
 
@@ -172,6 +195,29 @@ struct Rotate_event_info {
     Rotate_event_info(const char* buf, unsigned int event_len);
 };
 
+// Database and query of a QUERY_EVENT, pointing into the event buffer
+struct Query_event_view {
+
+    const char* db_name;
+    size_t db_len;
+    const char* query;
+    size_t query_len;
+
+    Query_event_view(const char* buf, unsigned int event_len);
+};
+
+// Table id, database and table names of a TABLE_MAP_EVENT, names point into the event buffer
+struct Table_map_event_view {
+
+    unsigned long table_id;
+    const char* db_name;
+    size_t db_len;
+    const char* tbl_name;
+    size_t tbl_len;
+
+    Table_map_event_view(const char* buf, unsigned int event_len);
+};
+
 struct Query_event_info {
 
     std::string db_name;
@@ -180,6 +226,20 @@ struct Query_event_info {
     Query_event_info(const char* buf, unsigned int event_len);
 };
 
+// Column metadata of a TABLE_MAP event, see Table_map_event_info::parse_metadata()
+struct Table_map_metadata {
+
+    // Per column, as written by the server: string length, temporal precision etc.
+    std::vector<uint16_t> m_cols_meta;
+
+    // Optional metadata, logged by 8.0 (binlog_row_metadata), empty if absent
+    std::vector<std::string> m_cols_names;
+    // Per column, non-zero for unsigned numeric columns
+    std::vector<unsigned char> m_cols_unsigned;
+    // Per column, values of ENUM and SET columns
+    std::vector<std::vector<std::string> > m_cols_values;
+};
+
 struct Table_map_event_info {
 
     unsigned long m_table_id;
@@ -188,8 +248,27 @@ struct Table_map_event_info {
     std::vector<unsigned char> m_cols_types;
 
     Table_map_event_info(const char* buf, unsigned int event_len);
+
+    // Parses column metadata. It is only needed to build tables, so it is not done by the
+    // constructor and the event buffer has to be still alive.
+    void parse_metadata(Table_map_metadata& md) const;
+
+    // Type of the column in SHOW FULL COLUMNS notation ("int unsigned", "datetime(3)"),
+    // with string lengths in bytes; empty if it can not be restored (e.g. JSON, GEOMETRY)
+    std::string column_type(const Table_map_metadata& md, size_t i) const;
+
+private:
+
+    const unsigned char* m_meta;
+    const unsigned char* m_end;
 };
 
+// Builds column decoders from TABLE_MAP column types and metadata, so the table
+// can be updated without a query to the master. Returns false if it is impossible:
+// column names are logged only with binlog_row_metadata=FULL (8.0), and not all types
+// can be restored from the binlog.
+bool create_fields(const Table_map_event_info& tmi, std::vector<std::unique_ptr<Field> >& fields);
+
 struct Row_event_info {
 
     unsigned long m_width;
@@ -208,16 +287,72 @@ struct Row_event_info {
 
 struct Gtid_event_info
 {
-    std::string m_sid;
+    ServerUuid  m_sid;
     int64_t     m_gno;
 
     Gtid_event_info(const char* buf, unsigned int event_len);
 };
 
+// MySQL 8.0.20+ binlog_transaction_compression packs all events of a transaction
+// into one TRANSACTION_PAYLOAD_EVENT. Inner events are decompressed on the fly
+// by next(), so the whole transaction is never held in memory at once.
+struct Transaction_payload_event_info
+{
+    enum { COMPRESSION_ZSTD = 0, COMPRESSION_NONE = 255 };
+
+    uint64_t m_compression_type;
+    uint64_t m_payload_size;
+    uint64_t m_uncompressed_size;
+
+    // 'event_len' is without checksum
+    Transaction_payload_event_info(const char* buf, unsigned int event_len);
+    ~Transaction_payload_event_info();
+
+    // Returns next inner event and sets 'event_len', or returns nullptr after the last one.
+    // The event stays valid until the next call. Inner events carry no checksum.
+    const char* next(unsigned int& event_len);
+
+private:
+
+    // Decompresses more data into m_buf, returns false if nothing is left
+    bool decompress();
+
+    const char* m_payload;
+    size_t m_payload_pos;
+
+    struct Decompressor;
+    std::unique_ptr<Decompressor> m_decompressor;
+
+    std::vector<char> m_buf;
+    size_t m_begin;
+    size_t m_end;
+};
+
+
+// Checks CRC32 checksum stored in the last bytes of the event
+bool verify_checksum(const char* buf, unsigned int event_len, EventStatIface* event_stat = nullptr);
+
+// Returns true for rows query events and events flagged as ignorable, which carry nothing
+// the library uses. Looks at the common header only, so it can be called before the
+// checksum is verified.
+bool ignorable_event(const char* buf, unsigned int event_len);
+
+// If 'verify' is false, the checksum is expected to be verified by the caller beforehand
+bool read_log_event(const char* buf, unsigned int event_len, Basic_event_info& info, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info,
+                    bool verify = true);
+
+// Checks table id of a ROWS event before it is parsed. Returns true (and updates stats)
+// if the table has no callback or the callback does not want this kind of events.
+bool skip_row_event(const slave::RelayLogInfo& rli, const Basic_event_info& bei, EventStatIface* event_stat);
 
-bool read_log_event(const char* buf, unsigned int event_len, Basic_event_info& info, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info);
+// Checks names of a TABLE_MAP event before it is parsed. Returns true if the table is not
+// among 'tables'; its id is unbound then, as ids are reused after a restart of the master.
+bool skip_table_map_event(slave::RelayLogInfo& rli, const char* buf, unsigned int event_len,
+                          const std::set<std::pair<std::string, std::string>>& tables);
 
 void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface &ext_state, EventStatIface* event_stat);
+// Same as above for the already resolved table, nullptr if the table is not being tracked
+void apply_row_event(const Table* table, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface &ext_state, EventStatIface* event_stat);
 
 
 //------------------------------------------------------------------------------------------
@@ -21,6 +21,7 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <unordered_map>
 
 #include "field.h"
 #include "recordset.h"
@@ -32,6 +33,7 @@ namespace slave
 
 typedef std::unique_ptr<Field> PtrField;
 typedef std::function<void (RecordSet&)> callback;
+typedef std::function<void (std::vector<RecordSet>&)> batch_callback;
 typedef EventKind filter;
 
 
@@ -48,46 +50,191 @@ public:
     RowType  row_type;
 
     callback m_callback;
+    batch_callback m_batch_callback;
+    // If set, rows are decoded into column_batch() instead of RecordSet's
+    columnar_callback m_columnar_callback;
+    BatchFlush batch_flush;
     EventKind m_filter;
 
+    // If set, rows are unpacked into the table's own RecordSet (see reuse_record_set())
+    bool reuse_rows = false;
+
+    // See ExtStateIface::tableCountIndex()
+    size_t count_index = ExtStateIface::no_table_index;
+
     void call_callback(slave::RecordSet& _rs, ExtStateIface &ext_state) const
     {
         // Some stats
-        ext_state.incTableCount(full_name);
+        if (count_index != ExtStateIface::no_table_index)
+            ext_state.incTableCountAt(count_index, 1);
+        else
+            ext_state.incTableCount(full_name);
         ext_state.setLastFilteredUpdateTime();
 
         m_callback(_rs);
     }
 
+    void call_batch_callback(std::vector<slave::RecordSet>& _batch, ExtStateIface &ext_state) const
+    {
+        if (_batch.empty())
+            return;
+
+        // Some stats
+        if (count_index != ExtStateIface::no_table_index)
+            ext_state.incTableCountAt(count_index, _batch.size());
+        else
+            ext_state.incTableCount(full_name, _batch.size());
+        ext_state.setLastFilteredUpdateTime();
+
+        m_batch_callback(_batch);
+    }
+
+    // Passes the rows collected in column_batch() to the columnar callback and clears the batch
+    void call_columnar_callback(ExtStateIface &ext_state) const
+    {
+        if (m_column_batch.ops.empty())
+            return;
+
+        // Some stats, an update is one row as for the other callbacks
+        size_t rows = 0;
+        for (const auto op : m_column_batch.ops)
+            rows += op != ColumnBatch::UpdateBefore;
+        if (count_index != ExtStateIface::no_table_index)
+            ext_state.incTableCountAt(count_index, rows);
+        else
+            ext_state.incTableCount(full_name, rows);
+        ext_state.setLastFilteredUpdateTime();
+
+        struct Clear
+        {
+            ColumnBatch& batch;
+            ~Clear() { batch.clear(); }
+        } clear{m_column_batch};
+        m_columnar_callback(m_column_batch);
+    }
+
+    ColumnBatch& column_batch() const { return m_column_batch; }
+
+    // Sets up columns of column_batch() for the current fields, column filter and value formats
+    void init_column_batch() const
+    {
+        m_column_batch.db_name = database_name;
+        m_column_batch.tbl_name = table_name;
+        m_column_batch.columns.clear();
+        m_column_batch.ops.clear();
+        m_column_batch.when.clear();
+        for (const auto& step : decode_plan())
+        {
+            if (!step.wanted)
+                continue;
+            m_column_batch.columns.emplace_back();
+            ColumnBatch::Column& c = m_column_batch.columns.back();
+            c.name = step.field->field_name;
+            c.type = step.field->field_type;
+            c.kind = step.field->column_kind();
+            c.clear();
+        }
+    }
+
+    // Returns the table's RecordSet prepared for the next row. Containers keep their memory
+    // between rows: map nodes are kept while the set of columns stays the same, vectors keep
+    // their elements, and type and value strings are assigned in place. The RecordSet is
+    // overwritten by the next row, so callbacks have to copy out everything they need after
+    // they return.
+    RecordSet& reuse_record_set(bool update, const std::vector<unsigned char>& cols,
+                                const std::vector<unsigned char>& cols_ai) const
+    {
+        if (update != m_reuse_update || cols != m_reuse_cols || (update && cols_ai != m_reuse_cols_ai))
+        {
+            m_record_set.m_row.clear();
+            m_record_set.m_old_row.clear();
+            m_record_set.m_row_vec.clear();
+            m_record_set.m_old_row_vec.clear();
+            m_reuse_update = update;
+            m_reuse_cols = cols;
+            m_reuse_cols_ai = cols_ai;
+        }
+        return m_record_set;
+    }
+
+    // Replaces column decoders of the table, e.g. after ALTER TABLE.
+    // set_column_filter() has to be called afterwards.
+    void reset_fields(std::vector<PtrField>&& new_fields)
+    {
+        fields = std::move(new_fields);
+        m_decode_plan.clear();
+        // Column names may have changed, so reused rows have to start from scratch
+        m_record_set.m_row.clear();
+        m_record_set.m_old_row.clear();
+        m_record_set.m_row_vec.clear();
+        m_record_set.m_old_row_vec.clear();
+        m_reuse_cols.clear();
+        m_reuse_cols_ai.clear();
+        // Unflushed rows are dropped, init_column_batch() sets up the new columns
+        m_column_batch = ColumnBatch();
+    }
+
+    // One step of row decoding, see decode_plan()
+    struct DecodeStep
+    {
+        Field* field;
+        unsigned index;     // column number in the table
+        bool wanted;        // column passes column filter
+        unsigned output;    // position in RowVector when column filter is set
+    };
+    typedef std::vector<DecodeStep> decode_plan_t;
+
+    // Per column decoding instructions for the current fields and column filter,
+    // so row unpacking does not need to look into the filter bitmaps.
+    const decode_plan_t& decode_plan() const
+    {
+        if (m_decode_plan.size() != fields.size())
+            build_decode_plan();
+        return m_decode_plan;
+    }
+
+    void build_decode_plan() const
+    {
+        m_decode_plan.clear();
+        m_decode_plan.reserve(fields.size());
+        for (unsigned i = 0; i < fields.size(); ++i) {
+            DecodeStep step;
+            step.field = fields[i].get();
+            step.index = i;
+            step.wanted = column_filter.empty() || column_filter[i / 8] & (1 << (i & 7));
+            step.output = column_filter.empty() ? i : column_filter_fields[i];
+            m_decode_plan.push_back(step);
+        }
+    }
+
     void set_column_filter(const std::vector<std::string> &_column_filter) {
         if (_column_filter.empty()) {
             column_filter.clear();
             column_filter_fields.clear();
             column_filter_count = 0;
+            build_decode_plan();
             return;
         }
 
-        column_filter.resize((fields.size() + 7)/8);
-        column_filter_fields.resize(fields.size());
+        column_filter.assign((fields.size() + 7)/8, 0);
+        column_filter_fields.assign(fields.size(), 0);
         column_filter_count = _column_filter.size();
-        for (unsigned i = 0; i < column_filter.size(); i++) {
-            column_filter[i] = 0;
-            column_filter_fields[i] = 0;
-        }
 
-        // FIXME: this loop has complexity factor of O(N*M)
-        for (auto i = _column_filter.begin(); i != _column_filter.end(); ++i) {
-            const auto &field_name = *i;
-            for (auto j = fields.begin(); j != fields.end(); ++j) {
-                const auto &field = *j;
-                if (field->getFieldName() == field_name) {
-                    const int index = j - fields.begin();
-                    column_filter[index>>3] |= (1<<(index&7));
-                    column_filter_fields[index] = i - _column_filter.begin();
-                    break;
-                }
-            }
+        std::unordered_map<std::string, unsigned> index_by_name;
+        index_by_name.reserve(fields.size());
+        for (unsigned j = 0; j < fields.size(); ++j)
+            index_by_name.emplace(fields[j]->field_name, j);
+
+        for (unsigned i = 0; i < _column_filter.size(); ++i) {
+            const auto it = index_by_name.find(_column_filter[i]);
+            if (it == index_by_name.end())
+                continue;
+            const unsigned index = it->second;
+            column_filter[index>>3] |= (1<<(index&7));
+            column_filter_fields[index] = i;
         }
+
+        build_decode_plan();
     }
 
     const std::string table_name;
@@ -95,6 +242,17 @@ public:
 
     std::string full_name;
 
+private:
+
+    mutable decode_plan_t m_decode_plan;
+    mutable RecordSet m_record_set;
+    mutable ColumnBatch m_column_batch;
+    mutable bool m_reuse_update = false;
+    mutable std::vector<unsigned char> m_reuse_cols;
+    mutable std::vector<unsigned char> m_reuse_cols_ai;
+
+public:
+
     Table(const std::string& db_name, const std::string& tbl_name) :
         column_filter_count(0),
         table_name(tbl_name), database_name(db_name),
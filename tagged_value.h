@@ -0,0 +1,150 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_TAGGED_VALUE_H_
+#define __SLAVE_TAGGED_VALUE_H_
+
+#include <cstddef>  // for std::nullptr_t
+#include <stdint.h>
+#include <string>
+#include <typeinfo>
+#include <utility>
+
+namespace slave
+{
+
+struct bad_tagged_value_cast : public std::bad_cast
+{
+    const char* what() const noexcept override { return "slave::bad_tagged_value_cast"; }
+};
+
+// Fixed-size field value: type tag plus number, or string. Integers and numbers are
+// stored inline without heap allocation, strings use std::string (short ones fit
+// into its small-string buffer). Consumers can switch on tag() instead of comparing
+// type()'s.
+class TaggedValue
+{
+public:
+
+    enum Tag : unsigned char { Null, Char, UInt16, Int32, UInt32, UInt64, Float, Double, String, Int64 };
+
+    TaggedValue() : m_tag(Null) { m_u.u = 0; }
+    TaggedValue(std::nullptr_t) : TaggedValue() {}
+    TaggedValue(char v) : m_tag(Char) { m_u.i = v; }
+    TaggedValue(uint16_t v) : m_tag(UInt16) { m_u.u = v; }
+    TaggedValue(int32_t v) : m_tag(Int32) { m_u.i = v; }
+    TaggedValue(uint32_t v) : m_tag(UInt32) { m_u.u = v; }
+    TaggedValue(unsigned long v) : m_tag(UInt64) { m_u.u = v; }
+    TaggedValue(unsigned long long v) : m_tag(UInt64) { m_u.u = v; }
+    TaggedValue(long v) : m_tag(Int64) { m_u.i = v; }
+    TaggedValue(long long v) : m_tag(Int64) { m_u.i = v; }
+    TaggedValue(float v) : m_tag(Float) { m_u.d = v; }
+    TaggedValue(double v) : m_tag(Double) { m_u.d = v; }
+    TaggedValue(const std::string& v) : m_tag(String), m_str(v) { m_u.u = 0; }
+    TaggedValue(std::string&& v) : m_tag(String), m_str(std::move(v)) { m_u.u = 0; }
+
+    TaggedValue(const TaggedValue&) = default;
+    TaggedValue& operator=(const TaggedValue&) = default;
+    // Moved from value is Null, the same as moved from boost::any is empty
+    TaggedValue(TaggedValue&& v) noexcept : m_tag(v.m_tag), m_u(v.m_u), m_str(std::move(v.m_str)) { v.m_tag = Null; }
+    TaggedValue& operator=(TaggedValue&& v) noexcept
+    {
+        m_tag = v.m_tag;
+        m_u = v.m_u;
+        m_str = std::move(v.m_str);
+        v.m_tag = Null;
+        return *this;
+    }
+
+    Tag tag() const { return m_tag; }
+    bool empty() const { return m_tag == Null; }
+
+    // Same types as stored by boost::any, for the code which compares typeid's
+    const std::type_info& type() const
+    {
+        switch (m_tag)
+        {
+        case Char:   return typeid(char);
+        case UInt16: return typeid(uint16_t);
+        case Int32:  return typeid(int32_t);
+        case UInt32: return typeid(uint32_t);
+        case UInt64: return typeid(unsigned long long);
+        case Int64:  return typeid(int64_t);
+        case Float:  return typeid(float);
+        case Double: return typeid(double);
+        case String: return typeid(std::string);
+        default:     return typeid(void);
+        }
+    }
+
+    // Raw accessors, values of signed tags are in i64(), unsigned -- in u64(), Float and Double -- in f64()
+    int64_t i64() const { return m_u.i; }
+    uint64_t u64() const { return m_u.u; }
+    double f64() const { return m_u.d; }
+    const std::string& str() const { return m_str; }
+    // Makes the value a String, which keeps the buffer of the string held before, and returns it
+    std::string& make_str()
+    {
+        m_tag = String;
+        m_u.u = 0;
+        return m_str;
+    }
+
+private:
+
+    Tag m_tag;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+    } m_u;
+    std::string m_str;
+};
+
+template <typename T>
+struct TaggedValueTraits;
+
+#define SLAVE_TAGGED_VALUE_TRAITS(TYPE, TAG, ACCESSOR)                          \
+    template <>                                                                 \
+    struct TaggedValueTraits<TYPE>                                              \
+    {                                                                           \
+        static const TaggedValue::Tag tag = TaggedValue::TAG;                   \
+        static TYPE get(const TaggedValue& v) { return static_cast<TYPE>(v.ACCESSOR()); } \
+    };
+
+SLAVE_TAGGED_VALUE_TRAITS(char, Char, i64)
+SLAVE_TAGGED_VALUE_TRAITS(uint16_t, UInt16, u64)
+SLAVE_TAGGED_VALUE_TRAITS(int32_t, Int32, i64)
+SLAVE_TAGGED_VALUE_TRAITS(uint32_t, UInt32, u64)
+SLAVE_TAGGED_VALUE_TRAITS(unsigned long, UInt64, u64)
+SLAVE_TAGGED_VALUE_TRAITS(unsigned long long, UInt64, u64)
+SLAVE_TAGGED_VALUE_TRAITS(long, Int64, i64)
+SLAVE_TAGGED_VALUE_TRAITS(long long, Int64, i64)
+SLAVE_TAGGED_VALUE_TRAITS(float, Float, f64)
+SLAVE_TAGGED_VALUE_TRAITS(double, Double, f64)
+SLAVE_TAGGED_VALUE_TRAITS(std::string, String, str)
+
+#undef SLAVE_TAGGED_VALUE_TRAITS
+
+template <>
+struct TaggedValueTraits<std::nullptr_t>
+{
+    static const TaggedValue::Tag tag = TaggedValue::Null;
+    static std::nullptr_t get(const TaggedValue&) { return nullptr; }
+};
+
+}// slave
+
+#endif
@@ -12,6 +12,28 @@
 volatile sig_atomic_t stop = 0;
 slave::Slave* sl = NULL;
 
+#ifdef SLAVE_USE_TAGGED_FIELD_VALUE
+std::string print(const slave::FieldValue& v) {
+
+    std::ostringstream s;
+
+    switch (v.tag()) {
+    case slave::TaggedValue::Null:   s << "NULL"; break;
+    case slave::TaggedValue::Char:   s << static_cast<char>(v.i64()); break;
+    case slave::TaggedValue::Int32:
+    case slave::TaggedValue::Int64:  s << v.i64(); break;
+    case slave::TaggedValue::UInt16:
+    case slave::TaggedValue::UInt32:
+    case slave::TaggedValue::UInt64: s << v.u64(); break;
+    case slave::TaggedValue::Float:  s << static_cast<float>(v.f64()); break;
+    case slave::TaggedValue::Double: s << v.f64(); break;
+    case slave::TaggedValue::String: s << "'" << v.str() << "'"; break;
+    default:                         s << "unknown type"; break;
+    }
+
+    return s.str();
+}
+#else
 std::string print(const slave::FieldValue& v) {
 
     if (v.type() == typeid(std::string)) {
@@ -42,6 +64,9 @@ std::string print(const slave::FieldValue& v) {
         else if (v.type() == typeid(unsigned long long))
             s << slave::get<unsigned long long>(v);
 
+        else if (v.type() == typeid(int64_t))
+            s << slave::get<int64_t>(v);
+
         else if (v.type() == typeid(float))
             s << slave::get<float>(v);
 
@@ -57,6 +82,7 @@ std::string print(const slave::FieldValue& v) {
         return s.str();
     }
 }
+#endif
 
 
 void callback(const slave::RecordSet& event) {
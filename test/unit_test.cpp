@@ -7,6 +7,8 @@ using namespace boost::unit_test;
 #include <boost/mpl/list.hpp>
 #include <boost/optional.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cfloat>
 #include <cmath>
 #include <condition_variable>
@@ -17,8 +19,29 @@ using namespace boost::unit_test;
 #include <mutex>
 #include <thread>
 
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef SLAVE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "AtomicExtState.h"
+#include "Checkpointer.h"
+#include "HistogramEventStat.h"
 #include "Slave.h"
+#include "binlog_file.h"
+#include "crc32.h"
+#include "dispatcher.h"
+#include "event_queue.h"
 #include "nanomysql.h"
+#include "packet_reader.h"
+#include "probes.h"
+#include "query_scanner.h"
+#include "schema_snapshot.h"
+#include "tagged_value.h"
 #include "types.h"
 
 namespace std
@@ -1712,6 +1735,1812 @@ namespace // anonymous
         BOOST_CHECK_EQUAL(ref2.size(), 1);
         BOOST_CHECK(ref2.front() == slave::gtid_interval_t(2, 2));
     }
+
+    void test_RowView()
+    {
+        slave::collate_info collate;
+        collate.maxlen = 1;
+
+        std::vector<std::unique_ptr<slave::Field>> fields;
+        fields.emplace_back(new slave::Field_long("id", "int(11)"));
+        fields.emplace_back(new slave::Field_varstring("name", "varchar(10)", collate));
+        fields.emplace_back(new slave::Field_blob("data", "blob"));
+        fields.emplace_back(new slave::Field_long("skipped", "int(11)"));
+
+        // int 7, varchar 'abc', blob 'xy'
+        const char buf[] = "\x07\x00\x00\x00" "\x03" "abc" "\x02\x00" "xy";
+        const char* ptr = buf;
+
+        slave::RowView view;
+        view.reset(fields);
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            const char* end = fields[i]->skip(ptr);
+            view.setValue(i, ptr, end);
+            ptr = end;
+        }
+        BOOST_CHECK_EQUAL(ptr - buf, sizeof(buf) - 1);
+
+        BOOST_CHECK_EQUAL(view.size(), 4);
+        BOOST_CHECK_EQUAL(view.index("name"), 1);
+        BOOST_CHECK_EQUAL(view.index("nothing"), -1);
+        BOOST_CHECK_EQUAL(view.length(1), 4);
+        BOOST_CHECK(view.data(0) == buf);
+        BOOST_CHECK_EQUAL(view.get<uint32_t>(0), 7);
+        BOOST_CHECK_EQUAL(view.get<std::string>(1), "abc");
+        BOOST_CHECK_EQUAL(view.get<std::string>(2), "xy");
+        BOOST_CHECK(!view.has(3));
+        BOOST_CHECK(view.data(3) == nullptr);
+        BOOST_CHECK_THROW(view.value(3), std::runtime_error);
+
+        view.setNull(3);
+        BOOST_CHECK(view.has(3));
+        BOOST_CHECK(view.isNull(3));
+        BOOST_CHECK(slave::isNullFieldValue(view.value(3)));
+    }
+
+    void test_RecordSetReuse()
+    {
+        slave::Table table("db", "tbl");
+        const std::vector<unsigned char> cols {0x3};
+        const std::vector<unsigned char> cols_minimal {0x1};
+
+        slave::RecordSet& rs = table.reuse_record_set(false, cols, cols);
+        rs.m_row["a"] = std::make_pair("int", slave::FieldValue(1));
+        rs.m_row_vec.emplace_back("int", slave::FieldValue(1));
+        rs.m_row_vec.reserve(16);
+
+        // Same column set: map and vector are kept to be overwritten in place
+        slave::RecordSet& rs2 = table.reuse_record_set(false, cols, cols);
+        BOOST_CHECK(&rs == &rs2);
+        BOOST_CHECK_EQUAL(rs2.m_row.size(), 1);
+        BOOST_CHECK_EQUAL(rs2.m_row_vec.size(), 1);
+        BOOST_CHECK_GE(rs2.m_row_vec.capacity(), 16);
+
+        // Other column set or event kind: stale columns must not survive
+        slave::RecordSet& rs3 = table.reuse_record_set(false, cols_minimal, cols_minimal);
+        BOOST_CHECK(rs3.m_row.empty());
+        BOOST_CHECK(rs3.m_row_vec.empty());
+        rs.m_old_row["a"] = std::make_pair("int", slave::FieldValue(1));
+        BOOST_CHECK(table.reuse_record_set(true, cols_minimal, cols_minimal).m_old_row.empty());
+
+        // Type and value strings of a reused row keep their buffers from row to row
+        slave::collate_info collate;
+        collate.maxlen = 1;
+        slave::Table reused("db", "tbl");
+        reused.fields.emplace_back(new slave::Field_varstring("name", "varchar(100) character set latin1", collate));
+        reused.row_type = slave::RowType::Vector;
+        reused.m_filter = slave::eAll;
+        reused.reuse_rows = true;
+
+        std::vector<const char*> types, values;
+        std::vector<std::string> names;
+        reused.m_callback = [&](slave::RecordSet& r)
+        {
+            BOOST_REQUIRE_EQUAL(r.m_row_vec.size(), 1);
+            types.push_back(r.m_row_vec[0].first.data());
+            const std::string& v = slave::get<std::string>(r.m_row_vec[0].second);
+            values.push_back(v.data());
+            names.push_back(v);
+        };
+
+        const std::string first(40, 'a'), second(30, 'b');
+        std::string ev(LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN, '\0');
+        ev += std::string("\x01\x01", 2);
+        ev += '\0' + std::string(1, static_cast<char>(first.size())) + first;
+        ev += '\0' + std::string(1, static_cast<char>(second.size())) + second;
+
+        slave::Basic_event_info bei;
+        bei.type = slave::WRITE_ROWS_EVENT;
+        bei.buf = ev.data();
+        bei.event_len = ev.size();
+        slave::EmptyExtState state;
+        slave::apply_row_event(&reused, bei, slave::Row_event_info(bei.buf, bei.event_len, false, true), state, nullptr);
+
+        BOOST_REQUIRE_EQUAL(names.size(), 2);
+        BOOST_CHECK_EQUAL(names[0], first);
+        BOOST_CHECK_EQUAL(names[1], second);
+        BOOST_CHECK(types[0] == types[1]);
+        BOOST_CHECK(values[0] == values[1]);
+    }
+
+    void test_TaggedValue()
+    {
+        const slave::TaggedValue null;
+        BOOST_CHECK(null.empty());
+        BOOST_CHECK(null.type() == typeid(void));
+
+        const slave::TaggedValue tiny(static_cast<char>(-3));
+        BOOST_CHECK_EQUAL(tiny.tag(), slave::TaggedValue::Char);
+        BOOST_CHECK_EQUAL(tiny.i64(), -3);
+
+        const slave::TaggedValue bit(static_cast<slave::types::MY_BIT>(0x1ff));
+        BOOST_CHECK_EQUAL(bit.tag(), slave::TaggedValue::UInt64);
+        BOOST_CHECK_EQUAL(slave::TaggedValueTraits<slave::types::MY_BIT>::get(bit), 0x1ff);
+        BOOST_CHECK_EQUAL(slave::TaggedValueTraits<slave::types::MY_BIGINT>::get(bit), 0x1ff);
+
+        const slave::TaggedValue time(static_cast<slave::types::MY_TIME>(-10101));
+        BOOST_CHECK(time.type() == typeid(int32_t));
+        BOOST_CHECK_EQUAL(slave::TaggedValueTraits<slave::types::MY_TIME>::get(time), -10101);
+
+        const slave::TaggedValue f(1.5f);
+        BOOST_CHECK_EQUAL(f.tag(), slave::TaggedValue::Float);
+        BOOST_CHECK_EQUAL(slave::TaggedValueTraits<float>::get(f), 1.5f);
+
+        slave::TaggedValue str(std::string("abc"));
+        BOOST_CHECK_EQUAL(str.tag(), slave::TaggedValue::String);
+        BOOST_CHECK_EQUAL(str.str(), "abc");
+        str = 5u;
+        BOOST_CHECK_EQUAL(str.tag(), slave::TaggedValue::UInt32);
+        BOOST_CHECK_EQUAL(str.u64(), 5);
+    }
+
+    void test_EventQueue()
+    {
+        slave::EventQueue queue(2);
+        const unsigned count = 1000;
+
+        std::thread producer([&queue]()
+        {
+            for (unsigned i = 1; i <= count; ++i)
+            {
+                slave::EventQueue::Slot* slot = queue.acquire();
+                if (!slot)
+                    return;
+                slot->data.assign(i % 7, 'x');
+                slot->len = i;
+                queue.push();
+            }
+        });
+
+        for (unsigned i = 1; i <= count; ++i)
+        {
+            const slave::EventQueue::Slot* slot = queue.front();
+            BOOST_REQUIRE(slot);
+            BOOST_CHECK_EQUAL(slot->len, i);
+            BOOST_CHECK_EQUAL(slot->data.size(), i % 7);
+            queue.pop();
+        }
+        producer.join();
+
+        // Producer blocked on the full queue has to be woken up by stop()
+        std::thread blocked([&queue]()
+        {
+            while (queue.acquire())
+                queue.push();
+        });
+        queue.stop();
+        blocked.join();
+        BOOST_CHECK(queue.front() == nullptr);
+
+        queue.reset();
+        BOOST_REQUIRE(queue.acquire());
+        queue.push();
+        BOOST_CHECK(queue.front() != nullptr);
+    }
+
+    void test_Dispatcher()
+    {
+        slave::Dispatcher dispatcher(3);
+        const unsigned shards = 5;
+        const unsigned count = 1000;
+
+        // Every shard is touched by one worker only, so no locking is needed
+        std::vector<std::vector<unsigned>> seen(shards);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            const unsigned shard = i % shards;
+            dispatcher.dispatch(shard, [&seen, shard, i]() { seen[shard].push_back(i); });
+        }
+        dispatcher.drain();
+
+        for (unsigned shard = 0; shard < shards; ++shard)
+        {
+            BOOST_CHECK_EQUAL(seen[shard].size(), count / shards);
+            BOOST_CHECK(std::is_sorted(seen[shard].begin(), seen[shard].end()));
+        }
+
+        dispatcher.dispatch(0, []() { throw std::runtime_error("task failed"); });
+        dispatcher.dispatch(1, []() {});
+        BOOST_CHECK_THROW(dispatcher.drain(), std::runtime_error);
+        BOOST_CHECK_NO_THROW(dispatcher.drain());
+    }
+
+    void test_BatchCallback()
+    {
+        struct CountingExtState : public slave::EmptyExtState
+        {
+            unsigned long rows = 0;
+            unsigned long calls = 0;
+            void incTableCount(const std::string& t, unsigned long count) override { rows += count; ++calls; }
+        } state;
+
+        slave::Table table("db", "tbl");
+        size_t delivered = 0;
+        table.m_batch_callback = [&delivered](std::vector<slave::RecordSet>& batch) { delivered += batch.size(); };
+
+        std::vector<slave::RecordSet> batch(3);
+        table.call_batch_callback(batch, state);
+        BOOST_CHECK_EQUAL(delivered, 3);
+        BOOST_CHECK_EQUAL(state.rows, 3);
+        BOOST_CHECK_EQUAL(state.calls, 1);
+
+        // Empty batches are not delivered
+        batch.clear();
+        table.call_batch_callback(batch, state);
+        BOOST_CHECK_EQUAL(state.calls, 1);
+    }
+
+    void test_TableIdLookup()
+    {
+        slave::RelayLogInfo rli;
+        rli.setTable("tbl", "db", slave::PtrTable(new slave::Table("db", "tbl")));
+
+        rli.setTableName(10, "tbl", "db");
+        rli.setTableName(11, "other", "db");
+
+        BOOST_CHECK(rli.getTableById(10) == rli.getTable(std::make_pair("db", "tbl")).get());
+        BOOST_CHECK(rli.getTableById(11) == nullptr);
+        BOOST_CHECK(rli.getTableById(12) == nullptr);
+
+        // Rebuilt table is bound to already known ids
+        rli.setTable("tbl", "db", slave::PtrTable(new slave::Table("db", "tbl")));
+        BOOST_CHECK(rli.getTableById(10) == rli.getTable(std::make_pair("db", "tbl")).get());
+
+        rli.setTable("other", "db", slave::PtrTable(new slave::Table("db", "other")));
+        BOOST_REQUIRE(rli.getTableById(11));
+        BOOST_CHECK_EQUAL(rli.getTableById(11)->full_name, "db.other");
+
+        rli.clear();
+        BOOST_CHECK(rli.getTableById(10) == nullptr);
+    }
+
+    void test_SkipRowEvent()
+    {
+        struct CountingEventStat : public slave::EventStatIface
+        {
+            unsigned ignored = 0;
+            unsigned filtered = 0;
+            void tickModifyEventIgnored(const unsigned long, slave::EventKind) override { ++ignored; }
+            void tickModifyEventFiltered(const unsigned long, slave::EventKind) override { ++filtered; }
+        } stat;
+
+        slave::RelayLogInfo rli;
+        slave::PtrTable table(new slave::Table("db", "tbl"));
+        table->m_filter = slave::eInsert;
+        rli.setTable("tbl", "db", std::move(table));
+        rli.setTableName(10, "tbl", "db");
+        rli.setTableName(11, "other", "db");
+
+        std::vector<char> buf(LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN + 2);
+        slave::Basic_event_info bei;
+        bei.buf = buf.data();
+        bei.event_len = buf.size();
+
+        // 6 bytes little endian
+        auto setTableId = [&buf](unsigned long id)
+        {
+            for (unsigned i = 0; i < 6; ++i)
+                buf[LOG_EVENT_HEADER_LEN + RW_MAPID_OFFSET + i] = (id >> (8 * i)) & 0xff;
+        };
+
+        setTableId(10);
+        bei.type = slave::WRITE_ROWS_EVENT;
+        BOOST_CHECK(!slave::skip_row_event(rli, bei, &stat));
+
+        bei.type = slave::DELETE_ROWS_EVENT;
+        BOOST_CHECK(slave::skip_row_event(rli, bei, &stat));
+        BOOST_CHECK_EQUAL(stat.filtered, 1);
+        BOOST_CHECK_EQUAL(stat.ignored, 1);
+
+        setTableId(11);
+        BOOST_CHECK(slave::skip_row_event(rli, bei, &stat));
+        setTableId(12);
+        BOOST_CHECK(slave::skip_row_event(rli, bei, &stat));
+        BOOST_CHECK_EQUAL(stat.filtered, 1);
+        BOOST_CHECK_EQUAL(stat.ignored, 3);
+    }
+
+    void test_ColumnFilterPlan()
+    {
+        slave::Table table("db", "tbl");
+        table.fields.emplace_back(new slave::Field_long("id", "int(11)"));
+        table.fields.emplace_back(new slave::Field_blob("data", "blob"));
+        table.fields.emplace_back(new slave::Field_long("value", "int(11)"));
+
+        table.set_column_filter({"value", "id", "nothing"});
+        BOOST_CHECK_EQUAL(table.column_filter_count, 3);
+
+        const auto& plan = table.decode_plan();
+        BOOST_REQUIRE_EQUAL(plan.size(), 3);
+        BOOST_CHECK(plan[0].wanted);
+        BOOST_CHECK_EQUAL(plan[0].output, 1);
+        BOOST_CHECK(!plan[1].wanted);
+        BOOST_CHECK(plan[2].wanted);
+        BOOST_CHECK_EQUAL(plan[2].output, 0);
+
+        table.set_column_filter({});
+        BOOST_CHECK(table.decode_plan()[1].wanted);
+        BOOST_CHECK_EQUAL(table.decode_plan()[1].output, 1);
+    }
+    void test_Crc32()
+    {
+        std::vector<unsigned char> buf(4096 + 16);
+        uint32_t seed = 12345;
+        for (auto& c : buf)
+        {
+            seed = seed * 1103515245 + 12345;
+            c = seed >> 24;
+        }
+
+        BOOST_CHECK(slave::checksum_crc32_engine() != nullptr);
+
+        for (size_t offset : {0, 1, 7, 15})
+            for (size_t len : {0, 1, 15, 16, 63, 64, 65, 100, 128, 1000, 4096})
+                BOOST_CHECK_EQUAL(slave::checksum_crc32(0, &buf[offset], len),
+                                  ::crc32(0, &buf[offset], len));
+
+        // Incremental computation gives the same result
+        const uint32_t crc = slave::checksum_crc32(0, buf.data(), 1000);
+        BOOST_CHECK_EQUAL(slave::checksum_crc32(crc, buf.data() + 1000, 3000), ::crc32(0, buf.data(), 4000));
+
+        // Event with checksum in the last 4 bytes
+        std::vector<char> event(buf.begin(), buf.begin() + 200);
+        const uint32_t sum = htole32(slave::checksum_crc32(0, (const unsigned char*)event.data(), event.size()));
+        event.insert(event.end(), (const char*)&sum, (const char*)&sum + sizeof(sum));
+        BOOST_CHECK(slave::verify_checksum(event.data(), event.size()));
+        event[10] ^= 1;
+        BOOST_CHECK(!slave::verify_checksum(event.data(), event.size()));
+        BOOST_CHECK(!slave::verify_checksum(event.data(), 3));
+
+        slave::MasterInfo info;
+        BOOST_CHECK(info.sampleChecksum());
+        BOOST_CHECK(info.sampleChecksum());
+        info.checksum_verify_interval = 3;
+        int sampled = 0;
+        for (int i = 0; i < 9; ++i)
+            sampled += info.sampleChecksum();
+        BOOST_CHECK_EQUAL(sampled, 3);
+        info.checksum_verify_interval = 0;
+        BOOST_CHECK(!info.sampleChecksum());
+    }
+    void test_CreateField()
+    {
+        slave::collate_info ci;
+        ci.maxlen = 3;
+
+        BOOST_CHECK_EQUAL(slave::field_type_name("int(10) unsigned"), "int");
+        BOOST_CHECK_EQUAL(slave::field_type_name("double"), "double");
+        BOOST_CHECK_THROW(slave::field_type_name("(1)"), std::runtime_error);
+
+        auto field = slave::create_field("id", "bigint(20)", ci, false);
+        BOOST_REQUIRE(dynamic_cast<slave::Field_longlong*>(field.get()));
+        BOOST_CHECK_EQUAL(field->field_name, "id");
+        BOOST_CHECK_EQUAL(field->field_type, "bigint(20)");
+
+        BOOST_CHECK(dynamic_cast<slave::Field_varstring*>(slave::create_field("s", "char(10)", ci, false).get()));
+        BOOST_CHECK(dynamic_cast<slave::Field_mediumblob*>(slave::create_field("b", "mediumtext", ci, false).get()));
+        BOOST_CHECK_EQUAL(slave::create_field("d", "datetime", ci, false)->pack_length(), 5);
+        BOOST_CHECK_EQUAL(slave::create_field("d", "datetime", ci, true)->pack_length(), 8);
+        BOOST_CHECK_THROW(slave::create_field("j", "json", ci, false), std::runtime_error);
+    }
+    void test_BinlogFile()
+    {
+        char path[] = "/tmp/libslave_test_binlog_XXXXXX";
+        const int fd = ::mkstemp(path);
+        BOOST_REQUIRE(fd >= 0);
+        ::close(fd);
+
+        auto event = [](unsigned char type, unsigned int len)
+        {
+            std::string ev(len, '\0');
+            ev[EVENT_TYPE_OFFSET] = type;
+            for (int i = 0; i < 4; ++i)
+                ev[EVENT_LEN_OFFSET + i] = static_cast<char>(len >> (8 * i));
+            return ev;
+        };
+
+        std::string fde = event(slave::FORMAT_DESCRIPTION_EVENT, LOG_EVENT_HEADER_LEN + START_V3_HEADER_LEN + 1);
+        ::strcpy(&fde[LOG_EVENT_HEADER_LEN + ST_SERVER_VER_OFFSET], "5.7.20-log");
+        const std::string xid = event(slave::XID_EVENT, LOG_EVENT_HEADER_LEN + 8);
+
+        {
+            std::ofstream f(path, std::ios::binary);
+            f << "\xfe" "bin" << fde << xid << xid.substr(0, 10);
+        }
+
+        {
+            slave::BinlogFile file(path);
+            BOOST_CHECK_EQUAL(file.name(), std::string(path).substr(5));
+            BOOST_CHECK_EQUAL(file.server_version(), 50720);
+            BOOST_CHECK_EQUAL(file.tell(), slave::BinlogFile::first_event_pos);
+
+            unsigned int len = 0;
+            const char* ev = file.next(len);
+            BOOST_REQUIRE(ev);
+            BOOST_CHECK_EQUAL(len, fde.size());
+            BOOST_CHECK_EQUAL(ev[EVENT_TYPE_OFFSET], slave::FORMAT_DESCRIPTION_EVENT);
+
+            const size_t xid_pos = file.tell();
+            ev = file.next(len);
+            BOOST_REQUIRE(ev);
+            BOOST_CHECK_EQUAL(len, xid.size());
+            BOOST_CHECK_EQUAL(ev[EVENT_TYPE_OFFSET], slave::XID_EVENT);
+
+            // Incomplete event at the end
+            BOOST_CHECK(file.next(len) == nullptr);
+
+            file.seek(xid_pos);
+            BOOST_CHECK(file.next(len) != nullptr);
+            BOOST_CHECK_THROW(file.seek(file.size() + 1), std::runtime_error);
+        }
+
+        {
+            std::ofstream f(path, std::ios::binary);
+            f << "garbage";
+        }
+        BOOST_CHECK_THROW(slave::BinlogFile file(path), std::runtime_error);
+
+        ::unlink(path);
+        BOOST_CHECK_THROW(slave::BinlogFile file(path), std::runtime_error);
+    }
+    void test_PacketReader()
+    {
+        int fds[2];
+        BOOST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+        auto packet = [](const std::string& payload, unsigned char seq)
+        {
+            std::string p(4, '\0');
+            p[0] = payload.size() & 0xff;
+            p[1] = (payload.size() >> 8) & 0xff;
+            p[2] = (payload.size() >> 16) & 0xff;
+            p[3] = seq;
+            return p + payload;
+        };
+
+        std::string stream;
+        for (int i = 0; i < 1000; ++i)
+            stream += packet(std::string(1, '\0') + std::to_string(i), i);
+        stream += packet("", 0);
+        // Payload of 16M - 1 continues in the next packet
+        const std::string large(0xffffff + 10, 'x');
+        stream += packet(large.substr(0, 0xffffff), 1) + packet(large.substr(0xffffff), 2);
+        stream += packet("last", 3);
+
+        std::thread writer([&]
+        {
+            for (size_t pos = 0; pos < stream.size(); )
+            {
+                const ssize_t n = ::write(fds[1], stream.data() + pos, stream.size() - pos);
+                if (n <= 0)
+                    break;
+                pos += n;
+            }
+            ::close(fds[1]);
+        });
+
+        slave::PacketReader reader(1 << 20);
+        reader.reset(fds[0], 10);
+
+        const unsigned char* data = nullptr;
+        unsigned long len = 0;
+        for (int i = 0; i < 1000; ++i)
+        {
+            BOOST_REQUIRE(reader.read(data, len));
+            BOOST_CHECK_EQUAL(std::string((const char*)data, len), std::string(1, '\0') + std::to_string(i));
+        }
+        BOOST_REQUIRE(reader.read(data, len));
+        BOOST_CHECK_EQUAL(len, 0);
+        BOOST_REQUIRE(reader.read(data, len));
+        BOOST_CHECK_EQUAL(len, large.size());
+        BOOST_CHECK(std::string((const char*)data, len) == large);
+        BOOST_REQUIRE(reader.read(data, len));
+        BOOST_CHECK_EQUAL(std::string((const char*)data, len), "last");
+
+        // Connection is closed by the other side
+        BOOST_CHECK(!reader.read(data, len));
+        BOOST_CHECK(!reader.error().empty());
+
+        writer.join();
+        ::close(fds[0]);
+
+        BOOST_CHECK_EQUAL(reader.packets(), 1003);
+        // Small packets are received in chunks
+        BOOST_CHECK_LT(reader.recvCalls(), 1000);
+    }
+    void test_TransactionPayload()
+    {
+        auto event = [](unsigned char type, unsigned int len)
+        {
+            std::string ev(len, '\0');
+            ev[EVENT_TYPE_OFFSET] = type;
+            for (int i = 0; i < 4; ++i)
+                ev[EVENT_LEN_OFFSET + i] = static_cast<char>(len >> (8 * i));
+            return ev;
+        };
+        // Field values here fit into 3 bytes
+        auto packed = [](uint64_t v)
+        {
+            std::string r;
+            if (v < 251)
+                r += static_cast<char>(v);
+            else
+            {
+                r += '\xfd';
+                for (int i = 0; i < 3; ++i)
+                    r += static_cast<char>(v >> (8 * i));
+            }
+            return r;
+        };
+        auto payload_event = [&](const std::string& data, unsigned int compression, size_t uncompressed)
+        {
+            std::string header;
+            header += packed(2) + packed(packed(compression).size()) + packed(compression);
+            header += packed(3) + packed(packed(uncompressed).size()) + packed(uncompressed);
+            header += packed(1) + packed(packed(data.size()).size()) + packed(data.size());
+            header += packed(0);
+            std::string ev = event(slave::TRANSACTION_PAYLOAD_EVENT, LOG_EVENT_HEADER_LEN);
+            return ev + header + data;
+        };
+
+        const std::string query = event(slave::QUERY_EVENT, LOG_EVENT_HEADER_LEN + 50);
+        const std::string rows = event(slave::WRITE_ROWS_EVENT, 300000);
+        const std::string xid = event(slave::XID_EVENT, LOG_EVENT_HEADER_LEN + 8);
+        const std::string inner = query + rows + xid;
+
+        auto check = [&](const std::string& ev)
+        {
+            slave::Transaction_payload_event_info tpi(ev.data(), ev.size());
+            BOOST_CHECK_EQUAL(tpi.m_uncompressed_size, inner.size());
+
+            unsigned int len = 0;
+            for (const std::string& expected : { query, rows, xid })
+            {
+                const char* buf = tpi.next(len);
+                BOOST_REQUIRE(buf);
+                BOOST_CHECK_EQUAL(len, expected.size());
+                BOOST_CHECK_EQUAL(buf[EVENT_TYPE_OFFSET], expected[EVENT_TYPE_OFFSET]);
+            }
+            BOOST_CHECK(tpi.next(len) == nullptr);
+        };
+
+        check(payload_event(inner, slave::Transaction_payload_event_info::COMPRESSION_NONE, inner.size()));
+
+        // Payload size does not match the event
+        std::string ev = payload_event(inner, slave::Transaction_payload_event_info::COMPRESSION_NONE, inner.size());
+        BOOST_CHECK_THROW(slave::Transaction_payload_event_info(ev.data(), ev.size() - 1), std::runtime_error);
+
+        // Truncated inner event
+        ev = payload_event(inner.substr(0, inner.size() - 1), slave::Transaction_payload_event_info::COMPRESSION_NONE, inner.size());
+        {
+            slave::Transaction_payload_event_info tpi(ev.data(), ev.size());
+            unsigned int len = 0;
+            BOOST_CHECK(tpi.next(len));
+            BOOST_CHECK(tpi.next(len));
+            BOOST_CHECK_THROW(tpi.next(len), std::runtime_error);
+        }
+
+#ifdef SLAVE_WITH_ZSTD
+        std::string compressed(ZSTD_compressBound(inner.size()), '\0');
+        const size_t n = ZSTD_compress(&compressed[0], compressed.size(), inner.data(), inner.size(), 1);
+        BOOST_REQUIRE(!ZSTD_isError(n));
+        compressed.resize(n);
+
+        check(payload_event(compressed, slave::Transaction_payload_event_info::COMPRESSION_ZSTD, inner.size()));
+
+        ev = payload_event(compressed.substr(0, n / 2), slave::Transaction_payload_event_info::COMPRESSION_ZSTD, inner.size());
+        {
+            slave::Transaction_payload_event_info tpi(ev.data(), ev.size());
+            unsigned int len = 0;
+            BOOST_CHECK_THROW(while (tpi.next(len)) {}, std::runtime_error);
+        }
+#else
+        ev = payload_event(inner, slave::Transaction_payload_event_info::COMPRESSION_ZSTD, inner.size());
+        BOOST_CHECK_THROW(slave::Transaction_payload_event_info(ev.data(), ev.size()), std::runtime_error);
+#endif
+    }
+    void test_AtomicExtState()
+    {
+        slave::AtomicExtState state;
+        state.initTableCount("test.a");
+        state.initTableCount("test.b");
+        state.initTableCount("test.a");
+
+        const size_t a = state.tableCountIndex("test.a");
+        const size_t b = state.tableCountIndex("test.b");
+        BOOST_CHECK_NE(a, b);
+        BOOST_CHECK_NE(a, slave::ExtStateIface::no_table_index);
+        BOOST_CHECK_EQUAL(state.tableCountIndex("test.c"), slave::ExtStateIface::no_table_index);
+
+        // Rows are counted through the index the table got at creation
+        slave::Table table("test", "a");
+        table.count_index = a;
+        table.m_callback = [](slave::RecordSet&) {};
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+            threads.emplace_back([&]()
+            {
+                slave::RecordSet rs;
+                for (int j = 0; j < 1000; ++j)
+                {
+                    table.call_callback(rs, state);
+                    state.incTableCountAt(b, 2);
+                    state.setLastEventTimePos(j, j);
+                }
+            });
+        for (auto& t : threads)
+            t.join();
+
+        state.incTableCount("test.b");
+        state.incTableCount("test.c", 5);
+
+        BOOST_CHECK_EQUAL(state.getTableCount("test.a"), 4000);
+        BOOST_CHECK_EQUAL(state.getTableCount("test.b"), 8001);
+        BOOST_CHECK_EQUAL(state.getTableCount("test.c"), 0);
+        BOOST_CHECK_EQUAL(state.getTableCounts().size(), 2);
+        BOOST_CHECK(state.getLastFilteredUpdateTime() != 0);
+        BOOST_CHECK_EQUAL(state.getState().last_event_time, 999);
+
+        slave::Position pos;
+        BOOST_CHECK(!state.getMasterPosition(pos));
+
+        pos.log_name = "mysql-bin.000001";
+        pos.log_pos = 4;
+        state.setMasterPosition(pos);
+        state.setLastEventTimePos(1, 120);
+        state.setConnecting();
+
+        slave::Position current;
+        BOOST_CHECK(state.getMasterPosition(current));
+        BOOST_CHECK_EQUAL(current.log_name, pos.log_name);
+        BOOST_CHECK_EQUAL(current.log_pos, 120);
+
+        const slave::State st = state.getState();
+        BOOST_CHECK_EQUAL(st.position.log_pos, 4);
+        BOOST_CHECK_EQUAL(st.intransaction_pos, 120);
+        BOOST_CHECK_EQUAL(st.connect_count, 1);
+    }
+    void test_LatencyHistogram()
+    {
+        for (uint64_t v : { 0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, ~0ull })
+        {
+            const size_t i = slave::LatencyHistogram::index(v);
+            BOOST_REQUIRE_LT(i, slave::LatencyHistogram::buckets);
+            BOOST_CHECK_GE(slave::LatencyHistogram::upper_bound(i), v);
+            // 1/8 relative precision
+            BOOST_CHECK_LE(slave::LatencyHistogram::upper_bound(i) - v, v / 8);
+            if (i > 0)
+                BOOST_CHECK_LT(slave::LatencyHistogram::upper_bound(i - 1), v);
+        }
+
+        slave::LatencyHistogram h;
+        BOOST_CHECK_EQUAL(h.percentile(99), 0);
+        for (uint64_t v = 1; v <= 1000; ++v)
+            h.add(v * 1000);
+        BOOST_CHECK_EQUAL(h.count(), 1000);
+        BOOST_CHECK_EQUAL(h.maximum(), 1000000);
+        BOOST_CHECK_CLOSE(h.mean(), 500500.0, 0.001);
+        BOOST_CHECK_GE(h.percentile(50), 500000);
+        BOOST_CHECK_LE(h.percentile(50), 500000 + 500000 / 8);
+        BOOST_CHECK_GE(h.percentile(99), 990000);
+        BOOST_CHECK_EQUAL(h.percentile(100), 1000000);
+        h.reset();
+        BOOST_CHECK_EQUAL(h.count(), 0);
+
+        slave::HistogramEventStat stat(4);
+        int sampled = 0;
+        for (int i = 0; i < 100; ++i)
+            sampled += stat.sampleTiming(slave::tsRow);
+        BOOST_CHECK_EQUAL(sampled, 25);
+
+        // Sites are counted apart, so interleaved ones do not alias with the interval
+        int waits = 0, checksums = 0;
+        for (int i = 0; i < 100; ++i)
+        {
+            waits += stat.sampleTiming(slave::tsNetworkWait);
+            checksums += stat.sampleTiming(slave::tsChecksum);
+            checksums += stat.sampleTiming(slave::tsChecksum);
+        }
+        BOOST_CHECK_EQUAL(waits, 25);
+        BOOST_CHECK_EQUAL(checksums, 50);
+
+        stat.processTableMap(10, "a", "test");
+        stat.tickModifyRowDone(10, slave::eInsert, 0);
+        stat.tickModifyRowDone(10, slave::eInsert, 5000);
+        stat.tickModifyRowDecoded(10, slave::eInsert, 1000);
+        stat.tickModifyEventLag(10, slave::eInsert, 2);
+        // Table map was not seen
+        stat.tickModifyRowDone(11, slave::eInsert, 5000);
+        stat.tickNetworkWait(100);
+        stat.tickChecksum(10);
+
+        const auto tables = stat.tables();
+        BOOST_REQUIRE_EQUAL(tables.size(), 1);
+        BOOST_CHECK_EQUAL(tables[0].first, "test.a");
+        BOOST_CHECK_EQUAL(tables[0].second->callback.count(), 1);
+        BOOST_CHECK_EQUAL(tables[0].second->decode.maximum(), 1000);
+        BOOST_CHECK_EQUAL(tables[0].second->lag.maximum(), 2);
+        BOOST_CHECK_EQUAL(stat.networkWait().count(), 1);
+        BOOST_CHECK(stat.report().find("test.a callback_ns count=1 ") != std::string::npos);
+
+        // Id is reused by another table after a restart of the master
+        stat.processTableMap(10, "b", "test");
+        stat.tickModifyRowDone(10, slave::eInsert, 3000);
+        const auto reused = stat.tables();
+        BOOST_REQUIRE_EQUAL(reused.size(), 2);
+        BOOST_CHECK_EQUAL(reused[0].second->callback.count(), 1);
+        BOOST_CHECK_EQUAL(reused[1].first, "test.b");
+        BOOST_CHECK_EQUAL(reused[1].second->callback.count(), 1);
+    }
+    void test_TableMapSchema()
+    {
+        auto packed_str = [](const std::string& v) { return std::string(1, static_cast<char>(v.size())) + v; };
+        struct Column { unsigned char type; std::string meta; std::string name; };
+
+        auto table_map = [&](const std::vector<Column>& cols, const std::string& optional)
+        {
+            std::string ev(LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN, '\0');
+            ev[LOG_EVENT_HEADER_LEN] = 7;
+            ev += packed_str("test") + '\0' + packed_str("t") + '\0';
+            ev += static_cast<char>(cols.size());
+            std::string meta;
+            for (const auto& c : cols)
+            {
+                ev += static_cast<char>(c.type);
+                meta += c.meta;
+            }
+            ev += packed_str(meta);
+            ev += std::string((cols.size() + 7) / 8, '\0');
+            return ev + optional;
+        };
+        auto names = [&](const std::vector<Column>& cols)
+        {
+            std::string v;
+            for (const auto& c : cols)
+                v += packed_str(c.name);
+            return std::string(1, '\x04') + packed_str(v);
+        };
+
+        const std::vector<Column> cols = {
+            { MYSQL_TYPE_LONG, "", "id" },
+            { MYSQL_TYPE_VARCHAR, std::string("\x78\x00", 2), "name" },
+            { slave::MYSQL_TYPE_DATETIME2, "\x03", "ts" },
+            { MYSQL_TYPE_NEWDECIMAL, "\x0a\x02", "price" },
+            { MYSQL_TYPE_STRING, "\xf7\x01", "e" },
+            { MYSQL_TYPE_STRING, "\xf8\x01", "s" },
+            { MYSQL_TYPE_STRING, "\xee\x2c", "c" },
+            { MYSQL_TYPE_BLOB, "\x02", "b" },
+            { MYSQL_TYPE_BIT, "\x02\x01", "f" },
+            { MYSQL_TYPE_TINY, "", "t" },
+        };
+        const std::string optional = std::string("\x01\x01\x80", 3) + names(cols)
+            + "\x06" + packed_str("\x02" + packed_str("a") + packed_str("b"))
+            + "\x05" + packed_str("\x03" + packed_str("x") + packed_str("y") + packed_str("z"));
+
+        const std::string ev = table_map(cols, optional);
+        slave::Table_map_event_info tmi(ev.data(), ev.size());
+        BOOST_CHECK_EQUAL(tmi.m_tblnam, "t");
+        BOOST_CHECK_EQUAL(tmi.m_table_id, 7);
+
+        slave::Table_map_metadata md;
+        tmi.parse_metadata(md);
+        BOOST_REQUIRE_EQUAL(md.m_cols_names.size(), cols.size());
+
+        const std::vector<std::string> types = {
+            "int unsigned", "varchar(120)", "datetime(3)", "decimal(10,2)", "enum('a','b')",
+            "set('x','y','z')", "char(300)", "blob", "bit(10)", "tinyint"
+        };
+        for (size_t i = 0; i < cols.size(); ++i)
+            BOOST_CHECK_EQUAL(tmi.column_type(md, i), types[i]);
+
+        std::vector<slave::PtrField> fields;
+        BOOST_REQUIRE(slave::create_fields(tmi, fields));
+        BOOST_REQUIRE_EQUAL(fields.size(), cols.size());
+        BOOST_CHECK_EQUAL(fields[1]->field_name, "name");
+        BOOST_CHECK_EQUAL(fields[3]->field_type, "decimal(10,2)");
+        BOOST_CHECK(dynamic_cast<slave::Field_datetime*>(fields[2].get()));
+        BOOST_CHECK_EQUAL(fields[2]->pack_length(), 7);
+        BOOST_CHECK_EQUAL(fields[8]->pack_length(), 2);
+
+        // A varchar of 300 bytes has 2 bytes of length
+        const char value[] = { 3, 0, 'a', 'b', 'c' };
+        BOOST_CHECK(fields[6]->unpack(value) == value + 5);
+
+        // No column names without binlog_row_metadata=FULL
+        const std::string minimal = table_map(cols, std::string("\x01\x01\x80", 3));
+        slave::Table_map_event_info tmi_minimal(minimal.data(), minimal.size());
+        BOOST_CHECK(!slave::create_fields(tmi_minimal, fields));
+        BOOST_CHECK_EQUAL(fields.size(), cols.size());
+
+        const std::vector<Column> json = { { MYSQL_TYPE_LONG, "", "id" }, { 245, "\x04", "j" } };
+        const std::string json_ev = table_map(json, names(json));
+        slave::Table_map_event_info tmi_json(json_ev.data(), json_ev.size());
+        BOOST_CHECK(!slave::create_fields(tmi_json, fields));
+
+        // Metadata is longer than the event
+        std::string broken = table_map(cols, "");
+        broken.resize(broken.size() - 4);
+        slave::Table_map_event_info tmi_broken(broken.data(), broken.size());
+        BOOST_CHECK_THROW(tmi_broken.parse_metadata(md), std::runtime_error);
+    }
+    void test_DdlScanner()
+    {
+        // Kind and "db.table" names of the statement
+        auto scan = [](const std::string& query)
+        {
+            slave::DdlScanner ddl(query);
+            std::string result = std::to_string(ddl.kind()) + (ddl.temporary() ? " TEMPORARY" : "");
+            slave::DdlTable t;
+            while (ddl.next(t))
+                result += " " + t.db.str() + "." + t.table.str();
+            return result;
+        };
+        auto expect = [](slave::DdlScanner::Kind kind, const std::string& tables)
+        {
+            return std::to_string(kind) + tables;
+        };
+
+        BOOST_CHECK_EQUAL(scan("BEGIN"), expect(slave::DdlScanner::NOT_DDL, ""));
+        BOOST_CHECK_EQUAL(scan("insert into t select * from test.a"), expect(slave::DdlScanner::NOT_DDL, ""));
+        BOOST_CHECK_EQUAL(scan("ALTERATION TABLE t"), expect(slave::DdlScanner::NOT_DDL, ""));
+        BOOST_CHECK_EQUAL(scan("create view v as select 1"), expect(slave::DdlScanner::NOT_DDL, ""));
+        BOOST_CHECK_EQUAL(scan(""), expect(slave::DdlScanner::NOT_DDL, ""));
+
+        BOOST_CHECK_EQUAL(scan("ALTER TABLE test ADD COLUMN x INT"), expect(slave::DdlScanner::ALTER_TABLE, " .test"));
+        BOOST_CHECK_EQUAL(scan("  alter\n\tignore table `db`.`my``table` engine=InnoDB"),
+                          expect(slave::DdlScanner::ALTER_TABLE, " db.my`table"));
+        BOOST_CHECK_EQUAL(scan("/* comment */ ALTER /*!50100 ONLINE */ TABLE db . t add x int"),
+                          expect(slave::DdlScanner::ALTER_TABLE, " db.t"));
+        BOOST_CHECK_EQUAL(scan("-- comment\n# another\nALTER TABLE t1,add y int"), expect(slave::DdlScanner::ALTER_TABLE, " .t1"));
+        BOOST_CHECK_EQUAL(scan("create table if not exists test.t(id int)"), expect(slave::DdlScanner::CREATE_TABLE, " test.t"));
+        BOOST_CHECK_EQUAL(scan("CREATE OR REPLACE TEMPORARY TABLE t LIKE a"), expect(slave::DdlScanner::CREATE_TABLE, " TEMPORARY .t"));
+        BOOST_CHECK_EQUAL(scan("DROP /*!40005 TEMPORARY */ TABLE IF EXISTS `t`"), expect(slave::DdlScanner::DROP_TABLE, " TEMPORARY .t"));
+        BOOST_CHECK_EQUAL(scan("CREATE TABLE if exists t"), expect(slave::DdlScanner::NOT_DDL, ""));
+        BOOST_CHECK_EQUAL(scan("DROP TABLE IF EXISTS a, db.b ,`c` /* generated by server */"),
+                          expect(slave::DdlScanner::DROP_TABLE, " .a db.b .c"));
+        BOOST_CHECK_EQUAL(scan("RENAME TABLE a TO b, db.c TO db.a"), expect(slave::DdlScanner::RENAME_TABLE, " .a .b db.c db.a"));
+        BOOST_CHECK_EQUAL(scan("truncate t"), expect(slave::DdlScanner::TRUNCATE_TABLE, " .t"));
+        BOOST_CHECK_EQUAL(scan("TRUNCATE TABLE db.t"), expect(slave::DdlScanner::TRUNCATE_TABLE, " db.t"));
+
+        // Broken names stop the scan
+        BOOST_CHECK_EQUAL(scan("ALTER TABLE `unterminated"), expect(slave::DdlScanner::ALTER_TABLE, ""));
+        BOOST_CHECK_EQUAL(scan("ALTER TABLE ``"), expect(slave::DdlScanner::ALTER_TABLE, ""));
+        BOOST_CHECK_EQUAL(scan("DROP TABLE a b"), expect(slave::DdlScanner::DROP_TABLE, " .a"));
+        BOOST_CHECK_EQUAL(scan("ALTER TABLE /* unterminated"), expect(slave::DdlScanner::ALTER_TABLE, ""));
+
+        // Huge statements are scanned in linear time
+        std::string huge = "INSERT INTO t VALUES ";
+        for (int i = 0; i < 100000; ++i)
+            huge += "(1, 'abc'),";
+        BOOST_CHECK_EQUAL(scan(huge), expect(slave::DdlScanner::NOT_DDL, ""));
+        BOOST_CHECK_EQUAL(scan("ALTER TABLE t COMMENT '" + std::string(1000000, 'x') + "'"), expect(slave::DdlScanner::ALTER_TABLE, " .t"));
+    }
+    void test_QueryEvent()
+    {
+        auto query_event = [](const std::string& db, const std::string& status_vars, const std::string& query)
+        {
+            std::string ev(LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN, '\0');
+            ev[LOG_EVENT_HEADER_LEN + Q_DB_LEN_OFFSET] = static_cast<char>(db.size());
+            ev[LOG_EVENT_HEADER_LEN + Q_STATUS_VARS_LEN_OFFSET] = static_cast<char>(status_vars.size());
+            return ev + status_vars + db + '\0' + query;
+        };
+
+        const std::string ev = query_event("test", std::string(7, '\x01'), "ALTER TABLE t ADD x INT");
+        const slave::Query_event_view view(ev.data(), ev.size());
+        BOOST_CHECK_EQUAL(std::string(view.db_name, view.db_len), "test");
+        BOOST_CHECK_EQUAL(std::string(view.query, view.query_len), "ALTER TABLE t ADD x INT");
+        BOOST_CHECK(view.query + view.query_len == ev.data() + ev.size());
+
+        const slave::Query_event_info info(ev.data(), ev.size());
+        BOOST_CHECK_EQUAL(info.db_name, "test");
+        BOOST_CHECK_EQUAL(info.query, "ALTER TABLE t ADD x INT");
+
+        // Database name longer than the event
+        std::string broken = query_event(std::string(200, 'd'), "", "");
+        broken.resize(broken.size() - 10);
+        BOOST_CHECK_THROW(slave::Query_event_view(broken.data(), broken.size()), std::runtime_error);
+        BOOST_CHECK_THROW(slave::Query_event_view(ev.data(), LOG_EVENT_HEADER_LEN + 2), std::runtime_error);
+
+        const std::vector<std::pair<std::string, slave::QueryKind>> kinds = {
+            { "BEGIN", slave::QUERY_BEGIN },
+            { "begin work", slave::QUERY_BEGIN },
+            { "START TRANSACTION", slave::QUERY_BEGIN },
+            { "XA START 'trx'", slave::QUERY_BEGIN },
+            { "COMMIT", slave::QUERY_COMMIT },
+            { "ROLLBACK", slave::QUERY_ROLLBACK },
+            { "ROLLBACK WORK TO SAVEPOINT sp", slave::QUERY_OTHER },
+            { "XA END 'trx'", slave::QUERY_XA },
+            { "XA COMMIT 'trx'", slave::QUERY_XA },
+            { "/* app */ DROP TABLE t", slave::QUERY_DDL },
+            { "INSERT INTO t VALUES (1)", slave::QUERY_OTHER },
+            { "SAVEPOINT sp", slave::QUERY_OTHER },
+            { "BEGINNING", slave::QUERY_OTHER },
+            { "", slave::QUERY_OTHER },
+        };
+        for (const auto& x : kinds)
+        {
+            const std::string ev = query_event("db", "", x.first);
+            const slave::Query_event_view view(ev.data(), ev.size());
+            BOOST_CHECK_MESSAGE(slave::DdlScanner(view.query, view.query_len).queryKind() == x.second, x.first);
+        }
+    }
+    void test_DispatcherGroups()
+    {
+        slave::Dispatcher dispatcher(2);
+        slave::Dispatcher::Group a, b;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool release = false;
+
+        // Slow task of one group does not hold drain of the other, which runs on another worker
+        std::atomic<int> done_a{0}, done_b{0};
+        dispatcher.dispatch(a, 0, [&]
+        {
+            std::unique_lock<std::mutex> l(mutex);
+            cond.wait(l, [&] { return release; });
+            ++done_a;
+        });
+        for (int i = 0; i < 100; ++i)
+            dispatcher.dispatch(b, 2 * i + 1, [&] { ++done_b; });
+        dispatcher.drain(b);
+        BOOST_CHECK_EQUAL(done_b, 100);
+
+        {
+            std::lock_guard<std::mutex> l(mutex);
+            release = true;
+        }
+        cond.notify_all();
+        dispatcher.drain(a);
+        BOOST_CHECK_EQUAL(done_a, 1);
+
+        // Errors are reported to the group of the failed task only
+        dispatcher.dispatch(a, 0, [] { throw std::runtime_error("task failed"); });
+        dispatcher.dispatch(b, 1, [] {});
+        BOOST_CHECK_NO_THROW(dispatcher.drain(b));
+        BOOST_CHECK_THROW(dispatcher.drain(a), std::runtime_error);
+        BOOST_CHECK_NO_THROW(dispatcher.drain(a));
+        BOOST_CHECK_NO_THROW(dispatcher.drain());
+    }
+    void test_PacketReaderNonBlocking()
+    {
+        int fds[2];
+        BOOST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+        auto packet = [](const std::string& payload, unsigned char seq)
+        {
+            std::string p(4, '\0');
+            p[0] = payload.size() & 0xff;
+            p[1] = (payload.size() >> 8) & 0xff;
+            p[2] = (payload.size() >> 16) & 0xff;
+            p[3] = seq;
+            return p + payload;
+        };
+        auto write_all = [&fds](const std::string& data)
+        {
+            for (size_t pos = 0; pos < data.size(); )
+            {
+                const ssize_t n = ::write(fds[1], data.data() + pos, data.size() - pos);
+                if (n <= 0)
+                    break;
+                pos += n;
+            }
+        };
+
+        slave::PacketReader reader(64);
+        reader.reset(fds[0], 1, true);
+
+        const unsigned char* data = nullptr;
+        unsigned long len = 0;
+        BOOST_CHECK(!reader.read(data, len));
+        BOOST_CHECK(reader.wouldBlock());
+
+        // Packet is returned only when it is complete
+        const std::string first = packet("first", 0);
+        write_all(first.substr(0, 2));
+        BOOST_CHECK(!reader.read(data, len));
+        BOOST_CHECK(reader.wouldBlock());
+        write_all(first.substr(2, 5));
+        BOOST_CHECK(!reader.read(data, len));
+        BOOST_CHECK(reader.wouldBlock());
+        write_all(first.substr(7) + packet("second", 1));
+        BOOST_REQUIRE(reader.read(data, len));
+        BOOST_CHECK(!reader.wouldBlock());
+        BOOST_CHECK_EQUAL(std::string((const char*)data, len), "first");
+        BOOST_REQUIRE(reader.read(data, len));
+        BOOST_CHECK_EQUAL(std::string((const char*)data, len), "second");
+        BOOST_CHECK(!reader.read(data, len));
+        BOOST_CHECK(reader.wouldBlock());
+
+        // Parts of a large packet are kept between reads
+        const std::string large(0xffffff + 10, 'x');
+        std::thread writer([&]
+        {
+            write_all(packet(large.substr(0, 0xffffff), 2));
+            write_all(packet(large.substr(0xffffff), 3) + packet("last", 4));
+            ::close(fds[1]);
+        });
+
+        size_t would_block = 0;
+        std::vector<std::string> received;
+        while (true)
+        {
+            if (reader.read(data, len))
+            {
+                received.emplace_back((const char*)data, len);
+                continue;
+            }
+            if (!reader.wouldBlock())
+                break;
+            ++would_block;
+            pollfd pfd = { fds[0], POLLIN, 0 };
+            ::poll(&pfd, 1, 1000);
+        }
+        writer.join();
+        ::close(fds[0]);
+
+        BOOST_CHECK_GT(would_block, 0);
+        BOOST_CHECK(!reader.error().empty());
+        BOOST_REQUIRE_EQUAL(received.size(), 2);
+        BOOST_CHECK(received[0] == large);
+        BOOST_CHECK_EQUAL(received[1], "last");
+    }
+    void test_SchemaSnapshot()
+    {
+        const std::string path = "schema_snapshot.test";
+        ::unlink(path.c_str());
+
+        slave::SchemaSnapshot snapshot;
+        BOOST_CHECK(!snapshot.load(path));
+
+        snapshot.position = slave::Position("mysql-bin.000012", 4567);
+        slave::ColumnInfo id;
+        id.name = "id";
+        id.type = "int(10) unsigned";
+        slave::ColumnInfo name;
+        name.name = "odd\tname\\with\nescapes";
+        name.type = "varchar(30)";
+        name.collate.name = "utf8mb4_general_ci";
+        name.collate.charset = "utf8mb4";
+        name.collate.maxlen = 4;
+        snapshot.tables[std::make_pair("db", "t1")] = { id, name };
+        snapshot.tables[std::make_pair("db", "empty")] = {};
+        snapshot.save(path);
+
+        slave::SchemaSnapshot loaded;
+        BOOST_REQUIRE(loaded.load(path));
+        BOOST_CHECK_EQUAL(loaded.position.log_name, "mysql-bin.000012");
+        BOOST_CHECK_EQUAL(loaded.position.log_pos, 4567);
+        BOOST_REQUIRE_EQUAL(loaded.tables.size(), 2);
+        const auto& columns = loaded.tables[std::make_pair("db", "t1")];
+        BOOST_REQUIRE_EQUAL(columns.size(), 2);
+        BOOST_CHECK_EQUAL(columns[0].name, "id");
+        BOOST_CHECK_EQUAL(columns[0].type, "int(10) unsigned");
+        BOOST_CHECK(columns[0].collate.name.empty());
+        BOOST_CHECK_EQUAL(columns[1].name, name.name);
+        BOOST_CHECK_EQUAL(columns[1].collate.name, "utf8mb4_general_ci");
+        BOOST_CHECK_EQUAL(columns[1].collate.charset, "utf8mb4");
+        BOOST_CHECK_EQUAL(columns[1].collate.maxlen, 4);
+        BOOST_CHECK(loaded.tables[std::make_pair("db", "empty")].empty());
+
+        // Truncated file is not a snapshot
+        std::string content;
+        {
+            std::ifstream in(path.c_str());
+            content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        {
+            std::ofstream out(path.c_str(), std::ios::trunc);
+            out << content.substr(0, content.size() - 4);
+        }
+        BOOST_CHECK(!loaded.load(path));
+        BOOST_CHECK_EQUAL(loaded.position.log_pos, 4567);
+        ::unlink(path.c_str());
+
+        using slave::Position;
+        using slave::SchemaSnapshot;
+        BOOST_CHECK(SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position("mysql-bin.000012", 4567)));
+        BOOST_CHECK(SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position("mysql-bin.000012", 9000)));
+        BOOST_CHECK(SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position("mysql-bin.000100", 4)));
+        BOOST_CHECK(!SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position("mysql-bin.000012", 120)));
+        BOOST_CHECK(!SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position("mysql-bin.000011", 9000)));
+        BOOST_CHECK(!SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position("relay-bin.000013", 4)));
+        BOOST_CHECK(!SchemaSnapshot::usableFrom(Position("mysql-bin.000012", 4567), Position()));
+    }
+    void test_GtidSet()
+    {
+        const std::string uuidText = "24f7c945-c871-11e6-9461-0242ac110006";
+        const slave::ServerUuid uuid(uuidText);
+        BOOST_CHECK_EQUAL(uuid.str(), "24f7c945c87111e694610242ac110006");
+        BOOST_CHECK(uuid == slave::ServerUuid("24F7C945C87111E694610242AC110006"));
+        BOOST_CHECK(!uuid.empty());
+        BOOST_CHECK(slave::ServerUuid().empty());
+        BOOST_CHECK_THROW(slave::ServerUuid("24f7c945"), std::runtime_error);
+
+        slave::Position pos;
+        for (int64_t i = 1; i <= 1000; ++i)
+            pos.addGtid(slave::gtid_t(uuid, i));
+        const auto& ref = pos.gtid_executed[uuid];
+        BOOST_CHECK_EQUAL(ref.size(), 1);
+        BOOST_CHECK(ref.front() == slave::gtid_interval_t(1, 1000));
+
+        // Holes are filled in any order, duplicates change nothing
+        for (const int64_t gno : {1010, 1005, 1003, 1007, 1005, 500})
+            pos.addGtid(slave::gtid_t(uuid, gno));
+        BOOST_CHECK_EQUAL(ref.size(), 5);
+        BOOST_CHECK(ref[1] == slave::gtid_interval_t(1003, 1003));
+        for (const int64_t gno : {1004, 1002, 1001, 1006, 1008, 1009})
+            pos.addGtid(slave::gtid_t(uuid, gno));
+        BOOST_CHECK_EQUAL(ref.size(), 1);
+        BOOST_CHECK(ref.front() == slave::gtid_interval_t(1, 1010));
+
+        pos.addGtid(slave::gtid_t(uuid, 2000));
+        slave::Position other;
+        other.parseGtid(uuidText + ":1-1010:2000");
+        BOOST_CHECK(pos.reachedOtherPos(other));
+        other.addGtid(slave::gtid_t(uuid, 2001));
+        BOOST_CHECK(!pos.reachedOtherPos(other));
+        pos.addGtid(slave::gtid_t("ae00751a-cb5f-11e6-9d92-e03f490fd3db", 1));
+        pos.addGtid(slave::gtid_t(uuid, 2001));
+        BOOST_CHECK(!pos.reachedOtherPos(other));
+        other.addGtid(slave::gtid_t("ae00751acb5f11e69d92e03f490fd3db", 1));
+        BOOST_CHECK(pos.reachedOtherPos(other));
+
+        slave::Position single;
+        single.parseGtid(uuidText + ":1-5:7");
+        std::vector<unsigned char> buf(single.encodedGtidSize());
+        BOOST_CHECK_EQUAL(buf.size(), 8 + 16 + 8 + 2 * 16);
+        single.encodeGtid(buf.data());
+        BOOST_CHECK_EQUAL(buf[0], 1);
+        BOOST_CHECK(::memcmp(&buf[8], uuid.bytes.data(), 16) == 0);
+        BOOST_CHECK_EQUAL(buf[24], 2);
+        // Interval ends are exclusive in the encoded form
+        BOOST_CHECK_EQUAL(buf[32], 1);
+        BOOST_CHECK_EQUAL(buf[40], 6);
+        BOOST_CHECK_EQUAL(buf[48], 7);
+        BOOST_CHECK_EQUAL(buf[56], 8);
+        BOOST_CHECK_EQUAL(single.str(), "'GTIDs=24f7c945c87111e694610242ac110006:1-5:7'");
+    }
+
+    void test_Checkpointer()
+    {
+        const std::string path = "position.test";
+        ::unlink(path.c_str());
+
+        slave::Position pos("mysql-bin.000003", 1234);
+        pos.parseGtid("24f7c945-c871-11e6-9461-0242ac110006:1-5:7");
+
+        slave::FileCheckpointSink file(path);
+        slave::Position loaded;
+        BOOST_CHECK(!file.load(loaded));
+        file.save(pos);
+        BOOST_REQUIRE(file.load(loaded));
+        BOOST_CHECK_EQUAL(loaded.log_name, pos.log_name);
+        BOOST_CHECK_EQUAL(loaded.log_pos, pos.log_pos);
+        BOOST_CHECK(loaded.gtid_executed == pos.gtid_executed);
+        BOOST_CHECK_EQUAL(::access((path + ".tmp").c_str(), F_OK), -1);
+        ::unlink(path.c_str());
+
+        struct MemorySink : public slave::CheckpointSink
+        {
+            std::mutex mutex;
+            slave::Position saved;
+            unsigned saves = 0;
+            bool fail = false;
+
+            void save(const slave::Position& p) override
+            {
+                std::lock_guard<std::mutex> l(mutex);
+                if (fail)
+                    throw std::runtime_error("sink failure");
+                saved = p;
+                ++saves;
+            }
+            bool load(slave::Position& p) override
+            {
+                std::lock_guard<std::mutex> l(mutex);
+                p = saved;
+                return saves != 0;
+            }
+        };
+
+        // Saves only by flush: positions are coalesced
+        {
+            MemorySink* sink = new MemorySink;
+            slave::Checkpointer checkpointer(std::unique_ptr<slave::CheckpointSink>(sink), 3600 * 1000);
+            for (unsigned long i = 1; i <= 1000; ++i)
+                checkpointer.submit(slave::Position("mysql-bin.000001", i));
+            checkpointer.flush();
+            BOOST_CHECK_EQUAL(checkpointer.saveCount(), 1);
+            BOOST_CHECK_EQUAL(sink->saved.log_pos, 1000);
+            // Nothing new to save
+            checkpointer.flush();
+            BOOST_CHECK_EQUAL(checkpointer.saveCount(), 1);
+
+            slave::CheckpointExtState state(checkpointer);
+            state.setMasterPosition(slave::Position("mysql-bin.000002", 4));
+            state.saveMasterPosition();
+            slave::Position p;
+            BOOST_CHECK(state.loadMasterPosition(p));
+            BOOST_CHECK_EQUAL(p.log_name, "mysql-bin.000002");
+        }
+
+        // Saves every 10 positions, the destructor saves the rest
+        {
+            slave::Checkpointer checkpointer(std::unique_ptr<slave::CheckpointSink>(new slave::FileCheckpointSink(path)), 3600 * 1000, 10);
+            for (unsigned long i = 1; i <= 10; ++i)
+                checkpointer.submit(slave::Position("mysql-bin.000001", i));
+            for (int i = 0; i < 500 && checkpointer.saveCount() == 0; ++i)
+                ::usleep(10 * 1000);
+            BOOST_CHECK_EQUAL(checkpointer.saveCount(), 1);
+            checkpointer.submit(slave::Position("mysql-bin.000001", 11));
+        }
+        BOOST_REQUIRE(slave::FileCheckpointSink(path).load(loaded));
+        BOOST_CHECK_EQUAL(loaded.log_pos, 11);
+        ::unlink(path.c_str());
+
+        // Failed saves are retried
+        {
+            MemorySink* sink = new MemorySink;
+            sink->fail = true;
+            slave::Checkpointer checkpointer(std::unique_ptr<slave::CheckpointSink>(sink), 10);
+            checkpointer.submit(slave::Position("mysql-bin.000001", 5));
+            ::usleep(50 * 1000);
+            BOOST_CHECK_EQUAL(checkpointer.saveCount(), 0);
+            {
+                std::lock_guard<std::mutex> l(sink->mutex);
+                sink->fail = false;
+            }
+            checkpointer.flush();
+            BOOST_CHECK_EQUAL(sink->saved.log_pos, 5);
+        }
+    }
+
+    void test_NativeValues()
+    {
+        using slave::ValueFormat;
+
+        // 1234567890.1234 and -1234567890.1234
+        slave::Field_decimal dec("d", "decimal(14,4)");
+        const char pos14[] = "\x81\x0d\xfb\x38\xd2\x04\xd2";
+        const char neg14[] = "\x7e\xf2\x04\xc7\x2d\xfb\x2d";
+        BOOST_CHECK_EQUAL(dec.unpack(pos14) - pos14, 7);
+        BOOST_CHECK_CLOSE(slave::get<double>(dec.field_data), 1234567890.1234, 1e-12);
+        dec.set_value_format(ValueFormat::Native);
+        BOOST_CHECK_EQUAL(dec.unpack(pos14) - pos14, 7);
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(dec.field_data), 12345678901234LL);
+        dec.unpack(neg14);
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(dec.field_data), -12345678901234LL);
+
+        // 12.34 and -12.34
+        slave::Field_decimal small("d", "decimal(5,2)");
+        small.set_value_format(ValueFormat::Native);
+        small.unpack("\x80\x0c\x22");
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(small.field_data), 1234);
+        small.unpack("\x7f\xf3\xdd");
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(small.field_data), -1234);
+
+        // 123456789.123456789, full groups only
+        slave::Field_decimal full("d", "decimal(18,9)");
+        full.set_value_format(ValueFormat::Native);
+        full.unpack("\x87\x5b\xcd\x15\x07\x5b\xcd\x15");
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(full.field_data), 123456789123456789LL);
+
+        // Does not fit into int64
+        slave::Field_decimal wide("d", "decimal(20,2)");
+        wide.set_value_format(ValueFormat::Native);
+        wide.unpack("\x80\x00\x00\x00\x00\x00\x00\x0c\x22");
+        BOOST_CHECK_CLOSE(slave::get<double>(wide.field_data), 12.34, 1e-12);
+
+        // 2011-03-13 09:49:09
+        struct tm t;
+        ::memset(&t, 0, sizeof(t));
+        t.tm_year = 2011 - 1900;
+        t.tm_mon = 2;
+        t.tm_mday = 13;
+        t.tm_hour = 9;
+        t.tm_min = 49;
+        t.tm_sec = 9;
+        const int64_t epoch_us = int64_t(::timegm(&t)) * 1000000;
+
+        const uint64_t packed = (uint64_t(1) << 39) | (uint64_t(2011 * 13 + 3) << 22) | (13 << 17) | (9 << 12) | (49 << 6) | 9;
+        char dt[8];
+        for (int i = 0; i < 5; ++i)
+            dt[i] = static_cast<char>(packed >> (8 * (4 - i)));
+        // .123456
+        dt[5] = '\x01';
+        dt[6] = '\xe2';
+        dt[7] = '\x40';
+
+        slave::Field_datetime datetime6("dt", "datetime(6)", false);
+        BOOST_CHECK_EQUAL(datetime6.unpack(dt) - dt, 8);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_DATETIME>(datetime6.field_data), 20110313094909ULL);
+        datetime6.set_value_format(ValueFormat::Native);
+        BOOST_CHECK_EQUAL(datetime6.unpack(dt) - dt, 8);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_DATETIME_US>(datetime6.field_data), epoch_us + 123456);
+
+        slave::Field_datetime datetime2("dt", "datetime(2)", false);
+        datetime2.set_value_format(ValueFormat::Native);
+        dt[5] = 12;
+        BOOST_CHECK_EQUAL(datetime2.unpack(dt) - dt, 6);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_DATETIME_US>(datetime2.field_data), epoch_us + 120000);
+
+        const char zero[5] = {'\x80', 0, 0, 0, 0};
+        slave::Field_datetime datetime0("dt", "datetime", false);
+        datetime0.set_value_format(ValueFormat::Native);
+        datetime0.unpack(zero);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_DATETIME_US>(datetime0.field_data), 0);
+
+        const uint64_t old = 20110313094909ULL;
+        char old_dt[8];
+        for (int i = 0; i < 8; ++i)
+            old_dt[i] = static_cast<char>(old >> (8 * i));
+        slave::Field_datetime datetime_old("dt", "datetime", true);
+        datetime_old.set_value_format(ValueFormat::Native);
+        datetime_old.unpack(old_dt);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_DATETIME_US>(datetime_old.field_data), epoch_us);
+
+        // 1300000000.123, 3-4 digits are stored in 1/10000 s
+        slave::Field_timestamp timestamp3("ts", "timestamp(3)", false);
+        timestamp3.set_value_format(ValueFormat::Native);
+        const char ts[] = "\x4d\x7c\x6d\x00\x04\xce";
+        BOOST_CHECK_EQUAL(timestamp3.unpack(ts) - ts, 6);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_TIMESTAMP_US>(timestamp3.field_data), 1300000000123000LL);
+        timestamp3.set_value_format(ValueFormat::Default);
+        timestamp3.unpack(ts);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_TIMESTAMP>(timestamp3.field_data), 1300000000);
+    }
+
+    void test_ColumnBatch()
+    {
+        struct CountingExtState : public slave::EmptyExtState
+        {
+            unsigned long rows = 0;
+            void incTableCount(const std::string& t, unsigned long count) override { rows += count; }
+        } state;
+
+        slave::collate_info collate;
+        collate.maxlen = 1;
+
+        slave::Table table("db", "tbl");
+        table.fields.emplace_back(new slave::Field_long("id", "int(11)"));
+        table.fields.emplace_back(new slave::Field_varstring("name", "varchar(10)", collate));
+        table.fields.emplace_back(new slave::Field_tiny("flag", "tinyint(4)"));
+        table.fields.emplace_back(new slave::Field_double("value", "double"));
+        table.fields.emplace_back(new slave::Field_long("skipped", "int(11)"));
+        table.set_column_filter({"value", "flag", "name", "id"});
+
+        table.m_filter = slave::eAll;
+
+        std::vector<slave::ColumnBatch> delivered;
+        table.m_columnar_callback = [&delivered](slave::ColumnBatch& batch) { delivered.push_back(batch); };
+        table.init_column_batch();
+
+        const auto& columns = table.column_batch().columns;
+        BOOST_REQUIRE_EQUAL(columns.size(), 4);
+        BOOST_CHECK_EQUAL(columns[1].name, "name");
+        BOOST_CHECK_EQUAL(columns[1].kind, slave::ColumnBatch::Binary);
+        BOOST_CHECK_EQUAL(columns[2].kind, slave::ColumnBatch::Integer);
+        BOOST_CHECK_EQUAL(columns[3].kind, slave::ColumnBatch::Real);
+
+        // Rows event with 5 columns, 'cols_ai' only for updates
+        auto makeEvent = [](const std::string& cols_ai, const std::string& rows)
+        {
+            std::string ev(LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN, '\0');
+            ev += "\x05\x1f";
+            return ev + cols_ai + rows;
+        };
+        auto row = [](uint32_t id, const char* name, char flag, double value)
+        {
+            std::string r(1, name ? '\0' : '\x02');
+            r.append((const char*)&id, 4);
+            if (name)
+                r += std::string(1, ::strlen(name)) + name;
+            r += flag;
+            r.append((const char*)&value, 8);
+            return r + std::string(4, '\0');
+        };
+
+        const std::string insert = makeEvent("", row(1, "ab", 7, 1.5) + row(2, nullptr, -1, 2.5));
+        slave::Basic_event_info bei;
+        bei.type = slave::WRITE_ROWS_EVENT;
+        bei.when = 1000;
+        bei.buf = insert.data();
+        bei.event_len = insert.size();
+        slave::apply_row_event(&table, bei, slave::Row_event_info(bei.buf, bei.event_len, false, true), state, nullptr);
+
+        BOOST_REQUIRE_EQUAL(delivered.size(), 1);
+        const slave::ColumnBatch& b = delivered[0];
+        BOOST_CHECK_EQUAL(b.tbl_name, "tbl");
+        BOOST_REQUIRE_EQUAL(b.rows(), 2);
+        BOOST_CHECK_EQUAL(b.ops[0], slave::ColumnBatch::Insert);
+        BOOST_CHECK_EQUAL(b.when[1], 1000);
+        BOOST_CHECK_EQUAL(b.columns[0].ints[1], 2);
+        BOOST_CHECK_EQUAL(b.columns[1].length, 2);
+        BOOST_CHECK_EQUAL(b.columns[1].null_count, 1);
+        BOOST_CHECK(!b.columns[1].isNull(0));
+        BOOST_CHECK(b.columns[1].isNull(1));
+        BOOST_REQUIRE_EQUAL(b.columns[1].offsets.size(), 3);
+        BOOST_CHECK_EQUAL(b.columns[1].offsets[1], 2);
+        BOOST_CHECK_EQUAL(b.columns[1].offsets[2], 2);
+        BOOST_CHECK_EQUAL(b.columns[1].data, "ab");
+        BOOST_CHECK_EQUAL(b.columns[2].ints[1], -1);
+        BOOST_CHECK_EQUAL(b.columns[2].validity[0], 3);
+        BOOST_CHECK_EQUAL(b.columns[3].reals[0], 1.5);
+        BOOST_CHECK_EQUAL(state.rows, 2);
+
+        // Batch is cleared after the callback
+        BOOST_CHECK_EQUAL(table.column_batch().rows(), 0);
+        BOOST_CHECK_EQUAL(table.column_batch().columns[1].offsets.size(), 1);
+
+        // Rows are kept until the end of transaction or the limit, columns missing from the after image are NULL
+        delivered.clear();
+        table.batch_flush.per_event = false;
+        table.batch_flush.max_rows = 3;
+        const std::string update = makeEvent("\x01", row(1, "ab", 7, 1.5) + std::string("\0\x03\0\0\0", 5));
+        bei.type = slave::UPDATE_ROWS_EVENT;
+        bei.buf = update.data();
+        bei.event_len = update.size();
+        const slave::Row_event_info uroi(bei.buf, bei.event_len, true, true);
+        slave::apply_row_event(&table, bei, uroi, state, nullptr);
+        BOOST_CHECK(delivered.empty());
+        BOOST_CHECK_EQUAL(table.column_batch().rows(), 2);
+
+        slave::apply_row_event(&table, bei, uroi, state, nullptr);
+        BOOST_REQUIRE_EQUAL(delivered.size(), 1);
+        BOOST_REQUIRE_EQUAL(delivered[0].rows(), 4);
+        BOOST_CHECK_EQUAL(delivered[0].ops[0], slave::ColumnBatch::UpdateBefore);
+        BOOST_CHECK_EQUAL(delivered[0].ops[1], slave::ColumnBatch::UpdateAfter);
+        BOOST_CHECK_EQUAL(delivered[0].columns[0].ints[1], 3);
+        BOOST_CHECK(delivered[0].columns[3].isNull(1));
+        BOOST_CHECK(!delivered[0].columns[3].isNull(2));
+        // An update is counted once
+        BOOST_CHECK_EQUAL(state.rows, 4);
+
+        // Nothing left for the end of transaction
+        table.call_columnar_callback(state);
+        BOOST_CHECK_EQUAL(delivered.size(), 1);
+
+        // A failed event does not drop rows of the earlier ones
+        table.batch_flush.max_rows = 0;
+        bei.type = slave::WRITE_ROWS_EVENT;
+        bei.buf = insert.data();
+        bei.event_len = insert.size();
+        slave::apply_row_event(&table, bei, slave::Row_event_info(bei.buf, bei.event_len, false, true), state, nullptr);
+        std::string bad = insert;
+        bad[LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN] = '\x06';
+        bei.buf = bad.data();
+        BOOST_CHECK_THROW(slave::apply_row_event(&table, bei, slave::Row_event_info(bei.buf, bei.event_len, false, true), state, nullptr),
+                          std::runtime_error);
+        BOOST_CHECK_EQUAL(table.column_batch().rows(), 2);
+
+        // Values of a partly appended row are dropped
+        slave::ColumnBatch& batch = table.column_batch();
+        batch.columns[0].appendInt(3);
+        batch.columns[1].appendNull();
+        batch.truncate(1);
+        BOOST_CHECK_EQUAL(batch.rows(), 1);
+        BOOST_CHECK_EQUAL(batch.columns[0].length, 1);
+        BOOST_CHECK_EQUAL(batch.columns[0].ints.size(), 1);
+        BOOST_CHECK_EQUAL(batch.columns[1].null_count, 0);
+        BOOST_CHECK_EQUAL(batch.columns[1].validity[0], 1);
+        BOOST_REQUIRE_EQUAL(batch.columns[1].offsets.size(), 2);
+        BOOST_CHECK_EQUAL(batch.columns[1].data, "ab");
+        BOOST_CHECK_EQUAL(batch.columns[3].reals.size(), 1);
+
+        table.call_columnar_callback(state);
+        BOOST_REQUIRE_EQUAL(delivered.size(), 2);
+        BOOST_CHECK_EQUAL(delivered[1].rows(), 1);
+    }
+
+    void test_StringRef()
+    {
+        slave::collate_info collate;
+        collate.maxlen = 1;
+
+        std::vector<std::unique_ptr<slave::Field>> fields;
+        fields.emplace_back(new slave::Field_varstring("name", "varchar(10)", collate));
+        fields.emplace_back(new slave::Field_blob("data", "blob"));
+        fields.emplace_back(new slave::Field_long("id", "int(11)"));
+        fields.emplace_back(new slave::Field_blob("null", "blob"));
+
+        // varchar 'abc', blob 'defghij', int 7
+        const char buf[] = "\x03" "abc" "\x07\x00" "defghij" "\x07\x00\x00\x00";
+        const char* ptr = buf;
+
+        slave::RowView view;
+        view.reset(fields);
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            const char* end = fields[i]->skip(ptr);
+            view.setValue(i, ptr, end);
+            ptr = end;
+        }
+        view.setNull(3);
+
+        // Values are not copied
+        const slave::StringRef name = view.stringRef(0);
+        BOOST_CHECK(name.data == buf + 1);
+        BOOST_CHECK_EQUAL(name.str(), "abc");
+        BOOST_CHECK(view.stringRef(1).data == buf + 6);
+        BOOST_CHECK_EQUAL(view.stringRef(1).size, 7);
+        BOOST_CHECK(view.stringRef(3).empty());
+        BOOST_CHECK_THROW(view.stringRef(2), std::runtime_error);
+
+        std::vector<std::string> chunks;
+        view.forEachChunk(1, 3, [&chunks](const char* data, size_t size) { chunks.emplace_back(data, size); });
+        BOOST_REQUIRE_EQUAL(chunks.size(), 3);
+        BOOST_CHECK_EQUAL(chunks[0], "def");
+        BOOST_CHECK_EQUAL(chunks[2], "j");
+        BOOST_CHECK_THROW(view.forEachChunk(1, 0, [](const char*, size_t) {}), std::invalid_argument);
+
+        // Decoded value is moved out of the field
+        BOOST_CHECK_EQUAL(view.get<std::string>(1), "defghij");
+        BOOST_CHECK(slave::isNullFieldValue(fields[1]->field_data));
+    }
+
+    void test_RowImageNullBits()
+    {
+        slave::EmptyExtState state;
+
+        // Unused bits of the last null byte are set, as MySQL 5.x and MariaDB do
+        for (unsigned n : {1, 2, 3, 4, 5, 6, 7, 9})
+        {
+            slave::Table table("db", "tbl");
+            for (unsigned i = 0; i < n; ++i)
+                table.fields.emplace_back(new slave::Field_tiny("c" + std::to_string(i), "tinyint(4)"));
+            table.row_type = slave::RowType::Map;
+            table.m_filter = slave::eAll;
+
+            std::vector<slave::Row> rows;
+            table.m_callback = [&rows](slave::RecordSet& rs) { rows.push_back(rs.m_row); };
+
+            const size_t null_bytes = (n + 7) / 8;
+            const unsigned char unused = (n & 7) ? 0xff << (n & 7) : 0;
+
+            // Column 0 and the last one are NULL in the second row
+            std::string nulls(null_bytes, '\0');
+            nulls[null_bytes - 1] = unused;
+            std::string row = nulls;
+            for (unsigned i = 0; i < n; ++i)
+                row += static_cast<char>(i + 1);
+            nulls[0] |= 1;
+            nulls[(n - 1) / 8] |= 1 << ((n - 1) & 7);
+            row += nulls;
+            for (unsigned i = 1; i + 1 < n; ++i)
+                row += static_cast<char>(i + 1);
+
+            std::string ev(LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN, '\0');
+            ev += static_cast<char>(n) + std::string(null_bytes, '\xff') + row;
+
+            slave::Basic_event_info bei;
+            bei.type = slave::WRITE_ROWS_EVENT;
+            bei.buf = ev.data();
+            bei.event_len = ev.size();
+            slave::apply_row_event(&table, bei, slave::Row_event_info(bei.buf, bei.event_len, false, true), state, nullptr);
+
+            BOOST_REQUIRE_EQUAL(rows.size(), 2);
+            for (unsigned i = 0; i < n; ++i)
+            {
+                const std::string name = "c" + std::to_string(i);
+                BOOST_CHECK_EQUAL(int(slave::get<slave::types::MY_TINYINT>(rows[0].at(name).second)), int(i + 1));
+
+                if (i == 0 || i == n - 1)
+                    BOOST_CHECK(slave::isNullFieldValue(rows[1].at(name).second));
+                else
+                    BOOST_CHECK_EQUAL(int(slave::get<slave::types::MY_TINYINT>(rows[1].at(name).second)), int(i + 1));
+            }
+        }
+    }
+
+    void test_EarlyEventFilter()
+    {
+        auto event = [](unsigned char type, uint16_t flags, size_t len)
+        {
+            std::string ev(len, '\0');
+            ev[EVENT_TYPE_OFFSET] = static_cast<char>(type);
+            ev[FLAGS_OFFSET] = static_cast<char>(flags & 0xff);
+            ev[FLAGS_OFFSET + 1] = static_cast<char>(flags >> 8);
+            return ev;
+        };
+
+        const size_t len = LOG_EVENT_HEADER_LEN + 10;
+        BOOST_CHECK(slave::ignorable_event(event(slave::ROWS_QUERY_LOG_EVENT, 0, len).data(), len));
+        BOOST_CHECK(slave::ignorable_event(event(slave::IGNORABLE_LOG_EVENT, 0, len).data(), len));
+        BOOST_CHECK(slave::ignorable_event(event(ANNOTATE_ROWS_EVENT, 0, len).data(), len));
+        BOOST_CHECK(slave::ignorable_event(event(200, LOG_EVENT_IGNORABLE_F, len).data(), len));
+        BOOST_CHECK(!slave::ignorable_event(event(slave::WRITE_ROWS_EVENT, 0, len).data(), len));
+        BOOST_CHECK(!slave::ignorable_event(event(slave::QUERY_EVENT, LOG_EVENT_SKIP_REPLICATION_F, len).data(), len));
+        BOOST_CHECK(!slave::ignorable_event(event(slave::ROWS_QUERY_LOG_EVENT, 0, len).data(), LOG_EVENT_HEADER_LEN - 1));
+
+        auto packed_str = [](const std::string& v) { return std::string(1, static_cast<char>(v.size())) + v + '\0'; };
+        const std::string tm = std::string(LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN, '\0') + packed_str("test") + packed_str("tbl") + "\x01\x03";
+
+        const slave::Table_map_event_view view(tm.data(), tm.size());
+        BOOST_CHECK_EQUAL(std::string(view.db_name, view.db_len), "test");
+        BOOST_CHECK_EQUAL(std::string(view.tbl_name, view.tbl_len), "tbl");
+
+        BOOST_CHECK_EQUAL(view.table_id, 0);
+
+        // Names do not fit in the event
+        BOOST_CHECK_THROW(slave::Table_map_event_view(tm.data(), tm.size() - 4), std::runtime_error);
+        BOOST_CHECK_THROW(slave::Table_map_event_view(tm.data(), LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN + 4), std::runtime_error);
+        BOOST_CHECK_THROW(slave::Table_map_event_view(tm.data(), LOG_EVENT_HEADER_LEN + 2), std::runtime_error);
+
+        // Table id is reused by an unwatched table after a restart of the master
+        auto table_map = [&packed_str](unsigned long id, const std::string& table)
+        {
+            std::string ev(LOG_EVENT_HEADER_LEN + TABLE_MAP_HEADER_LEN, '\0');
+            for (unsigned i = 0; i < 6; ++i)
+                ev[LOG_EVENT_HEADER_LEN + TM_MAPID_OFFSET + i] = (id >> (8 * i)) & 0xff;
+            return ev + packed_str("db") + packed_str(table) + "\x01\x03";
+        };
+        const std::set<std::pair<std::string, std::string>> watched = { { "db", "tbl" } };
+
+        slave::RelayLogInfo rli;
+        rli.setTable("tbl", "db", slave::PtrTable(new slave::Table("db", "tbl")));
+
+        const std::string first = table_map(10, "tbl");
+        BOOST_CHECK(!slave::skip_table_map_event(rli, first.data(), first.size(), watched));
+        rli.setTableName(10, "tbl", "db");
+        BOOST_CHECK(rli.getTableById(10) != nullptr);
+
+        const std::string reused = table_map(10, "other");
+        BOOST_CHECK(slave::skip_table_map_event(rli, reused.data(), reused.size(), watched));
+        BOOST_CHECK(rli.getTableById(10) == nullptr);
+        BOOST_CHECK(rli.getTableNameById(10).first.empty());
+
+        std::vector<char> rows(LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN + 2);
+        rows[LOG_EVENT_HEADER_LEN + RW_MAPID_OFFSET] = 10;
+        slave::Basic_event_info bei;
+        bei.buf = rows.data();
+        bei.event_len = rows.size();
+        bei.type = slave::WRITE_ROWS_EVENT;
+        BOOST_CHECK(slave::skip_row_event(rli, bei, nullptr));
+    }
+
+    void test_StageProbes()
+    {
+        slave::HistogramEventStat stat;
+        BOOST_CHECK(stat.report().find("stage_") == std::string::npos);
+
+        stat.tickStage(slave::psDecode, 100, 2000);
+        stat.tickStage(slave::psDecode, 50, 1000);
+        stat.tickAlloc(slave::psDecode, 3, 120);
+
+        BOOST_CHECK_EQUAL(stat.stageTime(slave::psDecode).count(), 2);
+        BOOST_CHECK_EQUAL(stat.stageBytes(slave::psDecode), 150);
+        BOOST_CHECK_EQUAL(stat.stageAllocs(slave::psDecode), 3);
+        BOOST_CHECK_EQUAL(stat.stageAllocBytes(slave::psDecode), 120);
+        BOOST_CHECK_EQUAL(stat.stageTime(slave::psRead).count(), 0);
+        BOOST_CHECK(stat.report().find("stage_decode bytes=150 allocs=3 alloc_bytes=120") != std::string::npos);
+        BOOST_CHECK(stat.report().find("stage_read") == std::string::npos);
+
+#if defined(SLAVE_WITH_PROBES)
+        {
+            SLAVE_PROBE_BEGIN(probe, &stat, slave::psCallback);
+            SLAVE_PROBE_STRING_ALLOC(1000);
+            SLAVE_PROBE_STRING_ALLOC(1);
+            SLAVE_PROBE_END(probe, 10);
+        }
+        BOOST_CHECK_EQUAL(stat.stageBytes(slave::psCallback), 10);
+        BOOST_CHECK_EQUAL(stat.stageAllocs(slave::psCallback), 1);
+        BOOST_CHECK_EQUAL(stat.stageAllocBytes(slave::psCallback), 1001);
+
+        {
+            SLAVE_PROBE_BEGIN(probe, &stat, slave::psParse);
+            SLAVE_PROBE_FIELD_VALUE(slave::nullFieldValue());
+            SLAVE_PROBE_FIELD_VALUE(slave::FieldValue(uint32_t(1)));
+            SLAVE_PROBE_END(probe, 10);
+        }
+#if !defined(SLAVE_USE_TAGGED_FIELD_VALUE) && !defined(SLAVE_USE_VARIANT_FOR_FIELD_VALUE)
+        BOOST_CHECK_EQUAL(stat.stageAllocs(slave::psParse), 1);
+#else
+        BOOST_CHECK_EQUAL(stat.stageAllocs(slave::psParse), 0);
+#endif
+#endif
+    }
+
+    void test_FlowControl()
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool open = false;
+        auto gated = [&]()
+        {
+            std::unique_lock<std::mutex> l(mutex);
+            cond.wait(l, [&open] { return open; });
+        };
+        auto release = [&]()
+        {
+            {
+                std::lock_guard<std::mutex> l(mutex);
+                open = true;
+            }
+            cond.notify_all();
+        };
+
+        slave::Dispatcher dispatcher(2);
+        slave::Dispatcher::Group group;
+        group.setLimits(2, 100);
+
+        BOOST_CHECK_EQUAL(dispatcher.dispatch(group, 0, gated, 40).tasks, 1);
+        const slave::Dispatcher::Backlog second = dispatcher.dispatch(group, 1, gated, 40);
+        BOOST_CHECK_EQUAL(second.tasks, 2);
+        BOOST_CHECK_EQUAL(second.bytes, 80);
+        BOOST_CHECK_EQUAL(second.wait_ns, 0);
+
+        // Third task waits for the task cap
+        std::atomic<bool> dispatched(false);
+        slave::Dispatcher::Backlog third;
+        std::thread reader([&]()
+        {
+            third = dispatcher.dispatch(group, 0, []() {}, 10);
+            dispatched = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        BOOST_CHECK(!dispatched);
+        release();
+        reader.join();
+        BOOST_CHECK(third.wait_ns > 0);
+        dispatcher.drain(group);
+
+        // Task bigger than the byte cap passes alone
+        open = false;
+        BOOST_CHECK_EQUAL(dispatcher.dispatch(group, 0, gated, 500).wait_ns, 0);
+        dispatched = false;
+        std::thread big([&]()
+        {
+            dispatcher.dispatch(group, 1, []() {}, 1);
+            dispatched = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        BOOST_CHECK(!dispatched);
+        release();
+        big.join();
+        dispatcher.drain(group);
+
+        // Pipelined read queue capped by bytes
+        slave::EventQueue queue(10, 100);
+        for (int i = 0; i < 2; ++i)
+        {
+            BOOST_REQUIRE(queue.acquire());
+            queue.push(60);
+        }
+        BOOST_CHECK_EQUAL(queue.queued(), 2);
+        BOOST_CHECK_EQUAL(queue.queuedBytes(), 120);
+
+        std::atomic<bool> acquired(false);
+        std::thread producer([&]()
+        {
+            if (queue.acquire())
+            {
+                acquired = true;
+                queue.push(10);
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        BOOST_CHECK(!acquired);
+        BOOST_REQUIRE(queue.front());
+        queue.pop();
+        producer.join();
+        BOOST_CHECK(acquired);
+        BOOST_CHECK_EQUAL(queue.queuedBytes(), 70);
+
+        slave::HistogramEventStat stat;
+        stat.tickBacklog(slave::bqDispatch, 3, 300);
+        stat.tickBacklog(slave::bqDispatch, 1, 100);
+        stat.tickBackpressure(1000);
+        BOOST_CHECK_EQUAL(stat.backlogEvents(slave::bqDispatch), 1);
+        BOOST_CHECK_EQUAL(stat.maxBacklogEvents(slave::bqDispatch), 3);
+        BOOST_CHECK_EQUAL(stat.maxBacklogBytes(slave::bqDispatch), 300);
+        BOOST_CHECK_EQUAL(stat.maxBacklogEvents(slave::bqPipeline), 0);
+        BOOST_CHECK_EQUAL(stat.backpressure().count(), 1);
+        BOOST_CHECK(stat.report().find("backlog_dispatch events=1 bytes=100 max_events=3 max_bytes=300") != std::string::npos);
+    }
+
 }// anonymous-namespace
 
 test_suite* init_unit_test_suite(int argc, char* argv[])
@@ -1729,6 +3558,37 @@ test_suite* init_unit_test_suite(int argc, char* argv[])
     ADD_FIXTURE_TEST(test_AlterCreateTable);
     ADD_FIXTURE_TEST(test_GtidParsing);
     ADD_FIXTURE_TEST(test_GtidAdding);
+    ADD_FIXTURE_TEST(test_RowView);
+    ADD_FIXTURE_TEST(test_RecordSetReuse);
+    ADD_FIXTURE_TEST(test_TaggedValue);
+    ADD_FIXTURE_TEST(test_EventQueue);
+    ADD_FIXTURE_TEST(test_Dispatcher);
+    ADD_FIXTURE_TEST(test_BatchCallback);
+    ADD_FIXTURE_TEST(test_TableIdLookup);
+    ADD_FIXTURE_TEST(test_SkipRowEvent);
+    ADD_FIXTURE_TEST(test_ColumnFilterPlan);
+    ADD_FIXTURE_TEST(test_Crc32);
+    ADD_FIXTURE_TEST(test_CreateField);
+    ADD_FIXTURE_TEST(test_BinlogFile);
+    ADD_FIXTURE_TEST(test_PacketReader);
+    ADD_FIXTURE_TEST(test_TransactionPayload);
+    ADD_FIXTURE_TEST(test_AtomicExtState);
+    ADD_FIXTURE_TEST(test_LatencyHistogram);
+    ADD_FIXTURE_TEST(test_TableMapSchema);
+    ADD_FIXTURE_TEST(test_DdlScanner);
+    ADD_FIXTURE_TEST(test_QueryEvent);
+    ADD_FIXTURE_TEST(test_DispatcherGroups);
+    ADD_FIXTURE_TEST(test_PacketReaderNonBlocking);
+    ADD_FIXTURE_TEST(test_SchemaSnapshot);
+    ADD_FIXTURE_TEST(test_GtidSet);
+    ADD_FIXTURE_TEST(test_Checkpointer);
+    ADD_FIXTURE_TEST(test_NativeValues);
+    ADD_FIXTURE_TEST(test_ColumnBatch);
+    ADD_FIXTURE_TEST(test_StringRef);
+    ADD_FIXTURE_TEST(test_RowImageNullBits);
+    ADD_FIXTURE_TEST(test_EarlyEventFilter);
+    ADD_FIXTURE_TEST(test_StageProbes);
+    ADD_FIXTURE_TEST(test_FlowControl);
 
 #undef ADD_FIXTURE_TEST
 
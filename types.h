@@ -2,6 +2,7 @@
 #define __SLAVE_TYPES_H
 
 #include <inttypes.h>
+#include <string.h>
 #include <string>
 #include <time.h>
 
@@ -10,7 +11,9 @@
 #undef test
 #endif /* test */
 
-#ifdef SLAVE_USE_VARIANT_FOR_FIELD_VALUE
+#if defined(SLAVE_USE_TAGGED_FIELD_VALUE)
+#include "tagged_value.h"
+#elif defined(SLAVE_USE_VARIANT_FOR_FIELD_VALUE)
 #include <cstddef>              // for std::nullptr_t
 #include <boost/variant.hpp>
 #else
@@ -43,6 +46,15 @@ namespace types
     typedef std::string         MY_LONGTEXT;
     typedef std::string         MY_BLOB;
 
+    // Types of ValueFormat::Native
+    // decimal(M,D) with M <= 18 as an integer scaled by 10^D: 12.34 of decimal(5,2) is 1234
+    typedef int64_t             MY_DECIMAL_SCALED;
+    // Microseconds since 1970-01-01 00:00:00 UTC
+    typedef int64_t             MY_TIMESTAMP_US;
+    // Microseconds since 1970-01-01 00:00:00 as if the value was in UTC, without timezone
+    // conversion; '0000-00-00 00:00:00' is 0
+    typedef int64_t             MY_DATETIME_US;
+
     // NOTE you should call tzset directly or indirectly before using any of these functions
     // for proper initialization of daylight variable
 
@@ -92,10 +104,44 @@ namespace types
 
 enum class RowType {
     Map,
-    Vector
+    Vector,
+    View
+};
+
+// How values of DECIMAL, DATETIME and TIMESTAMP columns are stored
+enum class ValueFormat {
+    // MY_DECIMAL, MY_DATETIME and MY_TIMESTAMP, fractional seconds are dropped
+    Default,
+    // MY_DECIMAL_SCALED (wider decimals stay MY_DECIMAL), MY_DATETIME_US and MY_TIMESTAMP_US
+    Native
+};
+
+// Bytes of a string or blob value inside the event buffer, see RowView::stringRef
+struct StringRef
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    StringRef() {}
+    StringRef(const char* d, size_t s) : data(d), size(s) {}
+
+    bool empty() const { return size == 0; }
+    std::string str() const { return std::string(data, size); }
 };
 
-#ifdef SLAVE_USE_VARIANT_FOR_FIELD_VALUE
+#if defined(SLAVE_USE_TAGGED_FIELD_VALUE)
+    using FieldValue = TaggedValue;
+    inline TaggedValue nullFieldValue() { return TaggedValue(); }
+    inline bool isNullFieldValue(const FieldValue& v) { return v.empty(); }
+    inline std::string& stringFieldValue(FieldValue& v) { return v.make_str(); }
+    template <typename T>
+    T get(const FieldValue& v)
+    {
+        if (v.tag() != TaggedValueTraits<T>::tag)
+            throw bad_tagged_value_cast();
+        return TaggedValueTraits<T>::get(v);
+    }
+#elif defined(SLAVE_USE_VARIANT_FOR_FIELD_VALUE)
     using FieldValue = boost::variant<std::nullptr_t
                                     , int
                                     , char
@@ -103,18 +149,33 @@ enum class RowType {
                                     , int32_t
                                     , uint32_t
                                     , unsigned long long
+                                    , int64_t
                                     , float
                                     , double
                                     , std::string
                                     >;
     inline std::nullptr_t nullFieldValue() { return nullptr; }
     inline bool isNullFieldValue(const FieldValue& v) { return v.type() == typeid(std::nullptr_t); }
+    inline std::string& stringFieldValue(FieldValue& v)
+    {
+        if (std::string* s = boost::get<std::string>(&v))
+            return *s;
+        v = std::string();
+        return boost::get<std::string>(v);
+    }
     template <typename T>
     const T& get(const FieldValue& v) { return boost::get<T>(v); }
 #else
     using FieldValue = boost::any;
     inline boost::any nullFieldValue() { return boost::any(); }
     inline bool isNullFieldValue(const FieldValue& v) { return v.empty(); }
+    inline std::string& stringFieldValue(FieldValue& v)
+    {
+        if (std::string* s = boost::any_cast<std::string>(&v))
+            return *s;
+        v = std::string();
+        return *boost::any_cast<std::string>(&v);
+    }
     template <typename T>
     T get(const FieldValue& v) { return boost::any_cast<T>(v); }
 #endif